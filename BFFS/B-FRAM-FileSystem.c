@@ -1,321 +1,3488 @@
 #include <B-FRAM-FileSystem.h>
 
-/* File System functions */
-bffs_st save_fs()
+/* Bits identifying the fields of a file struct, in the order they are laid out in memory (and thus in FRAM) */
+#define FILE_FIELD_FILENAME		0x01
+#define FILE_FIELD_READ_PTR		0x02
+#define FILE_FIELD_WRITE_PTR	0x04
+#define FILE_FIELD_START_PTR	0x08
+#define FILE_FIELD_END_PTR		0x10
+#define FILE_FIELD_TYPE			0x20
+#define FILE_FIELD_WRAP_COUNT	0x40
+#define FILE_FIELD_RECORD_SIZE	0x80
+#define FILE_FIELD_ALL			0xFF
+#define FILE_FIELD_COUNT		8
+
+/* Bits identifying the header fields of the file system struct, in the order they are laid out in memory */
+#define FS_FIELD_FILE_IDX		0x01
+#define FS_FIELD_WRITE_PTR		0x02
+#define FS_FIELD_END_PTR		0x04
+#define FS_FIELD_START_PTR		0x08
+#define FS_FIELD_MOVE			0x10
+#define FS_FIELD_FREE_COUNT		0x20
+#define FS_FIELD_FREE_EXTENTS	0x40
+#define FS_FIELD_ALL			0x7F
+#define FS_FIELD_COUNT			7
+
+#define FIELD_SIZE(type,field) sizeof(((type*)0)->field)
+
+static const uint16_t file_field_offset[FILE_FIELD_COUNT] = {
+	offsetof(file_t,filename), offsetof(file_t,read_ptr), offsetof(file_t,write_ptr),
+	offsetof(file_t,start_ptr), offsetof(file_t,end_ptr), offsetof(file_t,type), offsetof(file_t,wrap_count),
+	offsetof(file_t,record_size)};
+static const uint16_t file_field_size[FILE_FIELD_COUNT] = {
+	MAX_FILENAME_SIZE, FIELD_SIZE(file_t,read_ptr), FIELD_SIZE(file_t,write_ptr), FIELD_SIZE(file_t,start_ptr),
+	FIELD_SIZE(file_t,end_ptr), FIELD_SIZE(file_t,type), FIELD_SIZE(file_t,wrap_count), FIELD_SIZE(file_t,record_size)};
+
+static const uint16_t fs_field_offset[FS_FIELD_COUNT] = {
+	offsetof(file_system_t,file_idx), offsetof(file_system_t,write_ptr),
+	offsetof(file_system_t,end_ptr), offsetof(file_system_t,start_ptr), offsetof(file_system_t,move_slot),
+	offsetof(file_system_t,free_extent_count), offsetof(file_system_t,free_extents)};
+static const uint16_t fs_field_size[FS_FIELD_COUNT] = {
+	FIELD_SIZE(file_system_t,file_idx), FIELD_SIZE(file_system_t,write_ptr), FIELD_SIZE(file_system_t,end_ptr),
+	FIELD_SIZE(file_system_t,start_ptr),
+	offsetof(file_system_t,move_done)+FIELD_SIZE(file_system_t,move_done)-offsetof(file_system_t,move_slot),
+	FIELD_SIZE(file_system_t,free_extent_count), FIELD_SIZE(file_system_t,free_extents)};
+
+#if BFFS_STATS
+#if BFFS_THREAD_SAFE
+/* Counters are bumped by calls on different files at the same time */
+#define STATS_ADD(field,value)	__atomic_fetch_add(&bffs->stats.field,(value),__ATOMIC_RELAXED)
+#define STATS_OP(op)			__atomic_fetch_add(&bffs->stats.op_calls[op],1,__ATOMIC_RELAXED)
+#else
+#define STATS_ADD(field,value)	(bffs->stats.field += (value))
+#define STATS_OP(op)			(bffs->stats.op_calls[op]++)
+#endif
+#else
+#define STATS_ADD(field,value)
+#define STATS_OP(op)
+#endif
+
+/* Locking: public functions take the locks and leave the work to static _locked functions, called with the locks held,
+ * so public functions sharing each other's work don't lock twice. Calls on a file take the table lock shared and the file
+ * lock, and only touch the fields of their file and the commit state under the commit lock. Everything else changing
+ * the table takes it exclusive. Without lock hooks (or BFFS_THREAD_SAFE) locking does nothing */
+#define TABLE_SHARED 1
+#define TABLE_EXCLUSIVE 0
+
+#if BFFS_THREAD_SAFE
+static void take_lock(bffs_t* bffs, void* lock, uint8_t shared)
 {
-	/* Write file system strct in the beginning of FRAM*/
-	write_FRAM(0,FS_STRCT_SIZE,&BFFS);
-	return SAVE_FS_SUCCESS;
+	if (lock != NULL)
+	{
+		bffs->lock_hooks.lock(lock,shared);
+	}
 }
 
-bffs_st load_fs()
+static void give_lock(bffs_t* bffs, void* lock, uint8_t shared)
+{
+	if (lock != NULL)
+	{
+		bffs->lock_hooks.unlock(lock,shared);
+	}
+}
+#endif
+
+static void lock_table(bffs_t* bffs, uint8_t shared)
+{
+#if BFFS_THREAD_SAFE
+	take_lock(bffs,bffs->table_lock,shared);
+#else
+	(void)bffs;
+	(void)shared;
+#endif
+}
+
+static void unlock_table(bffs_t* bffs, uint8_t shared)
 {
-	/* Read file system strct from the beginning of FRAM*/
-	read_FRAM(0,FS_STRCT_SIZE,&BFFS);
+#if BFFS_THREAD_SAFE
+	give_lock(bffs,bffs->table_lock,shared);
+#else
+	(void)bffs;
+	(void)shared;
+#endif
+}
 
-	//try to look for faulty conditions to validate the fs that is being loaded
-	if (BFFS.end_ptr>FRAM_SIZE)
+static void lock_commit(bffs_t* bffs)
+{
+#if BFFS_THREAD_SAFE
+	take_lock(bffs,bffs->commit_lock,0);
+#else
+	(void)bffs;
+#endif
+}
+
+static void unlock_commit(bffs_t* bffs)
+{
+#if BFFS_THREAD_SAFE
+	give_lock(bffs,bffs->commit_lock,0);
+#else
+	(void)bffs;
+#endif
+}
+
+static uint8_t get_bus(bffs_t* bffs, uint8_t device)
+{
+	return (bffs->driver->get_bus != NULL) ? bffs->driver->get_bus(bffs->driver_ctx,device) : 0;
+}
+
+/* Driver calls on one bus never overlap, calls on devices of other buses do. Bus locks are shared by the volumes of a
+ * driver context, as partitions of a device are on the same bus */
+static void lock_bus(bffs_t* bffs, uint8_t device)
+{
+#if BFFS_THREAD_SAFE
+	take_lock(bffs,bffs->bus_locks[get_bus(bffs,device)],0);
+#else
+	(void)bffs;
+	(void)device;
+#endif
+}
+
+static void unlock_bus(bffs_t* bffs, uint8_t device)
+{
+#if BFFS_THREAD_SAFE
+	give_lock(bffs,bffs->bus_locks[get_bus(bffs,device)],0);
+#else
+	(void)bffs;
+	(void)device;
+#endif
+}
+
+/* CRC-32 (IEEE 802.3, reflected) lookup table, one entry per byte value */
+static const uint32_t crc32_table[256] = {
+	0x00000000, 0x77073096, 0xEE0E612C, 0x990951BA, 0x076DC419, 0x706AF48F,
+	0xE963A535, 0x9E6495A3, 0x0EDB8832, 0x79DCB8A4, 0xE0D5E91E, 0x97D2D988,
+	0x09B64C2B, 0x7EB17CBD, 0xE7B82D07, 0x90BF1D91, 0x1DB71064, 0x6AB020F2,
+	0xF3B97148, 0x84BE41DE, 0x1ADAD47D, 0x6DDDE4EB, 0xF4D4B551, 0x83D385C7,
+	0x136C9856, 0x646BA8C0, 0xFD62F97A, 0x8A65C9EC, 0x14015C4F, 0x63066CD9,
+	0xFA0F3D63, 0x8D080DF5, 0x3B6E20C8, 0x4C69105E, 0xD56041E4, 0xA2677172,
+	0x3C03E4D1, 0x4B04D447, 0xD20D85FD, 0xA50AB56B, 0x35B5A8FA, 0x42B2986C,
+	0xDBBBC9D6, 0xACBCF940, 0x32D86CE3, 0x45DF5C75, 0xDCD60DCF, 0xABD13D59,
+	0x26D930AC, 0x51DE003A, 0xC8D75180, 0xBFD06116, 0x21B4F4B5, 0x56B3C423,
+	0xCFBA9599, 0xB8BDA50F, 0x2802B89E, 0x5F058808, 0xC60CD9B2, 0xB10BE924,
+	0x2F6F7C87, 0x58684C11, 0xC1611DAB, 0xB6662D3D, 0x76DC4190, 0x01DB7106,
+	0x98D220BC, 0xEFD5102A, 0x71B18589, 0x06B6B51F, 0x9FBFE4A5, 0xE8B8D433,
+	0x7807C9A2, 0x0F00F934, 0x9609A88E, 0xE10E9818, 0x7F6A0DBB, 0x086D3D2D,
+	0x91646C97, 0xE6635C01, 0x6B6B51F4, 0x1C6C6162, 0x856530D8, 0xF262004E,
+	0x6C0695ED, 0x1B01A57B, 0x8208F4C1, 0xF50FC457, 0x65B0D9C6, 0x12B7E950,
+	0x8BBEB8EA, 0xFCB9887C, 0x62DD1DDF, 0x15DA2D49, 0x8CD37CF3, 0xFBD44C65,
+	0x4DB26158, 0x3AB551CE, 0xA3BC0074, 0xD4BB30E2, 0x4ADFA541, 0x3DD895D7,
+	0xA4D1C46D, 0xD3D6F4FB, 0x4369E96A, 0x346ED9FC, 0xAD678846, 0xDA60B8D0,
+	0x44042D73, 0x33031DE5, 0xAA0A4C5F, 0xDD0D7CC9, 0x5005713C, 0x270241AA,
+	0xBE0B1010, 0xC90C2086, 0x5768B525, 0x206F85B3, 0xB966D409, 0xCE61E49F,
+	0x5EDEF90E, 0x29D9C998, 0xB0D09822, 0xC7D7A8B4, 0x59B33D17, 0x2EB40D81,
+	0xB7BD5C3B, 0xC0BA6CAD, 0xEDB88320, 0x9ABFB3B6, 0x03B6E20C, 0x74B1D29A,
+	0xEAD54739, 0x9DD277AF, 0x04DB2615, 0x73DC1683, 0xE3630B12, 0x94643B84,
+	0x0D6D6A3E, 0x7A6A5AA8, 0xE40ECF0B, 0x9309FF9D, 0x0A00AE27, 0x7D079EB1,
+	0xF00F9344, 0x8708A3D2, 0x1E01F268, 0x6906C2FE, 0xF762575D, 0x806567CB,
+	0x196C3671, 0x6E6B06E7, 0xFED41B76, 0x89D32BE0, 0x10DA7A5A, 0x67DD4ACC,
+	0xF9B9DF6F, 0x8EBEEFF9, 0x17B7BE43, 0x60B08ED5, 0xD6D6A3E8, 0xA1D1937E,
+	0x38D8C2C4, 0x4FDFF252, 0xD1BB67F1, 0xA6BC5767, 0x3FB506DD, 0x48B2364B,
+	0xD80D2BDA, 0xAF0A1B4C, 0x36034AF6, 0x41047A60, 0xDF60EFC3, 0xA867DF55,
+	0x316E8EEF, 0x4669BE79, 0xCB61B38C, 0xBC66831A, 0x256FD2A0, 0x5268E236,
+	0xCC0C7795, 0xBB0B4703, 0x220216B9, 0x5505262F, 0xC5BA3BBE, 0xB2BD0B28,
+	0x2BB45A92, 0x5CB36A04, 0xC2D7FFA7, 0xB5D0CF31, 0x2CD99E8B, 0x5BDEAE1D,
+	0x9B64C2B0, 0xEC63F226, 0x756AA39C, 0x026D930A, 0x9C0906A9, 0xEB0E363F,
+	0x72076785, 0x05005713, 0x95BF4A82, 0xE2B87A14, 0x7BB12BAE, 0x0CB61B38,
+	0x92D28E9B, 0xE5D5BE0D, 0x7CDCEFB7, 0x0BDBDF21, 0x86D3D2D4, 0xF1D4E242,
+	0x68DDB3F8, 0x1FDA836E, 0x81BE16CD, 0xF6B9265B, 0x6FB077E1, 0x18B74777,
+	0x88085AE6, 0xFF0F6A70, 0x66063BCA, 0x11010B5C, 0x8F659EFF, 0xF862AE69,
+	0x616BFFD3, 0x166CCF45, 0xA00AE278, 0xD70DD2EE, 0x4E048354, 0x3903B3C2,
+	0xA7672661, 0xD06016F7, 0x4969474D, 0x3E6E77DB, 0xAED16A4A, 0xD9D65ADC,
+	0x40DF0B66, 0x37D83BF0, 0xA9BCAE53, 0xDEBB9EC5, 0x47B2CF7F, 0x30B5FFE9,
+	0xBDBDF21C, 0xCABAC28A, 0x53B39330, 0x24B4A3A6, 0xBAD03605, 0xCDD70693,
+	0x54DE5729, 0x23D967BF, 0xB3667A2E, 0xC4614AB8, 0x5D681B02, 0x2A6F2B94,
+	0xB40BBE37, 0xC30C8EA1, 0x5A05DF1B, 0x2D02EF8D
+};
+
+/* CRC-32 of data, continuing from the CRC of what came before it (0 to start) */
+static uint32_t crc32(uint32_t crc, const void* data, size_t length)
+{
+	const uint8_t* bytes = data;
+
+	crc ^= 0xFFFFFFFF;
+	while (length--)
 	{
-		return LOAD_FS_INVALID_FS;
+		crc = crc32_table[(crc ^ *bytes++) & 0xFF] ^ (crc >> 8);
 	}
-	if (BFFS.write_ptr>BFFS.end_ptr)
+	return crc ^ 0xFFFFFFFF;
+}
+
+/* Driver access: every FRAM transfer made by BFFS goes through these, telling file data (payload) apart from
+ * file system struct and journal (metadata) traffic, metadata being everything below FS_OFFSET */
+static void account_bytes(bffs_t* bffs, uint8_t is_write, fram_addr_t address, fram_addr_t data_length)
+{
+#if BFFS_STATS
+	uint8_t metadata = (address < FS_OFFSET);
+	if (is_write && metadata)
 	{
-		return LOAD_FS_INVALID_FS;
+		STATS_ADD(metadata_bytes_written,data_length);
 	}
-	if (BFFS.file_idx > MAX_FILES)
+	else if (is_write)
 	{
-		return LOAD_FS_INVALID_FS;
+		STATS_ADD(payload_bytes_written,data_length);
 	}
-	if (BFFS.file_idx == 0)
+	else if (metadata)
 	{
-		return LOAD_FS_INVALID_FS;
+		STATS_ADD(metadata_bytes_read,data_length);
 	}
-	if (BFFS.start_ptr>BFFS.write_ptr)
+	else
 	{
-		return LOAD_FS_INVALID_FS;
+		STATS_ADD(payload_bytes_read,data_length);
 	}
-	return LOAD_FS_SUCCESS;
-
+#else
+	(void)bffs;
+	(void)is_write;
+	(void)address;
+	(void)data_length;
+#endif
 }
 
-bffs_st reset_fs()
+static void account_segments(bffs_t* bffs, uint8_t is_write, const fram_segment_t* segments, uint16_t segment_count)
 {
-	//reset the file system to a clean state
-	//reset file structs
-	memset(&BFFS,0,((FILE_STRCT_SIZE)*(MAX_FILES)));
-	//reset rest of file system
-	BFFS.file_idx = 0;
-	BFFS.start_ptr = FS_OFFSET;
-	BFFS.write_ptr = FS_OFFSET;
-	BFFS.end_ptr = BFFS.start_ptr+USABLE_SIZE;
-
-	/*Save the current state of the fs in the beginning of FRAM */
-	save_fs();
-
-	return RESET_FS_SUCCESS;
+	for (uint16_t idx = 0; idx<segment_count; idx++)
+	{
+		account_bytes(bffs,is_write,segments[idx].address,segments[idx].data_length);
+	}
 }
 
-
-bffs_st mount_fs()
+/* Get the part of a transfer of data_length bytes at a volume address that is on a single FRAM device, and where it
+ * is. The volume is cut in STRIPE_SIZE byte stripes dealt to the devices in turn, so the stripes of one device follow
+ * each other within it and a sequential transfer is contiguous on every device */
+static fram_addr_t get_piece(bffs_t* bffs, fram_addr_t address, fram_addr_t data_length, uint8_t* device, fram_addr_t* device_address)
 {
-	/*Attempt to load stored fs from FRAM and reset to clean state if no FS is stored*/
-	bffs_st status;
-
-	status = load_fs();
-
-	if (status!=LOAD_FS_SUCCESS)
+#if FRAM_DEVICES > 1
+	if (bffs->geometry.devices > 1)
 	{
-		status = reset_fs();
+		fram_addr_t stripe = address/STRIPE_SIZE;
+		fram_addr_t stripe_left = STRIPE_SIZE-address%STRIPE_SIZE;
+
+		*device = stripe%bffs->geometry.devices;
+		*device_address = bffs->geometry.base+(stripe/bffs->geometry.devices)*STRIPE_SIZE+address%STRIPE_SIZE;
+		return (data_length < stripe_left) ? data_length : stripe_left;
 	}
-	if ((status == RESET_FS_SUCCESS) || (status == LOAD_FS_SUCCESS))
+#endif
+	*device = 0;
+	*device_address = bffs->geometry.base+address;
+	return data_length;
+}
+
+static void transfer_device(bffs_t* bffs, uint8_t is_write, uint8_t device, const fram_segment_t* segments, uint16_t segment_count)
+{
+	lock_bus(bffs,device);
+	if (is_write)
 	{
-		return MOUNT_FS_SUCCESS;
+		STATS_ADD(driver_writes,1);
+		bffs->driver->write_v(bffs->driver_ctx,device,segments,segment_count);
 	}
 	else
 	{
-		return MOUNT_FS_FAILED;
+		STATS_ADD(driver_reads,1);
+		bffs->driver->read_v(bffs->driver_ctx,device,segments,segment_count);
 	}
+	unlock_bus(bffs,device);
 }
 
-bffs_st create_file(char* filename, uint16_t file_size, file_t** file_ptr_ptr)
+/* Vectored transfer of volume segments. With several devices, segments are split at stripe boundaries and gathered
+ * per device, so a large transfer takes a single driver call per device (and SEGMENT_BATCH pieces). Segments of a
+ * volume on one device from its first byte are passed to the driver as they are */
+static void transfer_segments(bffs_t* bffs, uint8_t is_write, const fram_segment_t* segments, uint16_t segment_count)
 {
-	//Check if file ptr is valid
-	if (file_ptr_ptr == NULL)
+	if (!segment_count)
 	{
-		return CREATE_FILE_INVALID_FILE_PTR;
+		return;
 	}
-	//Check for available file slots
-	if (BFFS.file_idx >= MAX_FILES)
+	account_segments(bffs,is_write,segments,segment_count);
+	if ((bffs->geometry.devices == 1) && (bffs->geometry.base == 0))
 	{
-		return CREATE_FILE_NO_FILE_SLOTS;
+		transfer_device(bffs,is_write,0,segments,segment_count);
+		return;
 	}
-	//Get filename that is being created and verify its validity
-	char temp_str[MAX_FILENAME_SIZE] = {0};
-	for (uint8_t idx = 0; *(filename+idx) != '\0'; idx++)
+	fram_segment_t pieces[FRAM_DEVICES][SEGMENT_BATCH];
+	uint16_t piece_count[FRAM_DEVICES] = {0};
+
+	for (uint16_t idx = 0; idx<segment_count; idx++)
 	{
-		if (idx == MAX_FILENAME_SIZE)
+		fram_addr_t done = 0;
+		while (done < segments[idx].data_length)
 		{
-			return CREATE_FILE_BAD_FILENAME;
+			uint8_t device;
+			fram_addr_t device_address;
+			fram_addr_t length = get_piece(bffs,segments[idx].address+done,segments[idx].data_length-done,&device,&device_address);
+
+			if (piece_count[device] == SEGMENT_BATCH)
+			{
+				transfer_device(bffs,is_write,device,pieces[device],piece_count[device]);
+				piece_count[device] = 0;
+			}
+			pieces[device][piece_count[device]].address = device_address;
+			pieces[device][piece_count[device]].data_length = length;
+			pieces[device][piece_count[device]].data_ptr = (uint8_t*)segments[idx].data_ptr+done;
+			piece_count[device]++;
+			done += length;
 		}
-		temp_str[idx]= *(filename+idx);
 	}
-
-	//Compare it with existing filenames
-	for (uint16_t search_idx =0; search_idx<MAX_FILES; search_idx++)
+	for (uint8_t device = 0; device<bffs->geometry.devices; device++)
 	{
-		if (!strcmp(temp_str,BFFS.files[search_idx].filename))
+		if (piece_count[device])
 		{
-			return CREATE_FILE_FILENAME_TAKEN;
+			transfer_device(bffs,is_write,device,pieces[device],piece_count[device]);
 		}
 	}
-	/*Check file size is not 0 and return error if it is*/
-	if (!file_size)
+}
+
+#if !BFFS_JOURNAL
+static void write_metadata(bffs_t* bffs, uint16_t address, uint16_t data_length)
+{
+	fram_segment_t segment = {address,data_length,((uint8_t*)bffs->fs)+address};
+	transfer_segments(bffs,1,&segment,1);
+}
+#endif
+
+static void read_metadata(bffs_t* bffs, uint16_t address, uint16_t data_length)
+{
+	fram_segment_t segment = {address,data_length,((uint8_t*)bffs->fs)+address};
+	transfer_segments(bffs,0,&segment,1);
+}
+
+/* Vectored write of payload and/or metadata segments */
+static void write_segments(bffs_t* bffs, const fram_segment_t* segments, uint16_t segment_count)
+{
+	transfer_segments(bffs,1,segments,segment_count);
+}
+
+static void read_payload(bffs_t* bffs, fram_addr_t address, fram_addr_t data_length, void* data_ptr)
+{
+	fram_segment_t segment = {address,data_length,data_ptr};
+	transfer_segments(bffs,0,&segment,1);
+}
+
+static void read_segments(bffs_t* bffs, const fram_segment_t* segments, uint16_t segment_count)
+{
+	transfer_segments(bffs,0,segments,segment_count);
+}
+
+#if CLEAR_FILE_ZERO_DATA
+/* The part of a contiguous volume region on each device is contiguous too, so each device is filled in one call */
+static void fill_payload(bffs_t* bffs, fram_addr_t address, fram_addr_t data_length, uint8_t value)
+{
+	fram_addr_t device_start[FRAM_DEVICES];
+	fram_addr_t device_length[FRAM_DEVICES] = {0};
+
+	STATS_ADD(payload_bytes_written,data_length);
+	while (data_length)
 	{
-		return CREATE_FILE_BAD_SIZE;
+		uint8_t device;
+		fram_addr_t device_address;
+		fram_addr_t length = get_piece(bffs,address,data_length,&device,&device_address);
+
+		if (!device_length[device])
+		{
+			device_start[device] = device_address;
+		}
+		device_length[device] += length;
+		address += length;
+		data_length -= length;
 	}
-	/*Check file size is not too large*/
-	if ((file_size + BFFS.write_ptr) > BFFS.end_ptr)
+	for (uint8_t device = 0; device<bffs->geometry.devices; device++)
 	{
-		return CREATE_FILE_FILE_TOO_LARGE;
+		if (device_length[device])
+		{
+			STATS_ADD(driver_writes,1);
+			lock_bus(bffs,device);
+			bffs->driver->fill(bffs->driver_ctx,device,device_start[device],device_length[device],value);
+			unlock_bus(bffs,device);
+		}
 	}
-	/*No problems detected*/
-
-	/*Set filename*/
-	strcpy(BFFS.files[BFFS.file_idx].filename,temp_str);
+}
+#endif
 
+/* Asynchronous transfer of a list of volume segments. Each bus works through the pieces of the segments that are on
+ * its devices, one driver transfer at a time, so pieces on different buses are transferred in parallel. done is
+ * called once every bus is finished, with the first error met if any. The segments must stay valid until then */
+static void transfer_async_step(fram_st fram_status, void* ctx);
 
-	//Set pointers
-	BFFS.files[BFFS.file_idx].start_ptr = BFFS.write_ptr;
-	BFFS.files[BFFS.file_idx].end_ptr   = BFFS.write_ptr + file_size;
-	BFFS.files[BFFS.file_idx].write_ptr = BFFS.write_ptr;
-	BFFS.files[BFFS.file_idx].read_ptr  = BFFS.write_ptr;
+/* Start the next piece of a bus. Returns 0 if the bus has nothing left, or could not start it */
+static uint8_t transfer_async_next(bffs_xfer_chain_t* chain)
+{
+	bffs_t* bffs = chain->bffs;
 
-	//Set input file_ptr to point to a file in the file system.
-	*file_ptr_ptr = &(BFFS.files[BFFS.file_idx]);
+	while (chain->segment_idx < bffs->xfer_segment_count)
+	{
+		const fram_segment_t* segment = &bffs->xfer_segments[chain->segment_idx];
+		fram_addr_t offset = chain->offset;
+		fram_segment_t piece;
+		uint8_t device;
+		fram_st fram_status;
 
-	BFFS.file_idx++;
-	BFFS.write_ptr+= file_size;
+		piece.data_length = get_piece(bffs,segment->address+offset,segment->data_length-offset,&device,&piece.address);
+		piece.data_ptr = (uint8_t*)segment->data_ptr+offset;
+		chain->offset += piece.data_length;
+		if (chain->offset == segment->data_length)
+		{
+			chain->segment_idx++;
+			chain->offset = 0;
+		}
+		if ((!piece.data_length) || (get_bus(bffs,device) != chain->bus))
+		{
+			continue;
+		}
+		if ((bffs->xfer_is_write ? bffs->driver->write_async : bffs->driver->read_async) == NULL)
+		{
+			bffs->xfer_status = FRAM_ERROR;
+			return 0;
+		}
+		account_bytes(bffs,bffs->xfer_is_write,segment->address+offset,piece.data_length);
+		if (bffs->xfer_is_write)
+		{
+			STATS_ADD(driver_writes,1);
+			fram_status = bffs->driver->write_async(bffs->driver_ctx,device,piece.address,piece.data_length,
+					piece.data_ptr,transfer_async_step,chain);
+		}
+		else
+		{
+			STATS_ADD(driver_reads,1);
+			fram_status = bffs->driver->read_async(bffs->driver_ctx,device,piece.address,piece.data_length,
+					piece.data_ptr,transfer_async_step,chain);
+		}
+		if (fram_status == FRAM_OK)
+		{
+			return 1;
+		}
+		bffs->xfer_status = fram_status;
+		return 0;
+	}
+	return 0;
+}
 
-	/*Save file system in the beginning of FRAM, since it is now in a new state that should be loadable later*/
-	save_fs();
-	return CREATE_FILE_SUCCESS;
+static void transfer_async_bus_done(bffs_t* bffs)
+{
+	if (__atomic_fetch_sub(&bffs->xfer_buses,1,__ATOMIC_ACQ_REL) == 1)
+	{
+		bffs->xfer_done(bffs->xfer_status,bffs);
+	}
 }
 
-bffs_st open_file(char* filename,file_t** file_ptr_ptr)
+static void transfer_async_step(fram_st fram_status, void* ctx)
 {
-	/*Check if file ptr is valid */
-	if (file_ptr_ptr == NULL)
+	bffs_xfer_chain_t* chain = ctx;
+
+	if (fram_status != FRAM_OK)
 	{
-		return OPEN_FILE_INVALID_FILE_PTR;
+		chain->bffs->xfer_status = fram_status;
+	}
+	else if (transfer_async_next(chain))
+	{
+		return;
 	}
-	//Get string that is being searched
-	char temp_str[MAX_FILENAME_SIZE] = {0};
-	for (uint8_t idx = 0; *(filename+idx) != '\0'; idx++)
+	transfer_async_bus_done(chain->bffs);
+}
+
+/* Start an asynchronous transfer. If no bus could start, the error is returned and done is not called */
+static fram_st transfer_async(bffs_t* bffs, uint8_t is_write, const fram_segment_t* segments, uint16_t segment_count, fram_callback_t done)
+{
+	uint8_t started = 0;
+
+	bffs->xfer_segments = segments;
+	bffs->xfer_segment_count = segment_count;
+	bffs->xfer_is_write = is_write;
+	bffs->xfer_done = done;
+	bffs->xfer_status = FRAM_OK;
+	__atomic_store_n(&bffs->xfer_buses,FRAM_BUSES+1,__ATOMIC_RELEASE);
+
+	for (uint8_t bus = 0; bus<FRAM_BUSES; bus++)
 	{
-		temp_str[idx]= *(filename+idx);
+		bffs->xfer_chains[bus].bffs = bffs;
+		bffs->xfer_chains[bus].bus = bus;
+		bffs->xfer_chains[bus].segment_idx = 0;
+		bffs->xfer_chains[bus].offset = 0;
 	}
-	//Compare it with existing filenames
-	for (uint16_t search_idx =0; search_idx<MAX_FILES; search_idx++)
+	for (uint8_t bus = 0; bus<FRAM_BUSES; bus++)
 	{
-		if (!strcmp(temp_str,BFFS.files[search_idx].filename))
+		if (transfer_async_next(&bffs->xfer_chains[bus]))
+		{
+			started = 1;
+		}
+		else
 		{
-			/*If a file with a matchiing file name is found, make the input pointer point to it. */
-			*file_ptr_ptr = &(BFFS.files[search_idx]);
-			(*file_ptr_ptr)->read_ptr = (*file_ptr_ptr)->start_ptr; //reset read so any loaded read ptrs are reset
-		    return OPEN_FILE_SUCCESS;
+			transfer_async_bus_done(bffs);
 		}
 	}
-	return OPEN_FILE_FILE_NOT_FOUND;
+	if ((!started) && (bffs->xfer_status != FRAM_OK))
+	{
+		return bffs->xfer_status;
+	}
+	transfer_async_bus_done(bffs);
+	return FRAM_OK;
+}
 
+static void mark_file_dirty(bffs_t* bffs, file_t* file_ptr, uint8_t fields)
+{
+	bffs->dirty_files[file_ptr-bffs->fs->files] |= fields;
 }
 
+static void mark_fs_dirty(bffs_t* bffs, uint8_t fields)
+{
+	bffs->dirty_header |= fields;
+}
 
-uint16_t write_file(file_t* file_ptr, uint16_t data_length, void* data_ptr)
+/* Get the span of BFFS going from the first to the last dirty field of a struct located at base.
+ * Clean fields in between are rewritten too, since that is cheaper than starting a new SPI transaction */
+static void get_dirty_span(uint16_t base, uint8_t dirty, const uint16_t* offset, const uint16_t* size, uint8_t count,
+		uint16_t* span_start, uint16_t* span_length)
 {
-	/*Check pointer validity*/
-	if (file_ptr == NULL)
+	uint8_t first = 0;
+	uint8_t last = count-1;
+
+	while (!(dirty & (1<<first)))
 	{
-		return WRITE_FILE_INVALID_FILE_PTR;
+		first++;
 	}
-	if (data_ptr == NULL)
+	while (!(dirty & (1<<last)))
 	{
-		return WRITE_FILE_INVALID_DATA_PTR;
+		last--;
 	}
-	/*Check data length is not 0 */
-	if (data_length == 0)
+	*span_start = base+offset[first];
+	*span_length = offset[last]+size[last]-offset[first];
+}
+
+/* Get the next span of BFFS that must be written to FRAM and consider it clean. Returns 0 if nothing is dirty */
+static uint8_t take_dirty_span(bffs_t* bffs, uint16_t* span_start, uint16_t* span_length)
+{
+	for (uint16_t idx = 0; idx<MAX_FILES; idx++)
 	{
-		return WRITE_FILE_BAD_LENGTH;
+		if (bffs->dirty_files[idx])
+		{
+			get_dirty_span((uint16_t)((uint8_t*)&bffs->fs->files[idx]-(uint8_t*)bffs->fs),bffs->dirty_files[idx],
+					file_field_offset,file_field_size,FILE_FIELD_COUNT,span_start,span_length);
+			bffs->dirty_files[idx] = 0;
+			return 1;
+		}
 	}
-	/*Check if given current file pointer, the new file length would overflow it */
-	uint16_t write_end_ptr = file_ptr->write_ptr+data_length;
-	if (write_end_ptr > file_ptr->end_ptr)
+	if (bffs->dirty_header)
 	{
-		return WRITE_FILE_OVERFLOW;
+		get_dirty_span(0,bffs->dirty_header,fs_field_offset,fs_field_size,FS_FIELD_COUNT,span_start,span_length);
+		bffs->dirty_header = 0;
+		return 1;
 	}
-	/*Write file data in the FRAM */
-	write_FRAM(file_ptr->write_ptr,data_length,data_ptr);
-	file_ptr->write_ptr+=data_length;
+	return 0;
+}
 
-	/*Save the FS state in the FRAM, since we have updated the file pointers */
-	save_fs();
-	return WRITE_FILE_SUCCESS;
+#if BFFS_JOURNAL
+/* Journal: instead of being written in place, the dirty spans saved together are appended after the file system
+ * struct as a batch of records. A record is a header (struct offset, with JOURNAL_LAST_RECORD set on the last record
+ * of a batch, data length and the low 16 bits of a CRC-32 over the journal epoch, header and data) followed by the
+ * bytes of BFFS at that offset. Mount replays complete batches only, so each save takes effect entirely or not at all.
+ * save_fs checkpoints: it writes the whole struct with a new epoch, which makes every record in the journal stale */
+#define JOURNAL_START FS_STRCT_SIZE
+#define JOURNAL_LAST_RECORD 0x8000
+#define JOURNAL_READ_CHUNK 32 //Bytes of record data read at a time when checking records at mount
+
+static const uint8_t journal_empty[JOURNAL_HEADER_SIZE];
 
+static void read_journal(bffs_t* bffs, fram_addr_t position, fram_addr_t data_length, void* data_ptr)
+{
+	fram_segment_t segment = {JOURNAL_START+position,data_length,data_ptr};
+	read_segments(bffs,&segment,1);
 }
 
-bffs_st read_file(file_t* file_ptr, uint16_t data_length, void* data_ptr, bffs_read_file_option option)
+static uint32_t get_record_crc(bffs_t* bffs, const uint8_t* header, const void* data, uint16_t data_length)
 {
-	/*Check pointer validity */
-	if (file_ptr == NULL)
+	uint32_t crc = crc32(0,&bffs->fs->journal_epoch,sizeof(bffs->fs->journal_epoch));
+	crc = crc32(crc,header,JOURNAL_HEADER_SIZE-2);
+	return crc32(crc,data,data_length);
+}
+
+/* Lay every dirty span out as a batch of records at the end of the journal, in journal_segments (header and data
+ * segments in turn), and get the number of segments. Returns 0 if the batch doesn't fit the journal, in which case
+ * the dirty spans must be saved by a checkpoint */
+static uint8_t build_journal_batch(bffs_t* bffs, uint16_t* segment_count)
+{
+	uint16_t span_start;
+	uint16_t span_length;
+	uint16_t count = 0;
+	fram_addr_t position = bffs->journal_used;
+
+	while (take_dirty_span(bffs,&span_start,&span_length))
 	{
-		return READ_FILE_INVALID_FILE_PTR;
+		uint8_t* header = bffs->journal_headers[count/2];
+		header[0] = span_start & 0xFF;
+		header[1] = span_start >> 8;
+		header[2] = span_length & 0xFF;
+		header[3] = span_length >> 8;
+
+		bffs->journal_segments[count].address = JOURNAL_START+position;
+		bffs->journal_segments[count].data_length = JOURNAL_HEADER_SIZE;
+		bffs->journal_segments[count].data_ptr = header;
+		bffs->journal_segments[count+1].address = JOURNAL_START+position+JOURNAL_HEADER_SIZE;
+		bffs->journal_segments[count+1].data_length = span_length;
+		bffs->journal_segments[count+1].data_ptr = ((uint8_t*)bffs->fs)+span_start;
+		position += JOURNAL_HEADER_SIZE+span_length;
+		count += 2;
 	}
-	if (data_ptr == NULL)
+	*segment_count = count;
+	if (position > JOURNAL_SIZE)
 	{
-		return READ_FILE_INVALID_DATA_PTR;
+		return 0;
 	}
-	/*Check data length is not 0 */
-	if (data_length == 0)
+	if (!count)
 	{
-		return READ_FILE_BAD_LENGTH;
+		return 1;
 	}
-	/*Check if attempted read will overflow the file*/
-	uint16_t read_end_ptr = file_ptr->read_ptr+data_length;
-	if (read_end_ptr > file_ptr->end_ptr)
+	/*Flag the last record, then seal every record with its CRC */
+	bffs->journal_headers[count/2-1][1] |= JOURNAL_LAST_RECORD >> 8;
+	for (uint16_t idx = 0; idx<count; idx += 2)
 	{
-		return READ_FILE_OVERFLOW;
+		uint8_t* header = bffs->journal_headers[idx/2];
+		uint32_t crc = get_record_crc(bffs,header,bffs->journal_segments[idx+1].data_ptr,bffs->journal_segments[idx+1].data_length);
+		header[4] = crc & 0xFF;
+		header[5] = (crc >> 8) & 0xFF;
 	}
-	/*Read FRAM at the specified location */
-	read_FRAM(file_ptr->read_ptr,data_length,data_ptr);
-	if (option == READ_FILE_RESET_READ_PTR)
-		/*Reset the read pointer to the start if such is specified */
-		file_ptr->read_ptr = file_ptr->start_ptr;
-	return READ_FILE_SUCCESS;
+	bffs->journal_used = position;
+	return 1;
 }
 
-bffs_st clear_file(file_t* file_ptr)
+/* Check the record at a journal position, getting its offset in BFFS, data length and whether it ends a batch.
+ * Returns 0 if there is no valid record of the current epoch there */
+static uint8_t check_journal_record(bffs_t* bffs, fram_addr_t position, uint16_t* offset, uint16_t* data_length, uint8_t* last)
 {
-	/*Create temp data containing 0 */
-	uint8_t zero = 0;
+	uint8_t header[JOURNAL_HEADER_SIZE];
+	uint8_t chunk[JOURNAL_READ_CHUNK];
+	uint16_t tagged_offset;
+	uint32_t crc;
 
-	/*Check pointer validity`*/
-	if (file_ptr == NULL)
+	if (position+JOURNAL_HEADER_SIZE > JOURNAL_SIZE)
 	{
-		return CLEAR_FILE_INVALID_FILE_PTR;
+		return 0;
 	}
-	/*Write 0s in all the FRAM bytes that are within a file's boundaries */
-	for (uint32_t idx = 0; idx<(file_ptr->end_ptr-file_ptr->start_ptr);idx++)
+	read_journal(bffs,position,JOURNAL_HEADER_SIZE,header);
+	tagged_offset = header[0] | (header[1] << 8);
+	*offset = tagged_offset & ~JOURNAL_LAST_RECORD;
+	*data_length = header[2] | (header[3] << 8);
+	*last = (tagged_offset & JOURNAL_LAST_RECORD) != 0;
+
+	/*Records never touch the superblock, the epoch or the checkpoint CRC, nor go past the journal end */
+	if ((!*data_length) || (*offset < sizeof(bffs_superblock_t)) ||
+		(*offset+*data_length > offsetof(file_system_t,journal_epoch)) ||
+		(*data_length > JOURNAL_SIZE-position-JOURNAL_HEADER_SIZE))
 	{
-		write_FRAM(file_ptr->start_ptr+idx,1,&zero);
+		return 0;
 	}
-
-	/*Reset pointers */
-	file_ptr->read_ptr = file_ptr->start_ptr;
-	file_ptr->write_ptr = file_ptr->start_ptr;
-
-	/*Save the FS state in the FRAM, since we have updated the file pointers */
-	save_fs();
-
-	return CLEAR_FILE_SUCCESS;
-
+	crc = get_record_crc(bffs,header,NULL,0);
+	for (uint16_t done = 0; done<*data_length; done += JOURNAL_READ_CHUNK)
+	{
+		uint16_t length = (*data_length-done < JOURNAL_READ_CHUNK) ? *data_length-done : JOURNAL_READ_CHUNK;
+		read_journal(bffs,position+JOURNAL_HEADER_SIZE+done,length,chunk);
+		crc = crc32(crc,chunk,length);
+	}
+	return ((crc & 0xFFFF) == (uint32_t)(header[4] | (header[5] << 8)));
 }
 
-bffs_st seek_file(file_t* file_ptr, uint16_t byte)
+/* Apply the journal onto the loaded file system struct: find where the last complete batch of valid records ends,
+ * then read the data of every record up to there into place. New records are appended from that point on */
+static void replay_journal(bffs_t* bffs)
 {
-	/*CHeck ptr validity */
-	if (file_ptr == NULL)
+	fram_addr_t position = 0;
+	fram_addr_t batch_end = 0;
+	uint16_t offset;
+	uint16_t data_length;
+	uint8_t last;
+
+	while (check_journal_record(bffs,position,&offset,&data_length,&last))
 	{
-		return SEEK_FILE_INVALID_FILE_PTR;
+		position += JOURNAL_HEADER_SIZE+data_length;
+		if (last)
+		{
+			batch_end = position;
+		}
 	}
-	/*Check if byte want to read at later is within the file boundaries*/
-	if (file_ptr->start_ptr+byte>file_ptr->end_ptr)
+	position = 0;
+	while (position < batch_end)
 	{
-		return SEEK_FILE_OVERFLOW;
+		check_journal_record(bffs,position,&offset,&data_length,&last);
+		read_journal(bffs,position+JOURNAL_HEADER_SIZE,data_length,((uint8_t*)bffs->fs)+offset);
+		position += JOURNAL_HEADER_SIZE+data_length;
 	}
-	/*Set read pointer as specified*/
-	file_ptr->read_ptr = file_ptr->start_ptr+byte;
-	return SEEK_FILE_SUCCESS;
+	bffs->journal_used = batch_end;
 }
 
-uint16_t tell_file(file_t* file_ptr)
+/* CRC of the struct up to the checkpoint CRC, which tells a whole checkpoint from one cut short by a reset */
+static uint32_t get_checkpoint_crc(bffs_t* bffs)
 {
-	/*Simply return the read byte in relation to the start of the file */
-	return file_ptr->read_ptr-file_ptr->start_ptr;
+	return crc32(0,bffs->fs,offsetof(file_system_t,checkpoint_crc));
 }
-/*The functions below are very self explanatory and thus are not commented */
 
-uint16_t get_fs_free_bytes(void)
+/* Get the two segments of a checkpoint: the whole struct with a new epoch and its CRC, and an empty record starting
+ * the journal again, right after it in FRAM. The struct is clean once they are written */
+static uint16_t get_checkpoint_segments(bffs_t* bffs, fram_segment_t* segments)
 {
-	return BFFS.end_ptr-BFFS.write_ptr;
+	bffs->fs->journal_epoch++;
+	bffs->fs->checkpoint_crc = get_checkpoint_crc(bffs);
+	bffs->journal_used = 0;
+	segments[0].address = 0;
+	segments[0].data_length = FS_STRCT_SIZE;
+	segments[0].data_ptr = bffs->fs;
+	segments[1].address = JOURNAL_START;
+	segments[1].data_length = JOURNAL_HEADER_SIZE;
+	segments[1].data_ptr = (void*)journal_empty;
+	return 2;
 }
-uint16_t get_fs_size(void)
+#endif
+
+static bffs_st save_fs_locked(bffs_t* bffs);
+
+/* Write the given payload segments followed by every dirty metadata span, in as few vectored driver calls as
+ * possible. Payload goes first so the file pointers never get to FRAM before the data they point past */
+static void save_with_payload(bffs_t* bffs, const fram_segment_t* payload, uint16_t payload_count)
 {
-	return BFFS.end_ptr-BFFS.start_ptr;
+	fram_segment_t segments[SEGMENT_BATCH];
+	uint16_t count = 0;
+#if BFFS_JOURNAL
+	uint16_t batch_count;
+#else
+	uint16_t span_start;
+	uint16_t span_length;
+#endif
+
+	for (uint16_t idx = 0; idx<payload_count; idx++)
+	{
+		segments[count++] = payload[idx];
+		if (count == SEGMENT_BATCH)
+		{
+			write_segments(bffs,segments,count);
+			count = 0;
+		}
+	}
+#if FRAM_DEVICES > 1
+	/*Striped writes are sent device by device, so the payload must be out before metadata of another device is */
+	if (bffs->geometry.devices > 1)
+	{
+		write_segments(bffs,segments,count);
+		count = 0;
+	}
+#endif
+#if BFFS_JOURNAL
+	if (!build_journal_batch(bffs,&batch_count))
+	{
+		/*No room left in the journal: checkpoint, the whole struct being saved once the payload is out */
+		write_segments(bffs,segments,count);
+		save_fs_locked(bffs);
+		return;
+	}
+	for (uint16_t idx = 0; idx<batch_count; idx++)
+	{
+		segments[count++] = bffs->journal_segments[idx];
+		if (count == SEGMENT_BATCH)
+		{
+			write_segments(bffs,segments,count);
+			count = 0;
+		}
+	}
+#else
+	while (take_dirty_span(bffs,&span_start,&span_length))
+	{
+		segments[count].address = span_start;
+		segments[count].data_length = span_length;
+		segments[count].data_ptr = ((uint8_t*)bffs->fs)+span_start;
+		if (++count == SEGMENT_BATCH)
+		{
+			write_segments(bffs,segments,count);
+			count = 0;
+		}
+	}
+#endif
+	write_segments(bffs,segments,count);
 }
-uint16_t get_fs_free_file_slots(void)
+
+/* FNV-1a hash over the whole fixed width (zero padded) filename */
+static uint16_t hash_filename(const char* name)
 {
-	return MAX_FILES-BFFS.file_idx;
+	uint32_t hash = 2166136261u;
+	for (uint16_t idx = 0; idx<MAX_FILENAME_SIZE; idx++)
+	{
+		hash ^= (uint8_t)name[idx];
+		hash *= 16777619u;
+	}
+	return (uint16_t)(hash ^ (hash >> 16)) & (FS_INDEX_SIZE-1);
 }
-uint16_t get_fs_total_file_slots(void)
+
+/* Copy a user filename into a zero padded fixed width buffer. Returns 0 if it doesn't fit */
+static uint8_t get_filename(const char* filename, char* name)
 {
-	return MAX_FILES;
+	memset(name,0,MAX_FILENAME_SIZE);
+	for (uint16_t idx = 0; *(filename+idx) != '\0'; idx++)
+	{
+		if (idx == MAX_FILENAME_SIZE)
+		{
+			return 0;
+		}
+		name[idx] = *(filename+idx);
+	}
+	return 1;
 }
-uint16_t get_fs_total_files(void)
+
+/* Get the slot of the file with the given fixed width filename, or MAX_FILES if there is none */
+static uint16_t find_file(bffs_t* bffs, const char* name)
 {
-	return BFFS.file_idx;
+	uint16_t bucket = hash_filename(name);
+
+	while (bffs->index[bucket])
+	{
+		uint16_t slot = bffs->index[bucket]-1;
+		if (!memcmp(name,bffs->fs->files[slot].filename,MAX_FILENAME_SIZE))
+		{
+			return slot;
+		}
+		bucket = (bucket+1) & (FS_INDEX_SIZE-1);
+	}
+	return MAX_FILES;
+}
+
+static void index_file(bffs_t* bffs, uint16_t slot)
+{
+	uint16_t bucket = hash_filename(bffs->fs->files[slot].filename);
+
+	while (bffs->index[bucket])
+	{
+		bucket = (bucket+1) & (FS_INDEX_SIZE-1);
+	}
+	bffs->index[bucket] = slot+1;
+}
+
+static void rebuild_fs_index(bffs_t* bffs)
+{
+	memset(bffs->index,0,sizeof(bffs->index));
+	for (uint16_t slot = 0; slot<MAX_FILES; slot++)
+	{
+		if (bffs->fs->files[slot].filename[0] != '\0')
+		{
+			index_file(bffs,slot);
+		}
+	}
+}
+
+/* Get a file slot with an empty filename. Returns MAX_FILES if all are used */
+static uint16_t find_free_slot(bffs_t* bffs)
+{
+	for (uint16_t slot = 0; slot<MAX_FILES; slot++)
+	{
+		if (bffs->fs->files[slot].filename[0] == '\0')
+		{
+			return slot;
+		}
+	}
+	return MAX_FILES;
+}
+
+static void remove_free_extent(bffs_t* bffs, uint16_t idx)
+{
+	bffs->fs->free_extent_count--;
+	memmove(&bffs->fs->free_extents[idx],&bffs->fs->free_extents[idx+1],(bffs->fs->free_extent_count-idx)*sizeof(fs_extent_t));
+	memset(&bffs->fs->free_extents[bffs->fs->free_extent_count],0,sizeof(fs_extent_t));
+	mark_fs_dirty(bffs,FS_FIELD_FREE_COUNT|FS_FIELD_FREE_EXTENTS);
+}
+
+/* Best fit allocation: take length bytes from the start of the smallest free extent they fit in, or from the BFFS
+ * write pointer if none does. Bounded by MAX_FREE_EXTENTS. Returns 0 if there is no room */
+static uint8_t allocate_extent(bffs_t* bffs, fram_addr_t length, fram_addr_t* start_ptr)
+{
+	uint16_t best = MAX_FREE_EXTENTS;
+
+	for (uint16_t idx = 0; idx<bffs->fs->free_extent_count; idx++)
+	{
+		if ((bffs->fs->free_extents[idx].length >= length) &&
+				((best == MAX_FREE_EXTENTS) || (bffs->fs->free_extents[idx].length < bffs->fs->free_extents[best].length)))
+		{
+			best = idx;
+		}
+	}
+	if (best != MAX_FREE_EXTENTS)
+	{
+		*start_ptr = bffs->fs->free_extents[best].start_ptr;
+		bffs->fs->free_extents[best].start_ptr += length;
+		bffs->fs->free_extents[best].length -= length;
+		mark_fs_dirty(bffs,FS_FIELD_FREE_EXTENTS);
+		if (!bffs->fs->free_extents[best].length)
+		{
+			remove_free_extent(bffs,best);
+		}
+		return 1;
+	}
+	if (length > bffs->fs->end_ptr-bffs->fs->write_ptr)
+	{
+		return 0;
+	}
+	*start_ptr = bffs->fs->write_ptr;
+	bffs->fs->write_ptr += length;
+	mark_fs_dirty(bffs,FS_FIELD_WRITE_PTR);
+	return 1;
+}
+
+/* Give a region back, merging it with the free extents right before and after it. A region ending at the BFFS write
+ * pointer moves it back instead, so the free extents never end there */
+static void release_extent(bffs_t* bffs, fram_addr_t start_ptr, fram_addr_t length)
+{
+	uint16_t idx = 0;
+
+	if (!length)
+	{
+		return;
+	}
+	while ((idx<bffs->fs->free_extent_count) && (bffs->fs->free_extents[idx].start_ptr < start_ptr))
+	{
+		idx++;
+	}
+	/*Merge with the next extent */
+	if ((idx<bffs->fs->free_extent_count) && (start_ptr+length == bffs->fs->free_extents[idx].start_ptr))
+	{
+		length += bffs->fs->free_extents[idx].length;
+		remove_free_extent(bffs,idx);
+	}
+	/*Merge with the previous extent */
+	if (idx && (bffs->fs->free_extents[idx-1].start_ptr+bffs->fs->free_extents[idx-1].length == start_ptr))
+	{
+		idx--;
+		start_ptr = bffs->fs->free_extents[idx].start_ptr;
+		length += bffs->fs->free_extents[idx].length;
+		remove_free_extent(bffs,idx);
+	}
+	if (start_ptr+length == bffs->fs->write_ptr)
+	{
+		bffs->fs->write_ptr = start_ptr;
+		mark_fs_dirty(bffs,FS_FIELD_WRITE_PTR);
+		return;
+	}
+	/*There is a file after each free extent, so the list can't be full here */
+	memmove(&bffs->fs->free_extents[idx+1],&bffs->fs->free_extents[idx],(bffs->fs->free_extent_count-idx)*sizeof(fs_extent_t));
+	bffs->fs->free_extents[idx].start_ptr = start_ptr;
+	bffs->fs->free_extents[idx].length = length;
+	bffs->fs->free_extent_count++;
+	mark_fs_dirty(bffs,FS_FIELD_FREE_COUNT|FS_FIELD_FREE_EXTENTS);
+}
+
+/* Count an operation that changed BFFS in RAM as pending. Returns 1 if the commit policy requires the pending
+ * changes to be saved now */
+static uint8_t add_pending(bffs_t* bffs, fram_addr_t data_length)
+{
+	if (bffs->pending_ops < UINT16_MAX)
+	{
+		bffs->pending_ops++;
+	}
+	uint16_t room = UINT16_MAX-bffs->pending_bytes;
+	bffs->pending_bytes = (data_length > room) ? UINT16_MAX : bffs->pending_bytes+data_length;
+
+	switch (bffs->commit_policy)
+	{
+	case FS_COMMIT_WRITE_THROUGH:
+		return 1;
+	case FS_COMMIT_EVERY_N:
+		return ((bffs->commit_max_ops && (bffs->pending_ops >= bffs->commit_max_ops)) ||
+				(bffs->commit_max_bytes && (bffs->pending_bytes >= bffs->commit_max_bytes)));
+	case FS_COMMIT_ON_DEMAND:
+	default:
+		return 0;
+	}
+}
+
+/* Write the given payload segments together with every pending metadata change now, regardless of the commit policy */
+static void flush_fs(bffs_t* bffs, const fram_segment_t* payload, uint16_t payload_count)
+{
+	STATS_ADD(save_fs_changes_calls,1);
+	save_with_payload(bffs,payload,payload_count);
+	bffs->pending_ops = 0;
+	bffs->pending_bytes = 0;
+}
+
+/* Called by every operation that changed BFFS in RAM. Depending on the commit policy, the changes are either
+ * saved right away or left pending until a threshold is reached or sync_fs is called */
+static void commit_fs(bffs_t* bffs, fram_addr_t data_length)
+{
+	if (add_pending(bffs,data_length))
+	{
+		flush_fs(bffs,NULL,0);
+	}
+}
+
+/* Same as commit_fs for operations that also write file data: the data segments are written together with the
+ * metadata changes when those are committed, and on their own otherwise */
+static void commit_fs_payload(bffs_t* bffs, const fram_segment_t* payload, uint16_t payload_count)
+{
+	fram_addr_t data_length = 0;
+
+	for (uint16_t idx = 0; idx<payload_count; idx++)
+	{
+		data_length += payload[idx].data_length;
+	}
+	if (add_pending(bffs,data_length))
+	{
+		flush_fs(bffs,payload,payload_count);
+	}
+	else
+	{
+		write_segments(bffs,payload,payload_count);
+	}
+}
+
+/* Start moving the file right after the lowest free extent down to the extent start. The extent stops being free, the
+ * move record tracks it until the move finishes. Returns 0 if there is nothing to compact */
+static uint8_t start_move(bffs_t* bffs)
+{
+	if (!bffs->fs->free_extent_count)
+	{
+		return 0;
+	}
+	fram_addr_t gap_end = bffs->fs->free_extents[0].start_ptr+bffs->fs->free_extents[0].length;
+	for (uint16_t slot = 0; slot<MAX_FILES; slot++)
+	{
+		/*Emptied files take no space and are left where they are */
+		if ((bffs->fs->files[slot].filename[0] != '\0') && (bffs->fs->files[slot].start_ptr == gap_end) &&
+				(bffs->fs->files[slot].end_ptr > bffs->fs->files[slot].start_ptr))
+		{
+			bffs->fs->move_slot = slot;
+			bffs->fs->move_dst = bffs->fs->free_extents[0].start_ptr;
+			bffs->fs->move_done = 0;
+			mark_fs_dirty(bffs,FS_FIELD_MOVE);
+			remove_free_extent(bffs,0);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Slide the pointers of the moved file down to the destination and free the region left past its new end */
+static void finish_move(bffs_t* bffs)
+{
+	file_t* file_ptr = &bffs->fs->files[bffs->fs->move_slot];
+	fram_addr_t gap = file_ptr->start_ptr-bffs->fs->move_dst;
+
+	file_ptr->start_ptr -= gap;
+	file_ptr->end_ptr -= gap;
+	file_ptr->write_ptr -= gap;
+	file_ptr->read_ptr -= gap;
+	mark_file_dirty(bffs,file_ptr,FILE_FIELD_READ_PTR|FILE_FIELD_WRITE_PTR|FILE_FIELD_START_PTR|FILE_FIELD_END_PTR);
+
+	bffs->fs->move_slot = MAX_FILES;
+	bffs->fs->move_dst = 0;
+	bffs->fs->move_done = 0;
+	mark_fs_dirty(bffs,FS_FIELD_MOVE);
+	release_extent(bffs,file_ptr->end_ptr,gap);
+}
+
+static fram_addr_t get_buffered(bffs_t* bffs, const file_t* file_ptr);
+
+/* Copy the next chunk of at most max_bytes of the file being moved, or finish the move once all its data is copied.
+ * A chunk is never larger than the gap, so it never overwrites source bytes that were not copied yet, and it is saved
+ * together with the move progress so an interrupted move resumes from what FRAM says. A larger chunk, or saving the
+ * progress only every few chunks, would let a reset leave source bytes overwritten that the saved progress still
+ * says are to be copied, so a small gap costs one metadata write per gap bytes. Returns the budget used */
+static fram_addr_t move_chunk(bffs_t* bffs, fram_addr_t max_bytes)
+{
+	file_t* file_ptr = &bffs->fs->files[bffs->fs->move_slot];
+	fram_addr_t gap = file_ptr->start_ptr-bffs->fs->move_dst;
+	/*Bytes in the append buffer are not in FRAM yet, they are flushed to wherever the write pointer is then */
+	fram_addr_t length = bffs_get_file_used_bytes(bffs,file_ptr)-get_buffered(bffs,file_ptr);
+	uint8_t chunk[COMPACT_CHUNK_SIZE];
+
+	if (bffs->fs->move_done >= length)
+	{
+		finish_move(bffs);
+		flush_fs(bffs,NULL,0);
+		return 1;
+	}
+	fram_addr_t chunk_length = length-bffs->fs->move_done;
+	if (chunk_length > gap)
+	{
+		chunk_length = gap;
+	}
+	if (chunk_length > COMPACT_CHUNK_SIZE)
+	{
+		chunk_length = COMPACT_CHUNK_SIZE;
+	}
+	if (chunk_length > max_bytes)
+	{
+		chunk_length = max_bytes;
+	}
+	read_payload(bffs,file_ptr->start_ptr+bffs->fs->move_done,chunk_length,chunk);
+	fram_segment_t data = {bffs->fs->move_dst+bffs->fs->move_done,chunk_length,chunk};
+	bffs->fs->move_done += chunk_length;
+	mark_fs_dirty(bffs,FS_FIELD_MOVE);
+	flush_fs(bffs,&data,1);
+	return chunk_length;
+}
+
+/* The data of the file being moved is split between source and destination, so operations on it complete the move */
+static void settle_file(bffs_t* bffs, const file_t* file_ptr)
+{
+	while ((bffs->fs->move_slot != MAX_FILES) && (file_ptr == &bffs->fs->files[bffs->fs->move_slot]))
+	{
+		move_chunk(bffs,FRAM_ADDR_MAX);
+	}
+}
+
+#if BFFS_THREAD_SAFE || BFFS_READ_AHEAD || BFFS_APPEND_BUFFER
+/* Index of the file slot a file pointer points to, MAX_FILES if it doesn't point to one */
+static uint16_t get_file_slot(bffs_t* bffs, const file_t* file_ptr)
+{
+	for (uint16_t slot = 0; slot<MAX_FILES; slot++)
+	{
+		if (file_ptr == &bffs->fs->files[slot])
+		{
+			return slot;
+		}
+	}
+	return MAX_FILES;
+}
+#endif
+
+/* Take the locks of a call on a file: the table lock shared and the file lock. Finishing the move of a file being
+ * compacted changes the free extents, so it is done beforehand with the table lock exclusive */
+static void lock_file(bffs_t* bffs, const file_t* file_ptr)
+{
+	lock_table(bffs,TABLE_SHARED);
+#if BFFS_THREAD_SAFE
+	uint16_t slot = get_file_slot(bffs,file_ptr);
+	while ((slot != MAX_FILES) && (bffs->fs->move_slot == slot))
+	{
+		unlock_table(bffs,TABLE_SHARED);
+		lock_table(bffs,TABLE_EXCLUSIVE);
+		settle_file(bffs,file_ptr);
+		unlock_table(bffs,TABLE_EXCLUSIVE);
+		lock_table(bffs,TABLE_SHARED);
+	}
+	if (slot != MAX_FILES)
+	{
+		take_lock(bffs,bffs->file_locks[slot],0);
+	}
+#else
+	(void)file_ptr;
+#endif
+}
+
+static void unlock_file(bffs_t* bffs, const file_t* file_ptr)
+{
+#if BFFS_THREAD_SAFE
+	uint16_t slot = get_file_slot(bffs,file_ptr);
+	if (slot != MAX_FILES)
+	{
+		give_lock(bffs,bffs->file_locks[slot],0);
+	}
+#else
+	(void)file_ptr;
+#endif
+	unlock_table(bffs,TABLE_SHARED);
+}
+
+/* Read-ahead windows hold written bytes of a file, from an offset of its start. Appends land past them and moving
+ * the file doesn't change them, so they are only dropped when written bytes change or the slot gets another file */
+static void drop_read_ahead(bffs_t* bffs, const file_t* file_ptr)
+{
+#if BFFS_READ_AHEAD
+	uint16_t slot = get_file_slot(bffs,file_ptr);
+	if (slot != MAX_FILES)
+	{
+		bffs->read_ahead[slot].length = 0;
+	}
+#else
+	(void)bffs;
+	(void)file_ptr;
+#endif
+}
+
+static void drop_all_read_ahead(bffs_t* bffs)
+{
+#if BFFS_READ_AHEAD
+	for (uint16_t slot = 0; slot<MAX_FILES; slot++)
+	{
+		bffs->read_ahead[slot].length = 0;
+	}
+#else
+	(void)bffs;
+#endif
+}
+
+/* Copy a read at the read pointer from the window of its file, filling the window from the read pointer on a miss.
+ * Returns 0 if the read doesn't go through the window: reads of a window or more, and of bytes past the write pointer */
+static uint8_t read_ahead(bffs_t* bffs, const file_t* file_ptr, fram_addr_t data_length, void* data_ptr)
+{
+#if BFFS_READ_AHEAD
+	uint16_t slot = get_file_slot(bffs,file_ptr);
+	if ((slot == MAX_FILES) || (data_length >= READ_AHEAD_SIZE) || (file_ptr->read_ptr > file_ptr->write_ptr) ||
+			(data_length > file_ptr->write_ptr-file_ptr->read_ptr))
+	{
+		return 0;
+	}
+	bffs_read_ahead_t* window = &bffs->read_ahead[slot];
+	fram_addr_t offset = file_ptr->read_ptr-file_ptr->start_ptr;
+	if ((offset < window->offset) || ((uint64_t)offset+data_length > (uint64_t)window->offset+window->length))
+	{
+		STATS_ADD(read_ahead_misses,1);
+		fram_addr_t written = file_ptr->write_ptr-file_ptr->read_ptr;
+		window->offset = offset;
+		window->length = (written < READ_AHEAD_SIZE) ? written : READ_AHEAD_SIZE;
+		read_payload(bffs,file_ptr->read_ptr,window->length,window->data);
+	}
+	else
+	{
+		STATS_ADD(read_ahead_hits,1);
+	}
+	memcpy(data_ptr,&window->data[offset-window->offset],data_length);
+	return 1;
+#else
+	(void)bffs;
+	(void)file_ptr;
+	(void)data_length;
+	(void)data_ptr;
+	return 0;
+#endif
+}
+
+/* Append buffers hold data written to a file past its write pointer, which only moves once the data is flushed. Ring
+ * files overwrite their oldest data, so they are never buffered */
+#if BFFS_APPEND_BUFFER
+static bffs_append_buffer_t* get_append_buffer(bffs_t* bffs, const file_t* file_ptr)
+{
+	uint16_t slot = get_file_slot(bffs,file_ptr);
+	return ((slot == MAX_FILES) || (file_ptr->type == FILE_TYPE_RING)) ? NULL : &bffs->append_buffers[slot];
+}
+#endif
+
+/* Bytes of a file in its append buffer */
+static fram_addr_t get_buffered(bffs_t* bffs, const file_t* file_ptr)
+{
+#if BFFS_APPEND_BUFFER
+	bffs_append_buffer_t* buffer = get_append_buffer(bffs,file_ptr);
+	return (buffer == NULL) ? 0 : buffer->length;
+#else
+	(void)bffs;
+	(void)file_ptr;
+	return 0;
+#endif
+}
+
+/* Forget the data in the append buffer of a file, whose written data is being discarded */
+static void drop_append(bffs_t* bffs, const file_t* file_ptr)
+{
+#if BFFS_APPEND_BUFFER
+	uint16_t slot = get_file_slot(bffs,file_ptr);
+	if (slot != MAX_FILES)
+	{
+		bffs->append_buffers[slot].length = 0;
+	}
+#else
+	(void)bffs;
+	(void)file_ptr;
+#endif
+}
+
+static void drop_all_append(bffs_t* bffs)
+{
+#if BFFS_APPEND_BUFFER
+	for (uint16_t slot = 0; slot<MAX_FILES; slot++)
+	{
+		bffs->append_buffers[slot].length = 0;
+	}
+#else
+	(void)bffs;
+#endif
+}
+
+/* Copy the part of a read of data_length written bytes from the read pointer that is in the append buffer, which is
+ * its end. Returns how many bytes that is */
+static fram_addr_t read_append(bffs_t* bffs, const file_t* file_ptr, fram_addr_t data_length, void* data_ptr)
+{
+#if BFFS_APPEND_BUFFER
+	bffs_append_buffer_t* buffer = get_append_buffer(bffs,file_ptr);
+	fram_addr_t start = (file_ptr->read_ptr > file_ptr->write_ptr) ? file_ptr->read_ptr : file_ptr->write_ptr;
+	if ((buffer == NULL) || (file_ptr->read_ptr+data_length <= start))
+	{
+		return 0;
+	}
+	fram_addr_t length = file_ptr->read_ptr+data_length-start;
+	memcpy((uint8_t*)data_ptr+(start-file_ptr->read_ptr),&buffer->data[start-file_ptr->write_ptr],length);
+	return length;
+#else
+	(void)bffs;
+	(void)file_ptr;
+	(void)data_length;
+	(void)data_ptr;
+	return 0;
+#endif
+}
+
+/* Checks shared by the synchronous and asynchronous read_file. Also gets how many of the bytes to read are past the
+ * write pointer, which were never written (or were cleared/truncated) and read as 0 */
+static bffs_st check_read(bffs_t* bffs, file_t* file_ptr, fram_addr_t data_length, void* data_ptr, fram_addr_t* unwritten)
+{
+	/*Check pointer validity */
+	if (file_ptr == NULL)
+	{
+		return READ_FILE_INVALID_FILE_PTR;
+	}
+	if (data_ptr == NULL)
+	{
+		return READ_FILE_INVALID_DATA_PTR;
+	}
+	/*Check data length is not 0 */
+	if (data_length == 0)
+	{
+		return READ_FILE_BAD_LENGTH;
+	}
+	settle_file(bffs,file_ptr);
+	/*Ring file data doesn't start at the start pointer, it is read with read_ring_file */
+	if (file_ptr->type == FILE_TYPE_RING)
+	{
+		return READ_FILE_BAD_TYPE;
+	}
+	/*Check if attempted read will overflow the file*/
+	if (data_length > file_ptr->end_ptr-file_ptr->read_ptr)
+	{
+		return READ_FILE_OVERFLOW;
+	}
+	*unwritten = 0;
+	fram_addr_t data_end = file_ptr->write_ptr+get_buffered(bffs,file_ptr);
+	fram_addr_t written = (file_ptr->read_ptr < data_end) ? data_end-file_ptr->read_ptr : 0;
+	if (data_length > written)
+	{
+		*unwritten = data_length-written;
+#if READ_UNWRITTEN_ERROR
+		return READ_FILE_UNWRITTEN;
+#endif
+	}
+	return READ_FILE_SUCCESS;
+}
+
+/* Checks shared by the synchronous and asynchronous write_file */
+static bffs_st check_write(bffs_t* bffs, file_t* file_ptr, fram_addr_t data_length, void* data_ptr)
+{
+	/*Check pointer validity*/
+	if (file_ptr == NULL)
+	{
+		return WRITE_FILE_INVALID_FILE_PTR;
+	}
+	if (data_ptr == NULL)
+	{
+		return WRITE_FILE_INVALID_DATA_PTR;
+	}
+	/*Check data length is not 0, and only whole records are written to record files */
+	if ((data_length == 0) || ((file_ptr->type == FILE_TYPE_RECORD) && (data_length % file_ptr->record_size)))
+	{
+		return WRITE_FILE_BAD_LENGTH;
+	}
+	/*Ring files wrap around, so they only overflow if the data doesn't fit in the whole file. Wrapping over the start
+	 *of a file being moved would hit copied data, while appends land past it and are picked up by the move */
+	if (file_ptr->type == FILE_TYPE_RING)
+	{
+		settle_file(bffs,file_ptr);
+		return (data_length > file_ptr->end_ptr-file_ptr->start_ptr) ? WRITE_FILE_OVERFLOW : WRITE_FILE_SUCCESS;
+	}
+	/*Check if given current file pointer and buffered data, the new file length would overflow it */
+	if (data_length > file_ptr->end_ptr-file_ptr->write_ptr-get_buffered(bffs,file_ptr))
+	{
+		return WRITE_FILE_OVERFLOW;
+	}
+	return WRITE_FILE_SUCCESS;
+}
+
+/* Get where in FRAM data_length bytes written at the write pointer of a file go. Ring files wrap around to the start
+ * pointer, which splits the data in two segments. Returns the number of segments */
+static uint16_t get_write_segments(const file_t* file_ptr, fram_addr_t data_length, void* data_ptr, fram_segment_t* segments)
+{
+	fram_addr_t room = file_ptr->end_ptr-file_ptr->write_ptr;
+
+	segments[0].address = file_ptr->write_ptr;
+	segments[0].data_length = data_length;
+	segments[0].data_ptr = data_ptr;
+	if ((file_ptr->type != FILE_TYPE_RING) || (data_length <= room))
+	{
+		return 1;
+	}
+	segments[0].data_length = room;
+	segments[1].address = file_ptr->start_ptr;
+	segments[1].data_length = data_length-room;
+	segments[1].data_ptr = (uint8_t*)data_ptr+room;
+	return 2;
+}
+
+/* Move the write pointer of a file past data_length bytes written at it. The write pointer of a ring file never stays
+ * at the end pointer, it goes back to the start pointer and the wrap is counted */
+static void advance_write_ptr(bffs_t* bffs, file_t* file_ptr, fram_addr_t data_length)
+{
+	fram_addr_t room = file_ptr->end_ptr-file_ptr->write_ptr;
+
+	if ((file_ptr->type == FILE_TYPE_RING) && (data_length >= room))
+	{
+		file_ptr->write_ptr = file_ptr->start_ptr+(data_length-room);
+		if (file_ptr->wrap_count < UINT16_MAX)
+		{
+			file_ptr->wrap_count++;
+		}
+		mark_file_dirty(bffs,file_ptr,FILE_FIELD_WRITE_PTR|FILE_FIELD_WRAP_COUNT);
+		return;
+	}
+	file_ptr->write_ptr += data_length;
+	mark_file_dirty(bffs,file_ptr,FILE_FIELD_WRITE_PTR);
+}
+
+/* File System functions */
+static bffs_st save_fs_locked(bffs_t* bffs)
+{
+	/* Write file system strct in the beginning of FRAM*/
+	STATS_ADD(save_fs_calls,1);
+#if BFFS_JOURNAL
+	fram_segment_t segments[2];
+	write_segments(bffs,segments,get_checkpoint_segments(bffs,segments));
+#else
+	write_metadata(bffs,0,FS_STRCT_SIZE);
+#endif
+
+	/* Everything is in FRAM now, so nothing is left dirty */
+	bffs->dirty_header = 0;
+	memset(bffs->dirty_files,0,sizeof(bffs->dirty_files));
+	bffs->pending_ops = 0;
+	bffs->pending_bytes = 0;
+	return SAVE_FS_SUCCESS;
+}
+
+bffs_st bffs_save_fs(bffs_t* bffs)
+{
+	lock_table(bffs,TABLE_EXCLUSIVE);
+	bffs_st status = save_fs_locked(bffs);
+	unlock_table(bffs,TABLE_EXCLUSIVE);
+	return status;
+}
+
+static bffs_st save_fs_changes_locked(bffs_t* bffs)
+{
+	STATS_ADD(save_fs_changes_calls,1);
+
+	/* Write back only the fields of each file struct and of the header that changed, at their fixed offset in FRAM */
+	save_with_payload(bffs,NULL,0);
+	return SAVE_FS_SUCCESS;
+}
+
+bffs_st bffs_save_fs_changes(bffs_t* bffs)
+{
+	lock_table(bffs,TABLE_SHARED);
+	lock_commit(bffs);
+	bffs_st status = save_fs_changes_locked(bffs);
+	unlock_commit(bffs);
+	unlock_table(bffs,TABLE_SHARED);
+	return status;
+}
+
+static bffs_st sync_fs_locked(bffs_t* bffs)
+{
+	STATS_OP(BFFS_OP_SYNC_FS);
+	/* Flush every pending metadata change, regardless of the commit policy */
+	save_fs_changes_locked(bffs);
+	bffs->pending_ops = 0;
+	bffs->pending_bytes = 0;
+	return SYNC_FS_SUCCESS;
+}
+
+bffs_st bffs_sync_fs(bffs_t* bffs)
+{
+	/*Appends gathered in RAM are metadata changes not committed yet too */
+	bffs_flush_fs_buffers(bffs);
+	lock_table(bffs,TABLE_SHARED);
+	lock_commit(bffs);
+	bffs_st status = sync_fs_locked(bffs);
+	unlock_commit(bffs);
+	unlock_table(bffs,TABLE_SHARED);
+	return status;
+}
+
+static bffs_st set_fs_commit_policy_locked(bffs_t* bffs, bffs_commit_policy policy, uint16_t max_ops, uint16_t max_bytes)
+{
+	/*Check policy is known*/
+	if (policy > FS_COMMIT_ON_DEMAND)
+	{
+		return SET_COMMIT_POLICY_BAD_POLICY;
+	}
+	/*An every N policy without any threshold would never commit*/
+	if ((policy == FS_COMMIT_EVERY_N) && !max_ops && !max_bytes)
+	{
+		return SET_COMMIT_POLICY_BAD_THRESHOLD;
+	}
+	/*Changes left pending by the previous policy are committed so they aren't held back by the new one*/
+	sync_fs_locked(bffs);
+
+	bffs->commit_policy = policy;
+	bffs->commit_max_ops = max_ops;
+	bffs->commit_max_bytes = max_bytes;
+	return SET_COMMIT_POLICY_SUCCESS;
+}
+
+bffs_st bffs_set_fs_commit_policy(bffs_t* bffs, bffs_commit_policy policy, uint16_t max_ops, uint16_t max_bytes)
+{
+	lock_table(bffs,TABLE_EXCLUSIVE);
+	bffs_st status = set_fs_commit_policy_locked(bffs,policy,max_ops,max_bytes);
+	unlock_table(bffs,TABLE_EXCLUSIVE);
+	return status;
+}
+
+bffs_commit_policy bffs_get_fs_commit_policy(bffs_t* bffs, uint16_t* max_ops, uint16_t* max_bytes)
+{
+	if (max_ops != NULL)
+	{
+		*max_ops = bffs->commit_max_ops;
+	}
+	if (max_bytes != NULL)
+	{
+		*max_bytes = bffs->commit_max_bytes;
+	}
+	return bffs->commit_policy;
+}
+
+#if BFFS_THREAD_SAFE
+/* Lock of a bus shared by the volumes of a driver context. Volumes set up at the same time both create it, the first to
+ * store its lock wins and the other one takes that lock, leaving its own unused */
+static void* get_shared_bus_lock(bffs_bus_locks_t* bus_locks, const bffs_lock_hooks_t* hooks, uint8_t bus)
+{
+	void* lock = __atomic_load_n(&bus_locks->locks[bus],__ATOMIC_ACQUIRE);
+
+	if (lock == NULL)
+	{
+		/*A failed exchange leaves the winner's lock in lock*/
+		void* created = hooks->create();
+		if ((created != NULL) && __atomic_compare_exchange_n(&bus_locks->locks[bus],&lock,created,0,__ATOMIC_ACQ_REL,
+				__ATOMIC_ACQUIRE))
+		{
+			lock = created;
+		}
+	}
+	return lock;
+}
+
+bffs_st bffs_set_fs_lock_hooks(bffs_t* bffs, const bffs_lock_hooks_t* hooks)
+{
+	/*Check every hook is given*/
+	if ((hooks == NULL) || (hooks->create == NULL) || (hooks->lock == NULL) || (hooks->unlock == NULL))
+	{
+		return SET_LOCK_HOOKS_BAD_HOOKS;
+	}
+	/*Locks can't be swapped while calls may be holding them*/
+	if (bffs->table_lock != NULL)
+	{
+		return SET_LOCK_HOOKS_ALREADY_SET;
+	}
+	/*Bus locks of a driver context are shared by its volumes, so all of them must use the hooks they were created with*/
+	bffs_bus_locks_t* bus_locks = (bffs->driver->get_bus_locks != NULL) ?
+			bffs->driver->get_bus_locks(bffs->driver_ctx) : NULL;
+	if (bus_locks != NULL)
+	{
+		void* (*create)(void) = NULL;
+		if (!__atomic_compare_exchange_n(&bus_locks->create,&create,hooks->create,0,__ATOMIC_ACQ_REL,__ATOMIC_ACQUIRE) &&
+				(create != hooks->create))
+		{
+			return SET_LOCK_HOOKS_BAD_HOOKS;
+		}
+	}
+	/*Create every lock before any is used, the table lock last since locking is off while it is NULL*/
+	bffs->lock_hooks = *hooks;
+	void* table = hooks->create();
+	bffs->commit_lock = hooks->create();
+	uint8_t created = (table != NULL) && (bffs->commit_lock != NULL);
+	for (uint16_t slot = 0; slot<MAX_FILES; slot++)
+	{
+		bffs->file_locks[slot] = hooks->create();
+		created = created && (bffs->file_locks[slot] != NULL);
+	}
+	for (uint8_t bus = 0; bus<FRAM_BUSES; bus++)
+	{
+		bffs->bus_locks[bus] = (bus_locks != NULL) ? get_shared_bus_lock(bus_locks,hooks,bus) : hooks->create();
+		created = created && (bffs->bus_locks[bus] != NULL);
+	}
+	if (!created)
+	{
+		/*Hooks have no way to free locks, so the ones that were created are just left unused. Shared bus locks that
+		 were created are kept for the next call*/
+		bffs->commit_lock = NULL;
+		memset(bffs->file_locks,0,sizeof(bffs->file_locks));
+		memset(bffs->bus_locks,0,sizeof(bffs->bus_locks));
+		return SET_LOCK_HOOKS_NO_MEMORY;
+	}
+	bffs->table_lock = table;
+	return SET_LOCK_HOOKS_SUCCESS;
+}
+#endif
+static void fill_superblock(bffs_t* bffs, bffs_superblock_t* superblock)
+{
+	memset(superblock,0,sizeof(*superblock));
+	superblock->magic = BFFS_MAGIC;
+	superblock->version = BFFS_LAYOUT_VERSION;
+	superblock->max_files = MAX_FILES;
+	superblock->max_filename_size = MAX_FILENAME_SIZE;
+	superblock->addr_size = sizeof(fram_addr_t);
+	superblock->volume_size = bffs->volume_size;
+	superblock->devices = bffs->geometry.devices;
+	superblock->stripe_size = (bffs->geometry.devices > 1) ? STRIPE_SIZE : 0;
+	superblock->strct_size = FS_STRCT_SIZE;
+	superblock->journal_size = JOURNAL_REGION_SIZE;
+	superblock->crc = crc32(0,superblock,offsetof(bffs_superblock_t,crc));
+}
+
+/* Tell apart FRAM holding no file system, a damaged one and one laid out by a build with other settings */
+static bffs_st check_superblock(bffs_t* bffs, const bffs_superblock_t* superblock)
+{
+	bffs_superblock_t expected;
+
+	if (superblock->magic != BFFS_MAGIC)
+	{
+		return LOAD_FS_INVALID_FS;
+	}
+	if (superblock->crc != crc32(0,superblock,offsetof(bffs_superblock_t,crc)))
+	{
+		return LOAD_FS_CORRUPT;
+	}
+	fill_superblock(bffs,&expected);
+	if (memcmp(superblock,&expected,sizeof(expected)))
+	{
+		return LOAD_FS_INCOMPATIBLE;
+	}
+	return LOAD_FS_SUCCESS;
+}
+
+/* Layout of the images written before the superblock was added: file structs with 16 bit pointers as the compiler laid
+ * them out, then the file count and file system pointers, data starting right after. It is taken to have had this
+ * build's MAX_FILES and MAX_FILENAME_SIZE */
+typedef struct
+{
+	char filename[MAX_FILENAME_SIZE];
+	uint16_t read_ptr;
+	uint16_t write_ptr;
+	uint16_t start_ptr;
+	uint16_t end_ptr;
+} legacy_file_t;
+
+typedef struct
+{
+	uint16_t file_idx;
+	uint16_t write_ptr;
+	uint16_t end_ptr;
+	uint16_t start_ptr;
+} legacy_fs_header_t;
+
+#define LEGACY_FS_OFFSET ((8+MAX_FILENAME_SIZE)*MAX_FILES+8) //FS_OFFSET of those images
+
+/* Tell whether FRAM without a superblock holds an image of the old layout with files in it, whose pointers are
+ * consistent the way that layout left them: files appended one after another from the end of the file table */
+static uint8_t is_legacy_fs(bffs_t* bffs)
+{
+	legacy_fs_header_t header;
+	legacy_file_t file;
+
+	if (bffs->volume_size < LEGACY_FS_OFFSET)
+	{
+		return 0;
+	}
+	read_payload(bffs,MAX_FILES*sizeof(legacy_file_t),sizeof(header),&header);
+	if ((header.start_ptr != LEGACY_FS_OFFSET) || (header.write_ptr < header.start_ptr) ||
+			(header.end_ptr < header.write_ptr) || (header.end_ptr > bffs->volume_size) ||
+			(header.file_idx == 0) || (header.file_idx > MAX_FILES))
+	{
+		return 0;
+	}
+	uint16_t next_ptr = header.start_ptr;
+	for (uint16_t idx = 0; idx<header.file_idx; idx++)
+	{
+		read_payload(bffs,idx*sizeof(legacy_file_t),sizeof(file),&file);
+		if ((file.filename[0] == '\0') || (file.start_ptr != next_ptr) || (file.write_ptr < file.start_ptr) ||
+				(file.end_ptr < file.write_ptr) || (file.read_ptr < file.start_ptr) || (file.read_ptr > file.end_ptr))
+		{
+			return 0;
+		}
+		next_ptr = file.end_ptr;
+	}
+	return (next_ptr == header.write_ptr);
+}
+
+static void flush_all_append(bffs_t* bffs);
+
+static bffs_st load_fs_locked(bffs_t* bffs)
+{
+	STATS_OP(BFFS_OP_LOAD_FS);
+	drop_all_read_ahead(bffs);
+	/* Buffered appends were acknowledged to the caller, so they are written out instead of being lost */
+	flush_all_append(bffs);
+	/* Read and check the superblock alone first, so foreign or damaged contents are rejected with a short read */
+	read_metadata(bffs,0,sizeof(bffs_superblock_t));
+	bffs_st status = check_superblock(bffs,&bffs->fs->superblock);
+	if (status != LOAD_FS_SUCCESS)
+	{
+		/* An image of the old layout has no magic either, but its files must not be formatted away as blank FRAM */
+		if ((status == LOAD_FS_INVALID_FS) && is_legacy_fs(bffs))
+		{
+			status = LOAD_FS_INCOMPATIBLE;
+		}
+		return status;
+	}
+	/* Read the rest of the file system strct*/
+	read_metadata(bffs,sizeof(bffs_superblock_t),FS_STRCT_SIZE-sizeof(bffs_superblock_t));
+#if BFFS_JOURNAL
+	/* A checkpoint cut short leaves fields of two saves, which the journal can't be replayed onto */
+	if (bffs->fs->checkpoint_crc != get_checkpoint_crc(bffs))
+	{
+		return LOAD_FS_CORRUPT;
+	}
+	/* Bring it up to date with the changes recorded in the journal since it was last saved whole*/
+	replay_journal(bffs);
+#endif
+
+	/*RAM and FRAM copies are identical after loading */
+	bffs->dirty_header = 0;
+	memset(bffs->dirty_files,0,sizeof(bffs->dirty_files));
+	bffs->pending_ops = 0;
+	bffs->pending_bytes = 0;
+
+	//try to look for faulty conditions to validate the fs that is being loaded
+	if (bffs->fs->end_ptr>bffs->volume_size)
+	{
+		return LOAD_FS_CORRUPT;
+	}
+	if (bffs->fs->write_ptr>bffs->fs->end_ptr)
+	{
+		return LOAD_FS_CORRUPT;
+	}
+	if (bffs->fs->file_idx > MAX_FILES)
+	{
+		return LOAD_FS_CORRUPT;
+	}
+	if (bffs->fs->start_ptr>bffs->fs->write_ptr)
+	{
+		return LOAD_FS_CORRUPT;
+	}
+	if (bffs->fs->free_extent_count > MAX_FREE_EXTENTS)
+	{
+		return LOAD_FS_CORRUPT;
+	}
+	if ((bffs->fs->move_slot > MAX_FILES) || ((bffs->fs->move_slot < MAX_FILES) && (bffs->fs->files[bffs->fs->move_slot].filename[0] == '\0')))
+	{
+		return LOAD_FS_CORRUPT;
+	}
+	/*Index the loaded filenames for fast lookups */
+	rebuild_fs_index(bffs);
+	return LOAD_FS_SUCCESS;
+
+}
+
+bffs_st bffs_load_fs(bffs_t* bffs)
+{
+	lock_table(bffs,TABLE_EXCLUSIVE);
+	bffs_st status = load_fs_locked(bffs);
+	unlock_table(bffs,TABLE_EXCLUSIVE);
+	return status;
+}
+
+static bffs_st reset_fs_locked(bffs_t* bffs)
+{
+	STATS_OP(BFFS_OP_RESET_FS);
+	//reset the file system to a clean state
+	fill_superblock(bffs,&bffs->fs->superblock);
+	//reset file structs
+	memset(bffs->fs->files,0,((FILE_STRCT_SIZE)*(MAX_FILES)));
+	drop_all_read_ahead(bffs);
+	drop_all_append(bffs);
+	//reset rest of file system
+	bffs->fs->file_idx = 0;
+	bffs->fs->move_slot = MAX_FILES;
+	bffs->fs->move_dst = 0;
+	bffs->fs->move_done = 0;
+	bffs->fs->free_extent_count = 0;
+	memset(bffs->fs->free_extents,0,sizeof(bffs->fs->free_extents));
+	bffs->fs->start_ptr = FS_OFFSET;
+	bffs->fs->write_ptr = FS_OFFSET;
+	bffs->fs->end_ptr = bffs->fs->start_ptr+(bffs->volume_size-FS_OFFSET);
+	memset(bffs->index,0,sizeof(bffs->index));
+
+	/*Save the current state of the fs in the beginning of FRAM */
+	save_fs_locked(bffs);
+
+	return RESET_FS_SUCCESS;
+}
+
+bffs_st bffs_reset_fs(bffs_t* bffs)
+{
+	lock_table(bffs,TABLE_EXCLUSIVE);
+	bffs_st status = reset_fs_locked(bffs);
+	unlock_table(bffs,TABLE_EXCLUSIVE);
+	return status;
+}
+
+static bffs_st mount_fs_locked(bffs_t* bffs)
+{
+	STATS_OP(BFFS_OP_MOUNT_FS);
+	/*Attempt to load stored fs from FRAM and reset to clean state if no FS is stored. A damaged or incompatible FS
+	 is never formatted here, since it may still be recovered or read by the build that wrote it*/
+	bffs_st status;
+
+	status = load_fs_locked(bffs);
+
+	if (status==LOAD_FS_INVALID_FS)
+	{
+		status = reset_fs_locked(bffs);
+	}
+	if ((status == RESET_FS_SUCCESS) || (status == LOAD_FS_SUCCESS))
+	{
+		return MOUNT_FS_SUCCESS;
+	}
+	else if (status == LOAD_FS_CORRUPT)
+	{
+		return MOUNT_FS_CORRUPT;
+	}
+	else if (status == LOAD_FS_INCOMPATIBLE)
+	{
+		return MOUNT_FS_INCOMPATIBLE;
+	}
+	else
+	{
+		return MOUNT_FS_FAILED;
+	}
+}
+
+bffs_st bffs_mount_fs(bffs_t* bffs)
+{
+	lock_table(bffs,TABLE_EXCLUSIVE);
+	bffs_st status = mount_fs_locked(bffs);
+	unlock_table(bffs,TABLE_EXCLUSIVE);
+	return status;
+}
+
+/* Shared by create_file, create_ring_file and create_record_file */
+static bffs_st create_file_of_type(bffs_t* bffs, char* filename, fram_addr_t file_size, bffs_file_type type,
+		uint16_t record_size, file_t** file_ptr_ptr)
+{
+	//Check if file ptr is valid
+	if (file_ptr_ptr == NULL)
+	{
+		return CREATE_FILE_INVALID_FILE_PTR;
+	}
+	//Check for available file slots
+	if (bffs->fs->file_idx >= MAX_FILES)
+	{
+		return CREATE_FILE_NO_FILE_SLOTS;
+	}
+	//Get filename that is being created and verify its validity
+	char temp_str[MAX_FILENAME_SIZE];
+	if ((filename == NULL) || (*filename == '\0') || !get_filename(filename,temp_str))
+	{
+		return CREATE_FILE_BAD_FILENAME;
+	}
+
+	//Look it up among existing filenames
+	if (find_file(bffs,temp_str) != MAX_FILES)
+	{
+		return CREATE_FILE_FILENAME_TAKEN;
+	}
+	/*Check file size is not 0 and return error if it is*/
+	if (!file_size)
+	{
+		return CREATE_FILE_BAD_SIZE;
+	}
+	/*Find room for the file, in a free extent or after the last file, and check file size is not too large*/
+	fram_addr_t start_ptr;
+	if (!allocate_extent(bffs,file_size,&start_ptr))
+	{
+		return CREATE_FILE_FILE_TOO_LARGE;
+	}
+	/*No problems detected*/
+
+	/*Set filename in a free slot and index it*/
+	uint16_t slot = find_free_slot(bffs);
+	memcpy(bffs->fs->files[slot].filename,temp_str,MAX_FILENAME_SIZE);
+	index_file(bffs,slot);
+
+
+	//Set pointers
+	bffs->fs->files[slot].start_ptr = start_ptr;
+	bffs->fs->files[slot].end_ptr   = start_ptr + file_size;
+	bffs->fs->files[slot].write_ptr = start_ptr;
+	bffs->fs->files[slot].read_ptr  = start_ptr;
+	bffs->fs->files[slot].type = type;
+	bffs->fs->files[slot].wrap_count = 0;
+	bffs->fs->files[slot].record_size = record_size;
+
+	//Set input file_ptr to point to a file in the file system.
+	*file_ptr_ptr = &(bffs->fs->files[slot]);
+
+	mark_file_dirty(bffs,*file_ptr_ptr,FILE_FIELD_ALL);
+
+	bffs->fs->file_idx++;
+	mark_fs_dirty(bffs,FS_FIELD_FILE_IDX);
+
+	/*Commit the changed parts of the file system, since it is now in a new state that should be loadable later*/
+	commit_fs(bffs,0);
+	return CREATE_FILE_SUCCESS;
+}
+
+bffs_st bffs_create_file(bffs_t* bffs, char* filename, fram_addr_t file_size, file_t** file_ptr_ptr)
+{
+	STATS_OP(BFFS_OP_CREATE_FILE);
+	lock_table(bffs,TABLE_EXCLUSIVE);
+	bffs_st status = create_file_of_type(bffs,filename,file_size,FILE_TYPE_REGULAR,0,file_ptr_ptr);
+	unlock_table(bffs,TABLE_EXCLUSIVE);
+	return status;
+}
+
+bffs_st bffs_create_ring_file(bffs_t* bffs, char* filename, fram_addr_t file_size, file_t** file_ptr_ptr)
+{
+	STATS_OP(BFFS_OP_CREATE_RING_FILE);
+	lock_table(bffs,TABLE_EXCLUSIVE);
+	bffs_st status = create_file_of_type(bffs,filename,file_size,FILE_TYPE_RING,0,file_ptr_ptr);
+	unlock_table(bffs,TABLE_EXCLUSIVE);
+	return status;
+}
+
+bffs_st bffs_create_record_file(bffs_t* bffs, char* filename, uint16_t record_size, fram_addr_t max_records, file_t** file_ptr_ptr)
+{
+	STATS_OP(BFFS_OP_CREATE_RECORD_FILE);
+	/*Check the file size is not 0 and can be addressed */
+	if ((!record_size) || (!max_records))
+	{
+		return CREATE_FILE_BAD_SIZE;
+	}
+	if ((uint64_t)record_size*max_records > FRAM_ADDR_MAX)
+	{
+		return CREATE_FILE_FILE_TOO_LARGE;
+	}
+	lock_table(bffs,TABLE_EXCLUSIVE);
+	bffs_st status = create_file_of_type(bffs,filename,record_size*max_records,FILE_TYPE_RECORD,record_size,file_ptr_ptr);
+	unlock_table(bffs,TABLE_EXCLUSIVE);
+	return status;
+}
+
+bffs_st bffs_open_file(bffs_t* bffs, char* filename,file_t** file_ptr_ptr)
+{
+	STATS_OP(BFFS_OP_OPEN_FILE);
+	/*Check if file ptr is valid */
+	if (file_ptr_ptr == NULL)
+	{
+		return OPEN_FILE_INVALID_FILE_PTR;
+	}
+	//Get string that is being searched, names that don't fit can't belong to any file
+	char temp_str[MAX_FILENAME_SIZE];
+	if ((filename == NULL) || !get_filename(filename,temp_str))
+	{
+		return OPEN_FILE_FILE_NOT_FOUND;
+	}
+	for (;;)
+	{
+		//Look it up in the filename index
+		lock_table(bffs,TABLE_SHARED);
+		uint16_t slot = find_file(bffs,temp_str);
+		unlock_table(bffs,TABLE_SHARED);
+		if (slot == MAX_FILES)
+		{
+			return OPEN_FILE_FILE_NOT_FOUND;
+		}
+		/*The slot may be freed or reused by another task before the file lock is taken, so the file is only
+		 *opened if it still has the name once the lock is held, and looked up again otherwise */
+		file_t* file_ptr = &(bffs->fs->files[slot]);
+		lock_file(bffs,file_ptr);
+		if (!memcmp(file_ptr->filename,temp_str,MAX_FILENAME_SIZE))
+		{
+			/*If a file with a matching file name is found, make the input pointer point to it. */
+			lock_commit(bffs);
+			file_ptr->read_ptr = file_ptr->start_ptr; //reset read so any loaded read ptrs are reset
+			unlock_commit(bffs);
+			unlock_file(bffs,file_ptr);
+			*file_ptr_ptr = file_ptr;
+			return OPEN_FILE_SUCCESS;
+		}
+		unlock_file(bffs,file_ptr);
+	}
+
+}
+
+static bffs_st delete_file_locked(bffs_t* bffs, char* filename)
+{
+	STATS_OP(BFFS_OP_DELETE_FILE);
+	//Get string that is being searched, names that don't fit can't belong to any file
+	char temp_str[MAX_FILENAME_SIZE];
+	if ((filename == NULL) || !get_filename(filename,temp_str))
+	{
+		return DELETE_FILE_FILE_NOT_FOUND;
+	}
+	uint16_t slot = find_file(bffs,temp_str);
+	if (slot == MAX_FILES)
+	{
+		return DELETE_FILE_FILE_NOT_FOUND;
+	}
+	settle_file(bffs,&bffs->fs->files[slot]);
+	/*Give the file data region back to the allocator */
+	release_extent(bffs,bffs->fs->files[slot].start_ptr,bffs->fs->files[slot].end_ptr-bffs->fs->files[slot].start_ptr);
+
+	/*Free the slot. Open addressing can't simply empty a bucket, so the index is rebuilt */
+	drop_read_ahead(bffs,&bffs->fs->files[slot]);
+	drop_append(bffs,&bffs->fs->files[slot]);
+	memset(&bffs->fs->files[slot],0,sizeof(file_t));
+	mark_file_dirty(bffs,&bffs->fs->files[slot],FILE_FIELD_ALL);
+	bffs->fs->file_idx--;
+	mark_fs_dirty(bffs,FS_FIELD_FILE_IDX);
+	rebuild_fs_index(bffs);
+
+	/*Commit the changed parts of the file system */
+	commit_fs(bffs,0);
+	return DELETE_FILE_SUCCESS;
+}
+
+bffs_st bffs_delete_file(bffs_t* bffs, char* filename)
+{
+	lock_table(bffs,TABLE_EXCLUSIVE);
+	bffs_st status = delete_file_locked(bffs,filename);
+	unlock_table(bffs,TABLE_EXCLUSIVE);
+	return status;
+}
+
+
+/* Write data at the write pointer of a file, already checked, and move the pointer past it */
+static void append_data(bffs_t* bffs, file_t* file_ptr, fram_addr_t data_length, void* data_ptr)
+{
+	fram_segment_t data[2];
+	uint16_t count = get_write_segments(file_ptr,data_length,data_ptr,data);
+#if BFFS_THREAD_SAFE
+	/*Write file data in the FRAM first, so appends to other files only wait for each other's metadata commits */
+	write_segments(bffs,data,count);
+	lock_commit(bffs);
+	advance_write_ptr(bffs,file_ptr,data_length);
+	commit_fs(bffs,data_length);
+	unlock_commit(bffs);
+#else
+	/*Move the file write pointer past the data */
+	advance_write_ptr(bffs,file_ptr,data_length);
+
+	/*Write file data in the FRAM, together with the FS state if the commit policy requires it */
+	commit_fs_payload(bffs,data,count);
+#endif
+}
+
+/* Write the append buffer of a file out, as a single append */
+static void flush_append(bffs_t* bffs, file_t* file_ptr)
+{
+#if BFFS_APPEND_BUFFER
+	bffs_append_buffer_t* buffer = get_append_buffer(bffs,file_ptr);
+	if ((buffer != NULL) && buffer->length)
+	{
+		fram_addr_t length = buffer->length;
+		buffer->length = 0;
+		append_data(bffs,file_ptr,length,buffer->data);
+	}
+#else
+	(void)bffs;
+	(void)file_ptr;
+#endif
+}
+
+/* Write the append buffers of all files out. The caller holds the table lock exclusively, keeping calls on files out */
+static void flush_all_append(bffs_t* bffs)
+{
+#if BFFS_APPEND_BUFFER
+	for (uint16_t slot = 0; slot<MAX_FILES; slot++)
+	{
+		flush_append(bffs,&bffs->fs->files[slot]);
+	}
+#else
+	(void)bffs;
+#endif
+}
+
+/* Copy a short write to the append buffer of its file, flushing the buffer first if the write doesn't fit and after
+ * if it is full. Returns 0 if the write isn't buffered, the buffer having been flushed so the write lands after it */
+static uint8_t stage_append(bffs_t* bffs, file_t* file_ptr, fram_addr_t data_length, void* data_ptr)
+{
+#if BFFS_APPEND_BUFFER
+	bffs_append_buffer_t* buffer = get_append_buffer(bffs,file_ptr);
+	if ((buffer == NULL) || (data_length >= APPEND_BUFFER_SIZE))
+	{
+		flush_append(bffs,file_ptr);
+		return 0;
+	}
+	if (buffer->length+data_length > APPEND_BUFFER_SIZE)
+	{
+		flush_append(bffs,file_ptr);
+	}
+	memcpy(&buffer->data[buffer->length],data_ptr,data_length);
+	buffer->length += data_length;
+	if (buffer->length == APPEND_BUFFER_SIZE)
+	{
+		flush_append(bffs,file_ptr);
+	}
+	return 1;
+#else
+	(void)bffs;
+	(void)file_ptr;
+	(void)data_length;
+	(void)data_ptr;
+	return 0;
+#endif
+}
+
+static bffs_st write_file_locked(bffs_t* bffs, file_t* file_ptr, fram_addr_t data_length, void* data_ptr)
+{
+	/*Check for invalid inputs */
+	bffs_st status = check_write(bffs,file_ptr,data_length,data_ptr);
+	if (status != WRITE_FILE_SUCCESS)
+	{
+		return status;
+	}
+	/*Short writes are gathered in the append buffer, others go to FRAM after it */
+	if (!stage_append(bffs,file_ptr,data_length,data_ptr))
+	{
+		append_data(bffs,file_ptr,data_length,data_ptr);
+	}
+	return WRITE_FILE_SUCCESS;
+
+}
+
+uint16_t bffs_write_file(bffs_t* bffs, file_t* file_ptr, fram_addr_t data_length, void* data_ptr)
+{
+	STATS_OP(BFFS_OP_WRITE_FILE);
+	lock_file(bffs,file_ptr);
+	bffs_st status = write_file_locked(bffs,file_ptr,data_length,data_ptr);
+	unlock_file(bffs,file_ptr);
+	return status;
+}
+
+bffs_st bffs_flush_file(bffs_t* bffs, file_t* file_ptr)
+{
+	STATS_OP(BFFS_OP_FLUSH_FILE);
+	/*Check pointer validity */
+	if (file_ptr == NULL)
+	{
+		return FLUSH_FILE_INVALID_FILE_PTR;
+	}
+	lock_file(bffs,file_ptr);
+	flush_append(bffs,file_ptr);
+	unlock_file(bffs,file_ptr);
+	return FLUSH_FILE_SUCCESS;
+}
+
+bffs_st bffs_flush_fs_buffers(bffs_t* bffs)
+{
+#if BFFS_APPEND_BUFFER
+	/*Each file is locked in turn, as empty buffers are found under the lock too */
+	for (uint16_t slot = 0; slot<MAX_FILES; slot++)
+	{
+		lock_file(bffs,&bffs->fs->files[slot]);
+		flush_append(bffs,&bffs->fs->files[slot]);
+		unlock_file(bffs,&bffs->fs->files[slot]);
+	}
+#else
+	(void)bffs;
+#endif
+	return FLUSH_FS_BUFFERS_SUCCESS;
+}
+
+static bffs_st read_file_locked(bffs_t* bffs, file_t* file_ptr, fram_addr_t data_length, void* data_ptr, bffs_read_file_option option)
+{
+	STATS_OP(BFFS_OP_READ_FILE);
+	/*Check for invalid inputs */
+	fram_addr_t unwritten;
+	bffs_st status = check_read(bffs,file_ptr,data_length,data_ptr,&unwritten);
+	if (status != READ_FILE_SUCCESS)
+	{
+		return status;
+	}
+	/*Read FRAM at the specified location, and 0 the unwritten part instead of returning stale FRAM data */
+	if (!read_ahead(bffs,file_ptr,data_length,data_ptr))
+	{
+		fram_addr_t buffered = read_append(bffs,file_ptr,data_length-unwritten,data_ptr);
+		if (data_length-unwritten > buffered)
+		{
+			read_payload(bffs,file_ptr->read_ptr,data_length-unwritten-buffered,data_ptr);
+		}
+		memset((uint8_t*)data_ptr+(data_length-unwritten),0,unwritten);
+	}
+	if (option == READ_FILE_RESET_READ_PTR)
+	{
+		/*Reset the read pointer to the start if such is specified */
+		lock_commit(bffs);
+		file_ptr->read_ptr = file_ptr->start_ptr;
+		unlock_commit(bffs);
+	}
+	return READ_FILE_SUCCESS;
+}
+
+bffs_st bffs_read_file(bffs_t* bffs, file_t* file_ptr, fram_addr_t data_length, void* data_ptr, bffs_read_file_option option)
+{
+	lock_file(bffs,file_ptr);
+	bffs_st status = read_file_locked(bffs,file_ptr,data_length,data_ptr,option);
+	unlock_file(bffs,file_ptr);
+	return status;
+}
+
+/* Add up the lengths of a list of buffers */
+static uint64_t get_iovec_length(const bffs_iovec_t* iov, uint16_t iov_count)
+{
+	uint64_t data_length = 0;
+
+	for (uint16_t idx = 0; idx<iov_count; idx++)
+	{
+		data_length += iov[idx].data_length;
+	}
+	return data_length;
+}
+
+static bffs_st write_file_v_locked(bffs_t* bffs, file_t* file_ptr, const bffs_iovec_t* iov, uint16_t iov_count)
+{
+	STATS_OP(BFFS_OP_WRITE_FILE_V);
+	/*Buffered appends go first, the buffers being laid out from the write pointer */
+	flush_append(bffs,file_ptr);
+	/*Check buffers validity*/
+	if (iov == NULL)
+	{
+		return WRITE_FILE_INVALID_DATA_PTR;
+	}
+	uint64_t data_length = get_iovec_length(iov,iov_count);
+	if (data_length > FRAM_ADDR_MAX)
+	{
+		return WRITE_FILE_OVERFLOW;
+	}
+	/*Check for invalid inputs, once for the whole record */
+	bffs_st status = check_write(bffs,file_ptr,(fram_addr_t)data_length,(void*)iov);
+	if (status != WRITE_FILE_SUCCESS)
+	{
+		return status;
+	}
+	for (uint16_t idx = 0; idx<iov_count; idx++)
+	{
+		if ((iov[idx].data_ptr == NULL) && iov[idx].data_length)
+		{
+			return WRITE_FILE_INVALID_DATA_PTR;
+		}
+	}
+	/*Lay the buffers one after the other from the write pointer. Being contiguous in FRAM, the driver writes each
+	 *batch of them in a single transaction. A buffer wrapping around a ring file takes two segments. The write pointer
+	 *moves along, so the commit lock is held throughout */
+	fram_segment_t segments[SEGMENT_BATCH];
+	uint16_t count = 0;
+	lock_commit(bffs);
+	for (uint16_t idx = 0; idx<iov_count; idx++)
+	{
+		if (!iov[idx].data_length)
+		{
+			continue;
+		}
+		if (count > SEGMENT_BATCH-2)
+		{
+			write_segments(bffs,segments,count);
+			count = 0;
+		}
+		count += get_write_segments(file_ptr,iov[idx].data_length,iov[idx].data_ptr,&segments[count]);
+		advance_write_ptr(bffs,file_ptr,iov[idx].data_length);
+	}
+
+	/*Write the last batch in the FRAM, together with a single FS state update if the commit policy requires it */
+	commit_fs_payload(bffs,segments,count);
+	unlock_commit(bffs);
+	return WRITE_FILE_SUCCESS;
+}
+
+bffs_st bffs_write_file_v(bffs_t* bffs, file_t* file_ptr, const bffs_iovec_t* iov, uint16_t iov_count)
+{
+	lock_file(bffs,file_ptr);
+	bffs_st status = write_file_v_locked(bffs,file_ptr,iov,iov_count);
+	unlock_file(bffs,file_ptr);
+	return status;
+}
+
+static bffs_st read_file_v_locked(bffs_t* bffs, file_t* file_ptr, const bffs_iovec_t* iov, uint16_t iov_count,
+		bffs_read_file_option option)
+{
+	STATS_OP(BFFS_OP_READ_FILE_V);
+	/*Buffered appends are read from FRAM like the rest */
+	flush_append(bffs,file_ptr);
+	/*Check buffers validity*/
+	if (iov == NULL)
+	{
+		return READ_FILE_INVALID_DATA_PTR;
+	}
+	uint64_t data_length = get_iovec_length(iov,iov_count);
+	if (data_length > FRAM_ADDR_MAX)
+	{
+		return READ_FILE_OVERFLOW;
+	}
+	/*Check for invalid inputs, once for the whole read */
+	fram_addr_t unwritten;
+	bffs_st status = check_read(bffs,file_ptr,(fram_addr_t)data_length,(void*)iov,&unwritten);
+	if (status != READ_FILE_SUCCESS)
+	{
+		return status;
+	}
+	for (uint16_t idx = 0; idx<iov_count; idx++)
+	{
+		if ((iov[idx].data_ptr == NULL) && iov[idx].data_length)
+		{
+			return READ_FILE_INVALID_DATA_PTR;
+		}
+	}
+	/*Fill the buffers one after the other from the read pointer, with batches of contiguous segments read in a single
+	 *transaction, and 0 the part past the write pointer */
+	fram_segment_t segments[SEGMENT_BATCH];
+	uint16_t count = 0;
+	fram_addr_t address = file_ptr->read_ptr;
+	fram_addr_t written = (fram_addr_t)data_length-unwritten;
+	for (uint16_t idx = 0; idx<iov_count; idx++)
+	{
+		fram_addr_t from_fram = (iov[idx].data_length < written) ? iov[idx].data_length : written;
+		if (from_fram)
+		{
+			if (count == SEGMENT_BATCH)
+			{
+				read_segments(bffs,segments,count);
+				count = 0;
+			}
+			segments[count].address = address;
+			segments[count].data_length = from_fram;
+			segments[count].data_ptr = iov[idx].data_ptr;
+			count++;
+		}
+		memset((uint8_t*)iov[idx].data_ptr+from_fram,0,iov[idx].data_length-from_fram);
+		address += iov[idx].data_length;
+		written -= from_fram;
+	}
+	read_segments(bffs,segments,count);
+
+	if (option == READ_FILE_RESET_READ_PTR)
+	{
+		/*Reset the read pointer to the start if such is specified */
+		lock_commit(bffs);
+		file_ptr->read_ptr = file_ptr->start_ptr;
+		unlock_commit(bffs);
+	}
+	return READ_FILE_SUCCESS;
+}
+
+bffs_st bffs_read_file_v(bffs_t* bffs, file_t* file_ptr, const bffs_iovec_t* iov, uint16_t iov_count, bffs_read_file_option option)
+{
+	lock_file(bffs,file_ptr);
+	bffs_st status = read_file_v_locked(bffs,file_ptr,iov,iov_count,option);
+	unlock_file(bffs,file_ptr);
+	return status;
+}
+
+static bffs_st read_ring_file_locked(bffs_t* bffs, file_t* file_ptr, fram_addr_t data_length, void* data_ptr)
+{
+	STATS_OP(BFFS_OP_READ_RING_FILE);
+	/*Check pointer validity */
+	if (file_ptr == NULL)
+	{
+		return READ_FILE_INVALID_FILE_PTR;
+	}
+	if (data_ptr == NULL)
+	{
+		return READ_FILE_INVALID_DATA_PTR;
+	}
+	/*Check data length is not 0 */
+	if (data_length == 0)
+	{
+		return READ_FILE_BAD_LENGTH;
+	}
+	if (file_ptr->type != FILE_TYPE_RING)
+	{
+		return READ_FILE_BAD_TYPE;
+	}
+	settle_file(bffs,file_ptr);
+	/*Only bytes that were written can be read, all of the file once it has wrapped */
+	if (data_length > bffs_get_file_used_bytes(bffs,file_ptr))
+	{
+		return READ_FILE_OVERFLOW;
+	}
+	/*The newest bytes end at the write pointer. If there are fewer than data_length bytes between the start and write
+	 *pointers, the older ones are at the end of the file */
+	fram_segment_t segments[2];
+	uint16_t count = 0;
+	fram_addr_t head = file_ptr->write_ptr-file_ptr->start_ptr;
+	if (data_length > head)
+	{
+		segments[count].address = file_ptr->end_ptr-(data_length-head);
+		segments[count].data_length = data_length-head;
+		segments[count].data_ptr = data_ptr;
+		count++;
+	}
+	fram_addr_t newest = (data_length > head) ? head : data_length;
+	if (newest)
+	{
+		segments[count].address = file_ptr->write_ptr-newest;
+		segments[count].data_length = newest;
+		segments[count].data_ptr = (uint8_t*)data_ptr+(data_length-newest);
+		count++;
+	}
+	read_segments(bffs,segments,count);
+	return READ_FILE_SUCCESS;
+}
+
+bffs_st bffs_read_ring_file(bffs_t* bffs, file_t* file_ptr, fram_addr_t data_length, void* data_ptr)
+{
+	lock_file(bffs,file_ptr);
+	bffs_st status = read_ring_file_locked(bffs,file_ptr,data_length,data_ptr);
+	unlock_file(bffs,file_ptr);
+	return status;
+}
+
+/* Record files: record i is at start_ptr+i*record_size, and the records appended so far end at the write pointer, which
+ * only moves by whole records */
+static bffs_st append_records_locked(bffs_t* bffs, file_t* file_ptr, fram_addr_t record_count, void* data_ptr)
+{
+	/*Check pointer validity and file type */
+	if (file_ptr == NULL)
+	{
+		return WRITE_FILE_INVALID_FILE_PTR;
+	}
+	if (file_ptr->type != FILE_TYPE_RECORD)
+	{
+		return WRITE_FILE_BAD_TYPE;
+	}
+	if ((uint64_t)record_count*file_ptr->record_size > FRAM_ADDR_MAX)
+	{
+		return WRITE_FILE_OVERFLOW;
+	}
+	/*Records are written as any other file data, in one transfer and one metadata update */
+	return write_file_locked(bffs,file_ptr,record_count*file_ptr->record_size,data_ptr);
+}
+
+bffs_st bffs_append_records(bffs_t* bffs, file_t* file_ptr, fram_addr_t record_count, void* data_ptr)
+{
+	STATS_OP(BFFS_OP_APPEND_RECORDS);
+	lock_file(bffs,file_ptr);
+	bffs_st status = append_records_locked(bffs,file_ptr,record_count,data_ptr);
+	unlock_file(bffs,file_ptr);
+	return status;
+}
+
+static bffs_st read_records_locked(bffs_t* bffs, file_t* file_ptr, fram_addr_t first_record, fram_addr_t record_count, void* data_ptr)
+{
+	/*Check pointer validity */
+	if (file_ptr == NULL)
+	{
+		return READ_FILE_INVALID_FILE_PTR;
+	}
+	if (data_ptr == NULL)
+	{
+		return READ_FILE_INVALID_DATA_PTR;
+	}
+	/*Check record count is not 0 */
+	if (record_count == 0)
+	{
+		return READ_FILE_BAD_LENGTH;
+	}
+	if (file_ptr->type != FILE_TYPE_RECORD)
+	{
+		return READ_FILE_BAD_TYPE;
+	}
+	settle_file(bffs,file_ptr);
+	flush_append(bffs,file_ptr);
+	/*Only records that were appended can be read */
+	if ((uint64_t)first_record+record_count > bffs_get_file_records(bffs,file_ptr))
+	{
+		return READ_FILE_OVERFLOW;
+	}
+	read_payload(bffs,file_ptr->start_ptr+first_record*file_ptr->record_size,record_count*file_ptr->record_size,data_ptr);
+	return READ_FILE_SUCCESS;
+}
+
+bffs_st bffs_read_records(bffs_t* bffs, file_t* file_ptr, fram_addr_t first_record, fram_addr_t record_count, void* data_ptr)
+{
+	STATS_OP(BFFS_OP_READ_RECORDS);
+	lock_file(bffs,file_ptr);
+	bffs_st status = read_records_locked(bffs,file_ptr,first_record,record_count,data_ptr);
+	unlock_file(bffs,file_ptr);
+	return status;
+}
+
+bffs_st bffs_read_record(bffs_t* bffs, file_t* file_ptr, fram_addr_t record_idx, void* data_ptr)
+{
+	return bffs_read_records(bffs,file_ptr,record_idx,1,data_ptr);
+}
+
+/* Positional access to the written part of regular and record files, which leaves the file pointers and metadata as
+ * they are. Ring file offsets would move with each wrap, so ring files are not accepted */
+static bffs_st check_file_at(bffs_t* bffs, uint8_t is_write, file_t* file_ptr, fram_addr_t offset, fram_addr_t data_length,
+		void* data_ptr)
+{
+	/*Check pointer validity */
+	if (file_ptr == NULL)
+	{
+		return is_write ? WRITE_FILE_INVALID_FILE_PTR : READ_FILE_INVALID_FILE_PTR;
+	}
+	if (data_ptr == NULL)
+	{
+		return is_write ? WRITE_FILE_INVALID_DATA_PTR : READ_FILE_INVALID_DATA_PTR;
+	}
+	if (file_ptr->type == FILE_TYPE_RING)
+	{
+		return is_write ? WRITE_FILE_BAD_TYPE : READ_FILE_BAD_TYPE;
+	}
+	if (data_length == 0)
+	{
+		return is_write ? WRITE_FILE_BAD_LENGTH : READ_FILE_BAD_LENGTH;
+	}
+	/*A file being moved is settled first, so the bytes are accessed at their final place, and buffered appends are
+	 *flushed so they can be accessed too */
+	settle_file(bffs,file_ptr);
+	flush_append(bffs,file_ptr);
+	if ((uint64_t)offset+data_length > (fram_addr_t)(file_ptr->write_ptr-file_ptr->start_ptr))
+	{
+		return is_write ? WRITE_FILE_OVERFLOW : READ_FILE_OVERFLOW;
+	}
+	return is_write ? WRITE_FILE_SUCCESS : READ_FILE_SUCCESS;
+}
+
+static bffs_st write_file_at_locked(bffs_t* bffs, file_t* file_ptr, fram_addr_t offset, fram_addr_t data_length, void* data_ptr)
+{
+	/*Check for invalid inputs */
+	bffs_st status = check_file_at(bffs,1,file_ptr,offset,data_length,data_ptr);
+	if (status != WRITE_FILE_SUCCESS)
+	{
+		return status;
+	}
+	/*Only data is written, nothing in the file system changes */
+	drop_read_ahead(bffs,file_ptr);
+	fram_segment_t segment = {file_ptr->start_ptr+offset,data_length,data_ptr};
+	write_segments(bffs,&segment,1);
+	return WRITE_FILE_SUCCESS;
+}
+
+bffs_st bffs_write_file_at(bffs_t* bffs, file_t* file_ptr, fram_addr_t offset, fram_addr_t data_length, void* data_ptr)
+{
+	STATS_OP(BFFS_OP_WRITE_FILE_AT);
+	lock_file(bffs,file_ptr);
+	bffs_st status = write_file_at_locked(bffs,file_ptr,offset,data_length,data_ptr);
+	unlock_file(bffs,file_ptr);
+	return status;
+}
+
+static bffs_st read_file_at_locked(bffs_t* bffs, file_t* file_ptr, fram_addr_t offset, fram_addr_t data_length, void* data_ptr)
+{
+	/*Check for invalid inputs */
+	bffs_st status = check_file_at(bffs,0,file_ptr,offset,data_length,data_ptr);
+	if (status != READ_FILE_SUCCESS)
+	{
+		return status;
+	}
+	read_payload(bffs,file_ptr->start_ptr+offset,data_length,data_ptr);
+	return READ_FILE_SUCCESS;
+}
+
+bffs_st bffs_read_file_at(bffs_t* bffs, file_t* file_ptr, fram_addr_t offset, fram_addr_t data_length, void* data_ptr)
+{
+	STATS_OP(BFFS_OP_READ_FILE_AT);
+	lock_file(bffs,file_ptr);
+	bffs_st status = read_file_at_locked(bffs,file_ptr,offset,data_length,data_ptr);
+	unlock_file(bffs,file_ptr);
+	return status;
+}
+
+/* Asynchronous file operations: only one can be in progress at a time, and no other BFFS call should be made until
+ * its callback is called */
+
+static void finish_file_async(bffs_t* bffs, bffs_st status)
+{
+	bffs_callback_t callback = bffs->async_callback;
+
+	bffs->async_busy = 0;
+	if (callback != NULL)
+	{
+		callback(status,bffs->async_file,bffs->async_ctx);
+	}
+}
+
+/* Chain of asynchronous writes saving the dirty metadata spans one after another */
+static void sync_fs_async_step(fram_st fram_status, void* ctx)
+{
+	bffs_t* bffs = ctx;
+	uint16_t span_start;
+	uint16_t span_length;
+
+	if (fram_status != FRAM_OK)
+	{
+		/*The span that failed is no longer tracked as dirty, so have the next save write everything*/
+		mark_fs_dirty(bffs,FS_FIELD_ALL);
+		memset(bffs->dirty_files,FILE_FIELD_ALL,sizeof(bffs->dirty_files));
+#if BFFS_JOURNAL
+		/*Records past the failed ones would never be replayed, so the next save must be a checkpoint*/
+		bffs->journal_used = JOURNAL_SIZE;
+#endif
+		finish_file_async(bffs,WRITE_FILE_DRIVER_ERROR);
+		return;
+	}
+	if (take_dirty_span(bffs,&span_start,&span_length))
+	{
+		bffs->async_segments[0].address = span_start;
+		bffs->async_segments[0].data_length = span_length;
+		bffs->async_segments[0].data_ptr = ((uint8_t*)bffs->fs)+span_start;
+		if (transfer_async(bffs,1,bffs->async_segments,1,sync_fs_async_step) != FRAM_OK)
+		{
+			sync_fs_async_step(FRAM_ERROR,bffs);
+		}
+		return;
+	}
+	bffs->pending_ops = 0;
+	bffs->pending_bytes = 0;
+	finish_file_async(bffs,WRITE_FILE_SUCCESS);
+}
+
+/* Start saving the dirty metadata after an asynchronous write. With the journal, the whole batch of records (or the
+ * checkpoint if it doesn't fit) goes in a single transfer, after which sync_fs_async_step finds nothing left to save */
+static void start_sync_fs_async(bffs_t* bffs)
+{
+	STATS_ADD(save_fs_changes_calls,1);
+#if BFFS_JOURNAL
+	uint16_t segment_count;
+
+	if (!build_journal_batch(bffs,&segment_count))
+	{
+		STATS_ADD(save_fs_calls,1);
+		segment_count = get_checkpoint_segments(bffs,bffs->journal_segments);
+	}
+	if (!segment_count)
+	{
+		sync_fs_async_step(FRAM_OK,bffs);
+	}
+	else if (transfer_async(bffs,1,bffs->journal_segments,segment_count,sync_fs_async_step) != FRAM_OK)
+	{
+		sync_fs_async_step(FRAM_ERROR,bffs);
+	}
+#else
+	sync_fs_async_step(FRAM_OK,bffs);
+#endif
+}
+
+static void write_file_async_done(fram_st fram_status, void* ctx)
+{
+	bffs_t* bffs = ctx;
+
+	if (fram_status != FRAM_OK)
+	{
+		finish_file_async(bffs,WRITE_FILE_DRIVER_ERROR);
+		return;
+	}
+	/*The data is in FRAM, so the file pointers can now be moved and committed */
+	advance_write_ptr(bffs,bffs->async_file,bffs->async_length);
+	if (add_pending(bffs,bffs->async_length))
+	{
+		start_sync_fs_async(bffs);
+	}
+	else
+	{
+		finish_file_async(bffs,WRITE_FILE_SUCCESS);
+	}
+}
+
+static void read_file_async_done(fram_st fram_status, void* ctx)
+{
+	bffs_t* bffs = ctx;
+
+	if (fram_status != FRAM_OK)
+	{
+		finish_file_async(bffs,READ_FILE_DRIVER_ERROR);
+		return;
+	}
+	if (bffs->async_option == READ_FILE_RESET_READ_PTR)
+	{
+		bffs->async_file->read_ptr = bffs->async_file->start_ptr;
+	}
+	finish_file_async(bffs,READ_FILE_SUCCESS);
+}
+
+bffs_st bffs_write_file_async(bffs_t* bffs, file_t* file_ptr, fram_addr_t data_length, void* data_ptr, bffs_callback_t callback, void* ctx)
+{
+	STATS_OP(BFFS_OP_WRITE_FILE_ASYNC);
+	/*Check for invalid inputs */
+	bffs_st status = check_write(bffs,file_ptr,data_length,data_ptr);
+	if (status != WRITE_FILE_SUCCESS)
+	{
+		return status;
+	}
+	if (bffs->async_busy)
+	{
+		return WRITE_FILE_BUSY;
+	}
+	/*Buffered appends are written first, the data going after them */
+	flush_append(bffs,file_ptr);
+	bffs->async_busy = 1;
+	bffs->async_file = file_ptr;
+	bffs->async_length = data_length;
+	bffs->async_callback = callback;
+	bffs->async_ctx = ctx;
+	bffs->async_segment_count = get_write_segments(file_ptr,data_length,data_ptr,bffs->async_segments);
+
+	/*Start writing the file data, the file pointers are only moved once it is in FRAM */
+	fram_st fram_status = transfer_async(bffs,1,bffs->async_segments,bffs->async_segment_count,write_file_async_done);
+	if (fram_status != FRAM_OK)
+	{
+		bffs->async_busy = 0;
+		return (fram_status == FRAM_BUSY) ? WRITE_FILE_BUSY : WRITE_FILE_DRIVER_ERROR;
+	}
+	return WRITE_FILE_SUCCESS;
+}
+
+bffs_st bffs_read_file_async(bffs_t* bffs, file_t* file_ptr, fram_addr_t data_length, void* data_ptr, bffs_read_file_option option,
+		bffs_callback_t callback, void* ctx)
+{
+	STATS_OP(BFFS_OP_READ_FILE_ASYNC);
+	/*Check for invalid inputs */
+	fram_addr_t unwritten;
+	bffs_st status = check_read(bffs,file_ptr,data_length,data_ptr,&unwritten);
+	if (status != READ_FILE_SUCCESS)
+	{
+		return status;
+	}
+	if (bffs->async_busy)
+	{
+		return READ_FILE_BUSY;
+	}
+	/*Buffered appends are read from FRAM like the rest */
+	flush_append(bffs,file_ptr);
+	bffs->async_busy = 1;
+	bffs->async_file = file_ptr;
+	bffs->async_option = option;
+	bffs->async_callback = callback;
+	bffs->async_ctx = ctx;
+
+	/*The unwritten part is known to be 0, only the rest needs a transfer */
+	memset((uint8_t*)data_ptr+(data_length-unwritten),0,unwritten);
+	if (data_length == unwritten)
+	{
+		read_file_async_done(FRAM_OK,bffs);
+		return READ_FILE_SUCCESS;
+	}
+	bffs->async_segments[0].address = file_ptr->read_ptr;
+	bffs->async_segments[0].data_length = data_length-unwritten;
+	bffs->async_segments[0].data_ptr = data_ptr;
+	fram_st fram_status = transfer_async(bffs,0,bffs->async_segments,1,read_file_async_done);
+	if (fram_status != FRAM_OK)
+	{
+		bffs->async_busy = 0;
+		return (fram_status == FRAM_BUSY) ? READ_FILE_BUSY : READ_FILE_DRIVER_ERROR;
+	}
+	return READ_FILE_SUCCESS;
+}
+
+/* Streaming reads: chunks are read into two stack buffers in turn, the next one being fetched while the consumer has
+ * the current one */
+static void read_stream_chunk_done(fram_st fram_status, void* ctx)
+{
+	bffs_t* bffs = ctx;
+
+	bffs->stream_status = fram_status;
+	__atomic_store_n(&bffs->stream_pending,0,__ATOMIC_RELEASE);
+}
+
+/* Wait for the chunk being read to be in its buffer. This only ends once the driver calls read_stream_chunk_done, or
+ * its wait_async hook gives up on the transfer, which then counts as failed */
+static void wait_stream_chunk(bffs_t* bffs)
+{
+	while (__atomic_load_n(&bffs->stream_pending,__ATOMIC_ACQUIRE))
+	{
+		if ((bffs->driver->wait_async != NULL) && (bffs->driver->wait_async(bffs->driver_ctx) != FRAM_OK))
+		{
+			bffs->stream_status = FRAM_ERROR;
+			bffs->stream_pending = 0;
+		}
+	}
+}
+
+/* Read chunk_length bytes at offset from the read pointer into a buffer, of which the first written ones are in FRAM.
+ * Returns 1 if an asynchronous read was started and is pending, 0 if the chunk is already in the buffer */
+static uint8_t read_stream_chunk(bffs_t* bffs, const file_t* file_ptr, fram_addr_t offset, fram_addr_t chunk_length,
+		fram_addr_t written, uint8_t* buffer)
+{
+	fram_addr_t in_fram = (offset >= written) ? 0 : (written-offset < chunk_length) ? written-offset : chunk_length;
+
+	/*Bytes past the write pointer read as 0, as for read_file */
+	memset(buffer+in_fram,0,chunk_length-in_fram);
+	if (!in_fram)
+	{
+		return 0;
+	}
+	if (bffs->driver->read_async != NULL)
+	{
+		bffs->async_segments[0].address = file_ptr->read_ptr+offset;
+		bffs->async_segments[0].data_length = in_fram;
+		bffs->async_segments[0].data_ptr = buffer;
+		__atomic_store_n(&bffs->stream_pending,1,__ATOMIC_RELEASE);
+		if (transfer_async(bffs,0,bffs->async_segments,1,read_stream_chunk_done) == FRAM_OK)
+		{
+			return 1;
+		}
+		/*Nothing was started (a bus is busy with another asynchronous transfer), read it the blocking way */
+		bffs->stream_pending = 0;
+	}
+	read_payload(bffs,file_ptr->read_ptr+offset,in_fram,buffer);
+	return 0;
+}
+
+static bffs_st read_file_stream_locked(bffs_t* bffs, file_t* file_ptr, fram_addr_t data_length, fram_addr_t chunk_size,
+		bffs_stream_callback_t callback, void* ctx)
+{
+	/*Check for invalid inputs. There is no data pointer, the chunk buffers standing for it in check_read */
+	if (callback == NULL)
+	{
+		return READ_FILE_INVALID_DATA_PTR;
+	}
+	if ((chunk_size == 0) || (chunk_size > READ_STREAM_CHUNK_SIZE))
+	{
+		return READ_FILE_BAD_LENGTH;
+	}
+	uint8_t buffers[2][READ_STREAM_CHUNK_SIZE];
+	fram_addr_t unwritten;
+	bffs_st status = check_read(bffs,file_ptr,data_length,buffers,&unwritten);
+	if (status != READ_FILE_SUCCESS)
+	{
+		return status;
+	}
+	/*The asynchronous transfer state is shared with the asynchronous file operations */
+	if (bffs->async_busy)
+	{
+		return READ_FILE_BUSY;
+	}
+	/*Buffered appends are read from FRAM like the rest */
+	flush_append(bffs,file_ptr);
+	bffs->async_busy = 1;
+
+	uint8_t current = 0;
+	fram_addr_t offset = 0;
+	fram_addr_t length = (data_length < chunk_size) ? data_length : chunk_size;
+
+	status = READ_FILE_SUCCESS;
+	if (read_stream_chunk(bffs,file_ptr,0,length,data_length-unwritten,buffers[0]))
+	{
+		wait_stream_chunk(bffs);
+	}
+	while ((offset < data_length) && (status == READ_FILE_SUCCESS))
+	{
+		fram_addr_t next_offset = offset+length;
+		fram_addr_t next_length = (data_length-next_offset < chunk_size) ? data_length-next_offset : chunk_size;
+		uint8_t pending = 0;
+
+		if (bffs->stream_status != FRAM_OK)
+		{
+			status = READ_FILE_DRIVER_ERROR;
+			break;
+		}
+		/*Fetch the next chunk while the consumer has the current one */
+		if (next_length)
+		{
+			pending = read_stream_chunk(bffs,file_ptr,next_offset,next_length,data_length-unwritten,buffers[!current]);
+		}
+		callback(buffers[current],length,ctx);
+		if (pending)
+		{
+			wait_stream_chunk(bffs);
+		}
+		offset = next_offset;
+		length = next_length;
+		current = !current;
+	}
+	bffs->stream_status = FRAM_OK;
+	bffs->async_busy = 0;
+	return status;
+}
+
+bffs_st bffs_read_file_stream(bffs_t* bffs, file_t* file_ptr, fram_addr_t data_length, fram_addr_t chunk_size,
+		bffs_stream_callback_t callback, void* ctx)
+{
+	STATS_OP(BFFS_OP_READ_FILE_STREAM);
+	lock_file(bffs,file_ptr);
+	bffs_st status = read_file_stream_locked(bffs,file_ptr,data_length,chunk_size,callback,ctx);
+	unlock_file(bffs,file_ptr);
+	return status;
+}
+
+static bffs_st clear_file_locked(bffs_t* bffs, file_t* file_ptr)
+{
+	STATS_OP(BFFS_OP_CLEAR_FILE);
+	/*Check pointer validity`*/
+	if (file_ptr == NULL)
+	{
+		return CLEAR_FILE_INVALID_FILE_PTR;
+	}
+	settle_file(bffs,file_ptr);
+#if CLEAR_FILE_ZERO_DATA
+	/*Write 0s in all the FRAM bytes that are within a file's boundaries, in a single driver transaction */
+	fill_payload(bffs,file_ptr->start_ptr,file_ptr->end_ptr-file_ptr->start_ptr,0);
+#endif
+
+	/*Reset pointers, buffered appends being discarded with the rest of the data */
+	drop_read_ahead(bffs,file_ptr);
+	drop_append(bffs,file_ptr);
+	lock_commit(bffs);
+	file_ptr->read_ptr = file_ptr->start_ptr;
+	file_ptr->write_ptr = file_ptr->start_ptr;
+	file_ptr->wrap_count = 0;
+	mark_file_dirty(bffs,file_ptr,FILE_FIELD_READ_PTR|FILE_FIELD_WRITE_PTR|FILE_FIELD_WRAP_COUNT);
+
+	/*Commit the FS state to FRAM, since we have updated the file pointers */
+	commit_fs(bffs,0);
+	unlock_commit(bffs);
+
+	return CLEAR_FILE_SUCCESS;
+
+}
+
+bffs_st bffs_clear_file(bffs_t* bffs, file_t* file_ptr)
+{
+	lock_file(bffs,file_ptr);
+	bffs_st status = clear_file_locked(bffs,file_ptr);
+	unlock_file(bffs,file_ptr);
+	return status;
+}
+
+static bffs_st truncate_file_locked(bffs_t* bffs, file_t* file_ptr, fram_addr_t new_length)
+{
+	STATS_OP(BFFS_OP_TRUNCATE_FILE);
+	/*Check pointer validity*/
+	if (file_ptr == NULL)
+	{
+		return TRUNCATE_FILE_INVALID_FILE_PTR;
+	}
+	if (file_ptr->type == FILE_TYPE_RING)
+	{
+		return TRUNCATE_FILE_BAD_TYPE;
+	}
+	settle_file(bffs,file_ptr);
+	flush_append(bffs,file_ptr);
+	/*Truncating can only shrink the written part of a file, to whole records for record files*/
+	if ((new_length > file_ptr->write_ptr-file_ptr->start_ptr) ||
+			((file_ptr->type == FILE_TYPE_RECORD) && (new_length % file_ptr->record_size)))
+	{
+		return TRUNCATE_FILE_BAD_LENGTH;
+	}
+	/*Move the write pointer back, data past it now reads as unwritten */
+	drop_read_ahead(bffs,file_ptr);
+	lock_commit(bffs);
+	file_ptr->write_ptr = file_ptr->start_ptr+new_length;
+	if (file_ptr->read_ptr > file_ptr->write_ptr)
+	{
+		file_ptr->read_ptr = file_ptr->write_ptr;
+	}
+	mark_file_dirty(bffs,file_ptr,FILE_FIELD_READ_PTR|FILE_FIELD_WRITE_PTR);
+
+	/*Commit the FS state to FRAM, since we have updated the file pointers */
+	commit_fs(bffs,0);
+	unlock_commit(bffs);
+
+	return TRUNCATE_FILE_SUCCESS;
+}
+
+bffs_st bffs_truncate_file(bffs_t* bffs, file_t* file_ptr, fram_addr_t new_length)
+{
+	lock_file(bffs,file_ptr);
+	bffs_st status = truncate_file_locked(bffs,file_ptr,new_length);
+	unlock_file(bffs,file_ptr);
+	return status;
+}
+
+static bffs_st shrink_file_to_fit_locked(bffs_t* bffs, file_t* file_ptr)
+{
+	STATS_OP(BFFS_OP_SHRINK_FILE);
+	/*Check pointer validity*/
+	if (file_ptr == NULL)
+	{
+		return SHRINK_FILE_INVALID_FILE_PTR;
+	}
+	/*The write pointer of a ring file doesn't tell where its data ends*/
+	if (file_ptr->type == FILE_TYPE_RING)
+	{
+		return SHRINK_FILE_BAD_TYPE;
+	}
+	settle_file(bffs,file_ptr);
+	/*Buffered appends need the room they were checked against */
+	flush_append(bffs,file_ptr);
+	fram_addr_t unused = file_ptr->end_ptr-file_ptr->write_ptr;
+	if (!unused)
+	{
+		return SHRINK_FILE_SUCCESS;
+	}
+	/*Move the end pointer back and give the region past it to the allocator */
+	file_ptr->end_ptr = file_ptr->write_ptr;
+	if (file_ptr->read_ptr > file_ptr->end_ptr)
+	{
+		file_ptr->read_ptr = file_ptr->end_ptr;
+	}
+	mark_file_dirty(bffs,file_ptr,FILE_FIELD_READ_PTR|FILE_FIELD_END_PTR);
+	release_extent(bffs,file_ptr->end_ptr,unused);
+
+	/*Commit the FS state to FRAM, since we have updated the file pointers */
+	commit_fs(bffs,0);
+
+	return SHRINK_FILE_SUCCESS;
+}
+
+bffs_st bffs_shrink_file_to_fit(bffs_t* bffs, file_t* file_ptr)
+{
+	lock_table(bffs,TABLE_EXCLUSIVE);
+	bffs_st status = shrink_file_to_fit_locked(bffs,file_ptr);
+	unlock_table(bffs,TABLE_EXCLUSIVE);
+	return status;
+}
+
+static bffs_st compact_fs_step_locked(bffs_t* bffs, fram_addr_t max_bytes)
+{
+	STATS_OP(BFFS_OP_COMPACT_FS);
+	if (!max_bytes)
+	{
+		return COMPACT_FS_BAD_LENGTH;
+	}
+	/*Keep moving files down until the budget is spent, each chunk and finished move using some of it */
+	while (max_bytes)
+	{
+		if ((bffs->fs->move_slot == MAX_FILES) && !start_move(bffs))
+		{
+			return COMPACT_FS_DONE;
+		}
+		max_bytes -= move_chunk(bffs,max_bytes);
+	}
+	return ((bffs->fs->move_slot == MAX_FILES) && !bffs->fs->free_extent_count) ? COMPACT_FS_DONE : COMPACT_FS_IN_PROGRESS;
+}
+
+bffs_st bffs_compact_fs_step(bffs_t* bffs, fram_addr_t max_bytes)
+{
+	lock_table(bffs,TABLE_EXCLUSIVE);
+	bffs_st status = compact_fs_step_locked(bffs,max_bytes);
+	unlock_table(bffs,TABLE_EXCLUSIVE);
+	return status;
+}
+
+static bffs_st seek_file_locked(bffs_t* bffs, file_t* file_ptr, fram_addr_t byte)
+{
+	STATS_OP(BFFS_OP_SEEK_FILE);
+	/*CHeck ptr validity */
+	if (file_ptr == NULL)
+	{
+		return SEEK_FILE_INVALID_FILE_PTR;
+	}
+	/*Check if byte want to read at later is within the file boundaries*/
+	if (byte > file_ptr->end_ptr-file_ptr->start_ptr)
+	{
+		return SEEK_FILE_OVERFLOW;
+	}
+	/*Set read pointer as specified*/
+	lock_commit(bffs);
+	file_ptr->read_ptr = file_ptr->start_ptr+byte;
+	unlock_commit(bffs);
+	return SEEK_FILE_SUCCESS;
+}
+
+bffs_st bffs_seek_file(bffs_t* bffs, file_t* file_ptr, fram_addr_t byte)
+{
+	lock_file(bffs,file_ptr);
+	bffs_st status = seek_file_locked(bffs,file_ptr,byte);
+	unlock_file(bffs,file_ptr);
+	return status;
+}
+
+fram_addr_t bffs_tell_file(bffs_t* bffs, file_t* file_ptr)
+{
+	/*Simply return the read byte in relation to the start of the file */
+	lock_file(bffs,file_ptr);
+	fram_addr_t byte = file_ptr->read_ptr-file_ptr->start_ptr;
+	unlock_file(bffs,file_ptr);
+	return byte;
+}
+/*The functions below are very self explanatory and thus are not commented */
+
+fram_addr_t bffs_get_fs_free_bytes(bffs_t* bffs)
+{
+	fram_addr_t free_bytes = bffs->fs->end_ptr-bffs->fs->write_ptr;
+	if (bffs->fs->move_slot != MAX_FILES)
+	{
+		free_bytes += bffs->fs->files[bffs->fs->move_slot].start_ptr-bffs->fs->move_dst;
+	}
+	for (uint16_t idx = 0; idx<bffs->fs->free_extent_count; idx++)
+	{
+		free_bytes += bffs->fs->free_extents[idx].length;
+	}
+	return free_bytes;
+}
+fram_addr_t bffs_get_fs_size(bffs_t* bffs)
+{
+	return bffs->fs->end_ptr-bffs->fs->start_ptr;
+}
+uint16_t bffs_get_fs_free_file_slots(bffs_t* bffs)
+{
+	return MAX_FILES-bffs->fs->file_idx;
+}
+uint16_t bffs_get_fs_total_file_slots(bffs_t* bffs)
+{
+	(void)bffs;
+	return MAX_FILES;
+}
+uint16_t bffs_get_fs_total_files(bffs_t* bffs)
+{
+	return bffs->fs->file_idx;
+}
+uint16_t bffs_get_fs_free_extents(bffs_t* bffs)
+{
+	return bffs->fs->free_extent_count;
+}
+fram_addr_t bffs_get_fs_largest_free_extent(bffs_t* bffs)
+{
+	fram_addr_t largest = bffs->fs->end_ptr-bffs->fs->write_ptr;
+	for (uint16_t idx = 0; idx<bffs->fs->free_extent_count; idx++)
+	{
+		if (bffs->fs->free_extents[idx].length > largest)
+		{
+			largest = bffs->fs->free_extents[idx].length;
+		}
+	}
+	return largest;
+}
+uint16_t bffs_get_fs_pending_ops(bffs_t* bffs)
+{
+	return bffs->pending_ops;
+}
+uint16_t bffs_get_fs_pending_bytes(bffs_t* bffs)
+{
+	return bffs->pending_bytes;
 }
 
-uint16_t get_file_free_bytes(file_t* file_ptr)
+fram_addr_t bffs_get_file_free_bytes(bffs_t* bffs, file_t* file_ptr)
 {
-	return file_ptr->end_ptr-file_ptr->write_ptr;
+	return bffs_get_file_size(bffs,file_ptr)-bffs_get_file_used_bytes(bffs,file_ptr);
 }
-uint16_t get_file_used_bytes(file_t* file_ptr)
+fram_addr_t bffs_get_file_used_bytes(bffs_t* bffs, file_t* file_ptr)
 {
-	return file_ptr->write_ptr-file_ptr->start_ptr;
+	if ((file_ptr->type == FILE_TYPE_RING) && file_ptr->wrap_count)
+	{
+		return file_ptr->end_ptr-file_ptr->start_ptr;
+	}
+	return file_ptr->write_ptr+get_buffered(bffs,file_ptr)-file_ptr->start_ptr;
 }
-uint16_t get_file_size(file_t* file_ptr)
+fram_addr_t bffs_get_file_size(bffs_t* bffs, file_t* file_ptr)
 {
+	(void)bffs;
 	return file_ptr->end_ptr-file_ptr->start_ptr;
 }
+fram_addr_t bffs_get_file_records(bffs_t* bffs, file_t* file_ptr)
+{
+	if (file_ptr->type != FILE_TYPE_RECORD)
+	{
+		return 0;
+	}
+	return (file_ptr->write_ptr+get_buffered(bffs,file_ptr)-file_ptr->start_ptr)/file_ptr->record_size;
+}
+
+#if BFFS_STATS
+void bffs_get_volume_stats(bffs_t* bffs, bffs_stats_t* stats)
+{
+	*stats = bffs->stats;
+}
+void bffs_reset_volume_stats(bffs_t* bffs)
+{
+	memset(&bffs->stats,0,sizeof(bffs->stats));
+}
+#endif
+
+#if BFFS_DEFAULT_VOLUME
+/* Driver of the default volume: the functions of fram_driver.h, which have no context */
+static uint8_t default_get_bus(void* ctx, uint8_t device)
+{
+	(void)ctx;
+	return get_FRAM_bus(device);
+}
+static void default_write_v(void* ctx, uint8_t device, const fram_segment_t* segments, uint16_t segment_count)
+{
+	(void)ctx;
+	write_FRAM_v(device,segments,segment_count);
+}
+static void default_read_v(void* ctx, uint8_t device, const fram_segment_t* segments, uint16_t segment_count)
+{
+	(void)ctx;
+	read_FRAM_v(device,segments,segment_count);
+}
+static void default_fill(void* ctx, uint8_t device, fram_addr_t address, fram_addr_t data_length, uint8_t value)
+{
+	(void)ctx;
+	fill_FRAM(device,address,data_length,value);
+}
+static fram_st default_write_async(void* ctx, uint8_t device, fram_addr_t address, fram_addr_t data_length,
+		void* data_ptr, fram_callback_t callback, void* callback_ctx)
+{
+	(void)ctx;
+	return write_FRAM_async(device,address,data_length,data_ptr,callback,callback_ctx);
+}
+static fram_st default_read_async(void* ctx, uint8_t device, fram_addr_t address, fram_addr_t data_length,
+		void* data_ptr, fram_callback_t callback, void* callback_ctx)
+{
+	(void)ctx;
+	return read_FRAM_async(device,address,data_length,data_ptr,callback,callback_ctx);
+}
+/* All volumes on the fram_driver.h functions are on the same buses */
+static bffs_bus_locks_t default_bus_locks;
+static bffs_bus_locks_t* default_get_bus_locks(void* ctx)
+{
+	(void)ctx;
+	return &default_bus_locks;
+}
+
+static const bffs_driver_t default_driver = {default_get_bus,default_write_v,default_read_v,default_fill,
+		default_write_async,default_read_async,NULL,default_get_bus_locks};
+#endif
+
+static const bffs_geometry_t default_geometry = {0,FRAM_SIZE,FRAM_DEVICES};
+
+bffs_st bffs_init(bffs_t* bffs, file_system_t* fs, const bffs_driver_t* driver, void* driver_ctx,
+		const bffs_geometry_t* geometry)
+{
+	/*Check for invalid inputs */
+	if ((bffs == NULL) || (fs == NULL))
+	{
+		return INIT_FS_INVALID_PTR;
+	}
+#if BFFS_DEFAULT_VOLUME
+	if (driver == NULL)
+	{
+		driver = &default_driver;
+	}
+#endif
+	if ((driver == NULL) || (driver->write_v == NULL) || (driver->read_v == NULL) || (driver->fill == NULL))
+	{
+		return INIT_FS_BAD_DRIVER;
+	}
+	if (geometry == NULL)
+	{
+		geometry = &default_geometry;
+	}
+	/*The volume must fit the devices, the address type and the file system struct */
+	uint64_t volume_size = (uint64_t)geometry->size*geometry->devices;
+	if ((geometry->devices == 0) || (geometry->devices > FRAM_DEVICES) ||
+			((geometry->devices > 1) && (geometry->size % STRIPE_SIZE)) ||
+			((uint64_t)geometry->base+geometry->size-1 > FRAM_ADDR_MAX) ||
+			(volume_size-1 > FRAM_ADDR_MAX) || (volume_size <= FS_OFFSET))
+	{
+		return INIT_FS_BAD_GEOMETRY;
+	}
+
+	memset(bffs,0,sizeof(*bffs));
+	bffs->fs = fs;
+	bffs->driver = driver;
+	bffs->driver_ctx = driver_ctx;
+	bffs->geometry = *geometry;
+	bffs->volume_size = (fram_addr_t)volume_size;
+	bffs->commit_policy = FS_COMMIT_WRITE_THROUGH;
+	return INIT_FS_SUCCESS;
+}
 
+#if BFFS_DEFAULT_VOLUME
+/* Default volume, on BFFS and the whole of the FRAM devices, used by the functions without a volume handle */
+static bffs_t default_fs = {
+	.fs = &BFFS,
+	.driver = &default_driver,
+	.geometry = {0,FRAM_SIZE,FRAM_DEVICES},
+	.volume_size = VOLUME_SIZE,
+	.commit_policy = FS_COMMIT_WRITE_THROUGH,
+};
 
+bffs_t* get_default_volume(void)
+{
+	return &default_fs;
+}
+bffs_st save_fs()
+{
+	return bffs_save_fs(&default_fs);
+}
+bffs_st save_fs_changes()
+{
+	return bffs_save_fs_changes(&default_fs);
+}
+bffs_st sync_fs()
+{
+	return bffs_sync_fs(&default_fs);
+}
+bffs_st flush_fs_buffers()
+{
+	return bffs_flush_fs_buffers(&default_fs);
+}
+bffs_st set_fs_commit_policy(bffs_commit_policy policy, uint16_t max_ops, uint16_t max_bytes)
+{
+	return bffs_set_fs_commit_policy(&default_fs,policy,max_ops,max_bytes);
+}
+bffs_commit_policy get_fs_commit_policy(uint16_t* max_ops, uint16_t* max_bytes)
+{
+	return bffs_get_fs_commit_policy(&default_fs,max_ops,max_bytes);
+}
+#if BFFS_THREAD_SAFE
+bffs_st set_fs_lock_hooks(const bffs_lock_hooks_t* hooks)
+{
+	return bffs_set_fs_lock_hooks(&default_fs,hooks);
+}
+#endif
+bffs_st load_fs()
+{
+	return bffs_load_fs(&default_fs);
+}
+bffs_st reset_fs()
+{
+	return bffs_reset_fs(&default_fs);
+}
+bffs_st mount_fs()
+{
+	return bffs_mount_fs(&default_fs);
+}
+bffs_st create_file(char* filename, fram_addr_t file_size, file_t** file_ptr_ptr)
+{
+	return bffs_create_file(&default_fs,filename,file_size,file_ptr_ptr);
+}
+bffs_st create_ring_file(char* filename, fram_addr_t file_size, file_t** file_ptr_ptr)
+{
+	return bffs_create_ring_file(&default_fs,filename,file_size,file_ptr_ptr);
+}
+bffs_st create_record_file(char* filename, uint16_t record_size, fram_addr_t max_records, file_t** file_ptr_ptr)
+{
+	return bffs_create_record_file(&default_fs,filename,record_size,max_records,file_ptr_ptr);
+}
+bffs_st open_file(char* filename,file_t** file_ptr_ptr)
+{
+	return bffs_open_file(&default_fs,filename,file_ptr_ptr);
+}
+bffs_st delete_file(char* filename)
+{
+	return bffs_delete_file(&default_fs,filename);
+}
+uint16_t write_file(file_t* file_ptr, fram_addr_t data_length, void* data_ptr)
+{
+	return bffs_write_file(&default_fs,file_ptr,data_length,data_ptr);
+}
+bffs_st flush_file(file_t* file_ptr)
+{
+	return bffs_flush_file(&default_fs,file_ptr);
+}
+bffs_st read_file(file_t* file_ptr, fram_addr_t data_length, void* data_ptr, bffs_read_file_option option)
+{
+	return bffs_read_file(&default_fs,file_ptr,data_length,data_ptr,option);
+}
+bffs_st write_file_v(file_t* file_ptr, const bffs_iovec_t* iov, uint16_t iov_count)
+{
+	return bffs_write_file_v(&default_fs,file_ptr,iov,iov_count);
+}
+bffs_st read_file_v(file_t* file_ptr, const bffs_iovec_t* iov, uint16_t iov_count, bffs_read_file_option option)
+{
+	return bffs_read_file_v(&default_fs,file_ptr,iov,iov_count,option);
+}
+bffs_st read_ring_file(file_t* file_ptr, fram_addr_t data_length, void* data_ptr)
+{
+	return bffs_read_ring_file(&default_fs,file_ptr,data_length,data_ptr);
+}
+bffs_st append_records(file_t* file_ptr, fram_addr_t record_count, void* data_ptr)
+{
+	return bffs_append_records(&default_fs,file_ptr,record_count,data_ptr);
+}
+bffs_st read_record(file_t* file_ptr, fram_addr_t record_idx, void* data_ptr)
+{
+	return bffs_read_record(&default_fs,file_ptr,record_idx,data_ptr);
+}
+bffs_st read_records(file_t* file_ptr, fram_addr_t first_record, fram_addr_t record_count, void* data_ptr)
+{
+	return bffs_read_records(&default_fs,file_ptr,first_record,record_count,data_ptr);
+}
+bffs_st write_file_at(file_t* file_ptr, fram_addr_t offset, fram_addr_t data_length, void* data_ptr)
+{
+	return bffs_write_file_at(&default_fs,file_ptr,offset,data_length,data_ptr);
+}
+bffs_st read_file_at(file_t* file_ptr, fram_addr_t offset, fram_addr_t data_length, void* data_ptr)
+{
+	return bffs_read_file_at(&default_fs,file_ptr,offset,data_length,data_ptr);
+}
+bffs_st read_file_stream(file_t* file_ptr, fram_addr_t data_length, fram_addr_t chunk_size,
+		bffs_stream_callback_t callback, void* ctx)
+{
+	return bffs_read_file_stream(&default_fs,file_ptr,data_length,chunk_size,callback,ctx);
+}
+bffs_st write_file_async(file_t* file_ptr, fram_addr_t data_length, void* data_ptr, bffs_callback_t callback, void* ctx)
+{
+	return bffs_write_file_async(&default_fs,file_ptr,data_length,data_ptr,callback,ctx);
+}
+bffs_st read_file_async(file_t* file_ptr, fram_addr_t data_length, void* data_ptr, bffs_read_file_option option,
+		bffs_callback_t callback, void* ctx)
+{
+	return bffs_read_file_async(&default_fs,file_ptr,data_length,data_ptr,option,callback,ctx);
+}
+bffs_st clear_file(file_t* file_ptr)
+{
+	return bffs_clear_file(&default_fs,file_ptr);
+}
+bffs_st truncate_file(file_t* file_ptr, fram_addr_t new_length)
+{
+	return bffs_truncate_file(&default_fs,file_ptr,new_length);
+}
+bffs_st shrink_file_to_fit(file_t* file_ptr)
+{
+	return bffs_shrink_file_to_fit(&default_fs,file_ptr);
+}
+bffs_st compact_fs_step(fram_addr_t max_bytes)
+{
+	return bffs_compact_fs_step(&default_fs,max_bytes);
+}
+bffs_st seek_file(file_t* file_ptr, fram_addr_t byte)
+{
+	return bffs_seek_file(&default_fs,file_ptr,byte);
+}
+fram_addr_t tell_file(file_t* file_ptr)
+{
+	return bffs_tell_file(&default_fs,file_ptr);
+}
+fram_addr_t get_fs_free_bytes(void)
+{
+	return bffs_get_fs_free_bytes(&default_fs);
+}
+fram_addr_t get_fs_size(void)
+{
+	return bffs_get_fs_size(&default_fs);
+}
+uint16_t get_fs_free_file_slots(void)
+{
+	return bffs_get_fs_free_file_slots(&default_fs);
+}
+uint16_t get_fs_total_file_slots(void)
+{
+	return bffs_get_fs_total_file_slots(&default_fs);
+}
+uint16_t get_fs_total_files(void)
+{
+	return bffs_get_fs_total_files(&default_fs);
+}
+uint16_t get_fs_free_extents(void)
+{
+	return bffs_get_fs_free_extents(&default_fs);
+}
+fram_addr_t get_fs_largest_free_extent(void)
+{
+	return bffs_get_fs_largest_free_extent(&default_fs);
+}
+uint16_t get_fs_pending_ops(void)
+{
+	return bffs_get_fs_pending_ops(&default_fs);
+}
+uint16_t get_fs_pending_bytes(void)
+{
+	return bffs_get_fs_pending_bytes(&default_fs);
+}
+fram_addr_t get_file_free_bytes(file_t* file_ptr)
+{
+	return bffs_get_file_free_bytes(&default_fs,file_ptr);
+}
+fram_addr_t get_file_used_bytes(file_t* file_ptr)
+{
+	return bffs_get_file_used_bytes(&default_fs,file_ptr);
+}
+fram_addr_t get_file_size(file_t* file_ptr)
+{
+	return bffs_get_file_size(&default_fs,file_ptr);
+}
+fram_addr_t get_file_records(file_t* file_ptr)
+{
+	return bffs_get_file_records(&default_fs,file_ptr);
+}
 
+#if BFFS_STATS
+void bffs_get_stats(bffs_stats_t* stats)
+{
+	bffs_get_volume_stats(&default_fs,stats);
+}
+void bffs_reset_stats(void)
+{
+	bffs_reset_volume_stats(&default_fs);
+}
+#endif
+#endif
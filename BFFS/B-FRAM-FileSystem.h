@@ -10,18 +10,98 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <string.h>
 #include "fram_driver.h"
 
+#ifndef MAX_FILES
 #define MAX_FILES	20 //Max allowed files that can be stored in the file system
+#endif
+#ifndef MAX_FILENAME_SIZE
 #define MAX_FILENAME_SIZE 10
+#endif
+#ifndef FS_INDEX_SIZE
+#define FS_INDEX_SIZE 32 //Buckets of the in-RAM filename index, must be a power of 2 larger than MAX_FILES
+#endif
+#ifndef MAX_FREE_EXTENTS
+#define MAX_FREE_EXTENTS MAX_FILES //Free regions left by deleted files, each one is followed by a file so MAX_FILES is enough
+#endif
 
-#define FILE_STRCT_SIZE 8+(MAX_FILENAME_SIZE) //Size in bytes of a file struct
+#ifndef CLEAR_FILE_ZERO_DATA
+#define CLEAR_FILE_ZERO_DATA 0 //1: clear_file writes 0s over the whole file, 0: clear_file only resets the file pointers
+#endif
+#ifndef READ_UNWRITTEN_ERROR
+#define READ_UNWRITTEN_ERROR 0 //1: reading past a file's write pointer fails, 0: bytes past the write pointer read as 0
+#endif
+#ifndef SEGMENT_BATCH
+#define SEGMENT_BATCH 8 //Segments of data and metadata gathered on the stack for a single vectored driver write
+#endif
+#ifndef BFFS_STATS
+#define BFFS_STATS 1 //1: keep operation and bus traffic counters (see bffs_get_stats), 0: compile them out
+#endif
+#ifndef COMPACT_CHUNK_SIZE
+#define COMPACT_CHUNK_SIZE 32 //Bytes of file data moved per driver read and write by compact_fs_step, taken from the stack
+#endif
+#ifndef READ_STREAM_CHUNK_SIZE
+#define READ_STREAM_CHUNK_SIZE 64 //Largest chunk of read_file_stream, which takes two buffers of this size from the stack
+#endif
+#ifndef STRIPE_SIZE
+#define STRIPE_SIZE 256 //Bytes of the volume kept on one FRAM device before going on to the next one, with FRAM_DEVICES > 1
+#endif
+#ifndef BFFS_JOURNAL
+#define BFFS_JOURNAL 0 //1: metadata changes are appended to a journal replayed at mount, 0: they are written in place
+#endif
+#ifndef JOURNAL_SIZE
+#define JOURNAL_SIZE 512 //Bytes of FRAM after the file system struct taken by the journal, with BFFS_JOURNAL set
+#endif
+#ifndef BFFS_THREAD_SAFE
+#define BFFS_THREAD_SAFE 0 //1: calls take the application locks set with set_fs_lock_hooks, 0: calls must not overlap
+#endif
+#ifndef BFFS_READ_AHEAD
+#define BFFS_READ_AHEAD 0 //1: short read_file calls are served from a window of file data kept per file, 0: every read goes to FRAM
+#endif
+#ifndef READ_AHEAD_SIZE
+#define READ_AHEAD_SIZE 32 //Bytes of the read-ahead window of each file, taking MAX_FILES times this much RAM per volume
+#endif
+#ifndef BFFS_APPEND_BUFFER
+#define BFFS_APPEND_BUFFER 0 //1: short write_file calls are gathered per file in RAM and written together, 0: each one is written
+#endif
+#ifndef APPEND_BUFFER_SIZE
+#define APPEND_BUFFER_SIZE 64 //Bytes of the append buffer of each file, taking MAX_FILES times this much RAM per volume
+#endif
+#ifndef BFFS_DEFAULT_VOLUME
+#define BFFS_DEFAULT_VOLUME 1 //1: functions without a volume handle work on BFFS with the fram_driver.h functions, 0: only bffs_ functions
+#endif
 
-#define FS_STRCT_SIZE ((FILE_STRCT_SIZE)*(MAX_FILES))+8 //Size in bytes taken by one instance of BFFS
-#define FS_OFFSET FS_STRCT_SIZE //FRAM address where data starts being stored
+#if (FS_INDEX_SIZE & (FS_INDEX_SIZE-1)) || (FS_INDEX_SIZE <= MAX_FILES)
+#error "FS_INDEX_SIZE must be a power of 2 larger than MAX_FILES"
+#endif
+#if SEGMENT_BATCH < 2
+#error "SEGMENT_BATCH must fit the two segments of a write wrapping around a ring file"
+#endif
 
-#define USABLE_SIZE (FRAM_SIZE) - (FS_STRCT_SIZE) //Bytes of FRAM that can be used to store data
+#if ((FRAM_SIZE-1) >> (8*FRAM_ADDR_BYTES)) != 0
+#error "FRAM_ADDR_BYTES is too small to address FRAM_SIZE bytes"
+#endif
+#if (FRAM_DEVICES > 1) && ((FRAM_SIZE) % (STRIPE_SIZE))
+#error "FRAM_SIZE must be a multiple of STRIPE_SIZE for the stripes to fill every device"
+#endif
+
+#define BFFS_MAGIC 0x53464642 //Superblock magic, reads "BFFS" in FRAM on little endian microcontrollers
+#define BFFS_LAYOUT_VERSION 4 //Version of the FRAM layout of the file system struct, bumped whenever it changes
+
+#define FILE_STRCT_SIZE (sizeof(file_t)) //Size in bytes of a file struct, pointers being as wide as fram_addr_t
+
+#define FS_STRCT_SIZE (sizeof(file_system_t)) //Size in bytes taken by one instance of BFFS
+#if BFFS_JOURNAL
+#define JOURNAL_REGION_SIZE JOURNAL_SIZE
+#else
+#define JOURNAL_REGION_SIZE 0
+#endif
+#define FS_OFFSET ((FS_STRCT_SIZE)+(JOURNAL_REGION_SIZE)) //FRAM address where data starts being stored
+
+#define VOLUME_SIZE ((fram_addr_t)((FRAM_SIZE)*(FRAM_DEVICES))) //Bytes of the volume striped over all FRAM devices
+#define USABLE_SIZE ((VOLUME_SIZE) - (FS_OFFSET)) //Bytes of FRAM that can be used to store data
 
 
 /*Enumeration to define all possible mount options for the read_file function*/
@@ -32,7 +112,26 @@ typedef enum
 }
 	bffs_read_file_option;
 
-/*Enumeration to define all return statuses for the BFFS functions that don't return data*/
+/*Enumeration to define when metadata changes are written to FRAM*/
+typedef enum
+{
+	FS_COMMIT_WRITE_THROUGH, //metadata is saved by every operation that changes it
+	FS_COMMIT_EVERY_N,		 //metadata is saved once a number of operations or written bytes is pending
+	FS_COMMIT_ON_DEMAND,	 //metadata is only saved by sync_fs
+}
+	bffs_commit_policy;
+
+/*Enumeration to define how writes behave once a file's end pointer is reached*/
+typedef enum
+{
+	FILE_TYPE_REGULAR, //writes past the end pointer fail
+	FILE_TYPE_RING,	   //writes wrap around to the start pointer, overwriting the oldest data
+	FILE_TYPE_RECORD,  //an array of fixed size records, written and read whole
+}
+	bffs_file_type;
+
+/*Enumeration to define all return statuses for the BFFS functions that don't return data. Values are stored and logged
+ * by applications, so new statuses are only ever added at the end, never between existing ones*/
 typedef enum
 {
     CREATE_FILE_SUCCESS,
@@ -47,7 +146,7 @@ typedef enum
 	MOUNT_FS_FAILED, //this is only set if reset and load failed
 	RESET_FS_SUCCESS,
 	RESET_FS_NO_MEMORY,
-	LOAD_FS_INVALID_FS,
+	LOAD_FS_INVALID_FS, //no file system in FRAM
 	LOAD_FS_SUCCESS,
 	//
     WRITE_FILE_SUCCESS,
@@ -74,35 +173,336 @@ typedef enum
 	SEEK_FILE_OVERFLOW,
 	//
 	SAVE_FS_SUCCESS,
+	SYNC_FS_SUCCESS,
+	//
+	SET_COMMIT_POLICY_SUCCESS,
+	SET_COMMIT_POLICY_BAD_POLICY,
+	SET_COMMIT_POLICY_BAD_THRESHOLD,
+	//
+	READ_FILE_UNWRITTEN,
+	//
+	TRUNCATE_FILE_SUCCESS,
+	TRUNCATE_FILE_INVALID_FILE_PTR,
+	TRUNCATE_FILE_BAD_LENGTH,
+	//
+	WRITE_FILE_BUSY,
+	WRITE_FILE_DRIVER_ERROR,
+	//
+	READ_FILE_BUSY,
+	READ_FILE_DRIVER_ERROR,
+	READ_FILE_BAD_TYPE,
+	//
+	TRUNCATE_FILE_BAD_TYPE,
+	//
+	DELETE_FILE_SUCCESS,
+	DELETE_FILE_FILE_NOT_FOUND,
+	//
+	SHRINK_FILE_SUCCESS,
+	SHRINK_FILE_INVALID_FILE_PTR,
+	SHRINK_FILE_BAD_TYPE,
+	//
+	COMPACT_FS_DONE,
+	COMPACT_FS_IN_PROGRESS,
+	COMPACT_FS_BAD_LENGTH,
+	//
+	MOUNT_FS_CORRUPT, //a file system was found but is damaged, it is left untouched
+	MOUNT_FS_INCOMPATIBLE, //a file system from a build with other settings was found, it is left untouched
+	LOAD_FS_CORRUPT, //bad superblock checksum or inconsistent file system struct
+	LOAD_FS_INCOMPATIBLE, //layout version or geometry differ from this build
+	//
+	SET_LOCK_HOOKS_SUCCESS,
+	SET_LOCK_HOOKS_BAD_HOOKS,
+	SET_LOCK_HOOKS_ALREADY_SET,
+	SET_LOCK_HOOKS_NO_MEMORY,
+	//
+	INIT_FS_SUCCESS,
+	INIT_FS_INVALID_PTR,
+	INIT_FS_BAD_DRIVER,
+	INIT_FS_BAD_GEOMETRY,
+	//
+	WRITE_FILE_BAD_TYPE,
+	//
+	FLUSH_FILE_SUCCESS,
+	FLUSH_FILE_INVALID_FILE_PTR,
+	FLUSH_FS_BUFFERS_SUCCESS,
 } bffs_st;
 
 /*File: pointers refer to the fram address, not the the byte within a file. Start and end pointers define where in
- * FRAM the file data stars and ends, while the others define where data is being written and read
+ * FRAM the file data stars and ends, while the others define where data is being written and read. For ring files the
+ * write pointer is the head, and the tail (oldest byte) is the start pointer until the first wrap and the head after it
  */
 typedef struct file
 {
 
   char filename[MAX_FILENAME_SIZE];
-  uint16_t read_ptr;
-  uint16_t write_ptr;
-  uint16_t start_ptr;
-  uint16_t end_ptr;
+  fram_addr_t read_ptr;
+  fram_addr_t write_ptr;
+  fram_addr_t start_ptr;
+  fram_addr_t end_ptr;
+  uint16_t type;		//bffs_file_type
+  uint16_t wrap_count;	//times the write pointer of a ring file went back to the start pointer, saturating
+  uint16_t record_size;	//bytes of a record of a record file, 0 for other files
 } file_t;
 
+/*Free extent: region of FRAM between start_ptr and start_ptr+length left free by a deleted file*/
+typedef struct
+{
+  fram_addr_t start_ptr;
+  fram_addr_t length;
+} fs_extent_t;
+
+/*Superblock: identifies FRAM contents as a BFFS file system and records the build settings its layout depends on,
+ * so a foreign, corrupt or incompatible image is told apart before the file table is read. crc covers the other fields
+ */
+typedef struct
+{
+  uint32_t magic;				//BFFS_MAGIC
+  uint16_t version;				//BFFS_LAYOUT_VERSION
+  uint16_t max_files;			//MAX_FILES
+  uint16_t max_filename_size;	//MAX_FILENAME_SIZE
+  uint16_t addr_size;			//bytes of fram_addr_t
+  uint32_t volume_size;			//bytes of the volume, VOLUME_SIZE for the default one
+  uint16_t devices;				//devices of the volume
+  uint16_t stripe_size;			//STRIPE_SIZE with several devices, 0 otherwise
+  uint32_t strct_size;			//FS_STRCT_SIZE
+  uint32_t journal_size;		//JOURNAL_SIZE with BFFS_JOURNAL set, 0 otherwise
+  uint32_t crc;					//CRC-32 of the fields above
+} bffs_superblock_t;
+
 /*File System: pointers refer to the fram address, not the the byte within a file. Start and end pointers define where in
- * FRAM the file data can be stored, while write ptr defines where new created file's data is being stored in.
+ * FRAM the file data can be stored, while write ptr defines where new created file's data is being stored in when no
+ * free extent fits it. File slots with an empty filename are free, and file idx is the number of used ones. Free
+ * extents are sorted by address, never adjacent to each other and never end at the write ptr. While compaction moves a
+ * file down to move dst, move slot is its slot (MAX_FILES otherwise) and move done the bytes already copied. Journal
+ * epoch tells the journal records written since the last full save apart from older ones. A full save is not atomic,
+ * so with BFFS_JOURNAL set it also writes checkpoint crc, a CRC-32 of the struct before it: a full save cut short by a
+ * reset leaves a struct that fails it, instead of a mix of old and new fields the journal would be replayed onto.
  */
 typedef struct file_system
 {
+  bffs_superblock_t superblock;
   file_t files[MAX_FILES];
   uint16_t file_idx;
-  uint16_t write_ptr;
-  uint16_t end_ptr;
-  uint16_t start_ptr;
+  fram_addr_t write_ptr;
+  fram_addr_t end_ptr;
+  fram_addr_t start_ptr;
+  uint16_t move_slot;
+  fram_addr_t move_dst;
+  fram_addr_t move_done;
+  uint16_t free_extent_count;
+  fs_extent_t free_extents[MAX_FREE_EXTENTS];
+  uint32_t journal_epoch;
+  uint32_t checkpoint_crc;
 
 } file_system_t;
 
+#if BFFS_STATS
+/*Operations whose calls are counted in bffs_stats_t*/
+typedef enum
+{
+	BFFS_OP_MOUNT_FS,
+	BFFS_OP_LOAD_FS,
+	BFFS_OP_RESET_FS,
+	BFFS_OP_SYNC_FS,
+	BFFS_OP_CREATE_FILE,
+	BFFS_OP_CREATE_RING_FILE,
+	BFFS_OP_OPEN_FILE,
+	BFFS_OP_DELETE_FILE,
+	BFFS_OP_SHRINK_FILE,
+	BFFS_OP_COMPACT_FS,
+	BFFS_OP_WRITE_FILE,
+	BFFS_OP_READ_FILE,
+	BFFS_OP_WRITE_FILE_ASYNC,
+	BFFS_OP_READ_FILE_ASYNC,
+	BFFS_OP_WRITE_FILE_V,
+	BFFS_OP_READ_FILE_V,
+	BFFS_OP_READ_RING_FILE,
+	BFFS_OP_CLEAR_FILE,
+	BFFS_OP_TRUNCATE_FILE,
+	BFFS_OP_SEEK_FILE,
+	BFFS_OP_CREATE_RECORD_FILE,
+	BFFS_OP_APPEND_RECORDS,
+	BFFS_OP_READ_RECORDS,
+	BFFS_OP_WRITE_FILE_AT,
+	BFFS_OP_READ_FILE_AT,
+	BFFS_OP_READ_FILE_STREAM,
+	BFFS_OP_FLUSH_FILE,
+	BFFS_OP_COUNT,
+}
+	bffs_op;
+
+/*Counters kept since boot or the last bffs_reset_stats. Payload is file data, metadata is the file system struct*/
+typedef struct
+{
+	uint32_t op_calls[BFFS_OP_COUNT];	//calls of each operation, indexed by bffs_op
+	uint32_t payload_bytes_written;
+	uint32_t payload_bytes_read;
+	uint32_t metadata_bytes_written;
+	uint32_t metadata_bytes_read;
+	uint32_t driver_writes;				//write transactions requested from the FRAM driver
+	uint32_t driver_reads;				//read transactions requested from the FRAM driver
+	uint32_t save_fs_calls;				//full saves of the file system struct
+	uint32_t save_fs_changes_calls;		//saves of the changed file system struct fields only
+	uint32_t read_ahead_hits;			//read_file calls served from a read-ahead window, with BFFS_READ_AHEAD set
+	uint32_t read_ahead_misses;			//read_file calls that filled a read-ahead window from FRAM
+} bffs_stats_t;
+#endif
+
+/*Buffer of a vectored file operation*/
+typedef struct
+{
+	void* data_ptr;
+	fram_addr_t data_length;
+} bffs_iovec_t;
+
+/*Read-ahead window of a file: written bytes of the file from an offset of its start, empty if length is 0*/
+typedef struct
+{
+	fram_addr_t offset;
+	fram_addr_t length;
+	uint8_t data[READ_AHEAD_SIZE];
+} bffs_read_ahead_t;
+
+/*Append buffer of a file: bytes written to the file after its write pointer, not yet in FRAM*/
+typedef struct
+{
+	fram_addr_t length;
+	uint8_t data[APPEND_BUFFER_SIZE];
+} bffs_append_buffer_t;
+
+/*Called once an asynchronous file operation completes, with its final status*/
+typedef void (*bffs_callback_t)(bffs_st status, file_t* file_ptr, void* ctx);
+
+/*Called by read_file_stream with each chunk of file data, in order*/
+typedef void (*bffs_stream_callback_t)(const void* chunk_ptr, fram_addr_t chunk_length, void* ctx);
+
+#if BFFS_THREAD_SAFE
+/*Locking primitives supplied by the application (pthread rwlocks on a host, FreeRTOS semaphores on target...). Locks
+ * are taken either shared, by several tasks at a time, or exclusive, by a single one. Hooks of locks that can't be
+ * shared may ignore the shared argument, at the cost of serializing the calls that could have overlapped*/
+typedef struct
+{
+	void* (*create)(void);						//create a lock, returning NULL if it can't
+	void (*lock)(void* lock, uint8_t shared);	//block until the lock is taken, shared (1) or exclusive (0)
+	void (*unlock)(void* lock, uint8_t shared);	//release a lock taken with the same shared argument
+} bffs_lock_hooks_t;
+#endif
+
+/*Locks of the buses of a driver context, kept by the context for all the volumes on it and zeroed before the first of
+ * them gets its lock hooks. Set by BFFS only*/
+typedef struct
+{
+	void* (*create)(void);		//create hook the locks were made with, which the other volumes must use too
+	void* locks[FRAM_BUSES];
+} bffs_bus_locks_t;
+
+/*FRAM driver of a volume. Every operation takes the driver context given to bffs_init and the index of a device of the
+ * volume, addresses being within that device. get_bus may be NULL if all devices share one bus, and the async
+ * operations NULL if the driver has none (asynchronous file operations then fail with a driver error). wait_async is
+ * called over and over while a BFFS call waits for an asynchronous transfer to call back, to yield to other tasks or
+ * sleep until the transfer interrupt. It returns FRAM_ERROR to give up on transfers that timed out, once they are
+ * stopped and will never call back. If it is NULL BFFS spins, relying on the driver to always call back.
+ * get_bus_locks returns the bus locks of a context, so that volumes on the same buses (partitions of the same devices)
+ * serialize their driver calls. It may be NULL if each context drives a single volume, which then has bus locks of its
+ * own*/
+typedef struct
+{
+	uint8_t (*get_bus)(void* ctx, uint8_t device);	//bus of a device, below FRAM_BUSES
+	void (*write_v)(void* ctx, uint8_t device, const fram_segment_t* segments, uint16_t segment_count);
+	void (*read_v)(void* ctx, uint8_t device, const fram_segment_t* segments, uint16_t segment_count);
+	void (*fill)(void* ctx, uint8_t device, fram_addr_t address, fram_addr_t data_length, uint8_t value);
+	fram_st (*write_async)(void* ctx, uint8_t device, fram_addr_t address, fram_addr_t data_length, void* data_ptr,
+			fram_callback_t callback, void* callback_ctx);
+	fram_st (*read_async)(void* ctx, uint8_t device, fram_addr_t address, fram_addr_t data_length, void* data_ptr,
+			fram_callback_t callback, void* callback_ctx);
+	fram_st (*wait_async)(void* ctx);				//FRAM_OK to keep waiting, FRAM_ERROR to give up
+	bffs_bus_locks_t* (*get_bus_locks)(void* ctx);	//bus locks shared by the volumes on ctx
+} bffs_driver_t;
+
+/*Where a volume lives: size bytes from base on each of its devices, striped over them when there is more than one*/
+typedef struct
+{
+	fram_addr_t base;	//first byte of the volume on each device
+	fram_addr_t size;	//bytes of the volume on each device, a multiple of STRIPE_SIZE with several devices
+	uint8_t devices;	//devices of the volume, 1 to FRAM_DEVICES
+} bffs_geometry_t;
+
+#define JOURNAL_HEADER_SIZE 6 //Bytes of the header of a journal record
+
+/*Async transfer chain of one bus: the next piece it transfers is offset bytes into segment segment_idx*/
+typedef struct
+{
+	struct bffs_volume* bffs;
+	uint8_t bus;
+	uint16_t segment_idx;
+	fram_addr_t offset;
+} bffs_xfer_chain_t;
+
+/*Volume handle: a file system struct with the driver and geometry it is stored with, and the RAM state kept for it.
+ * Only fs, driver, driver_ctx and geometry are meant to be read by the application, the rest is set by bffs_init and
+ * private to BFFS*/
+typedef struct bffs_volume
+{
+	file_system_t* fs;
+	const bffs_driver_t* driver;
+	void* driver_ctx;
+	bffs_geometry_t geometry;
+	fram_addr_t volume_size;
+	//Fields of fs that changed in RAM but were not yet written to FRAM
+	uint8_t dirty_header;
+	uint8_t dirty_files[MAX_FILES];
+	//Commit policy state: how many metadata changing operations and file data bytes are not yet reflected in FRAM
+	bffs_commit_policy commit_policy;
+	uint16_t commit_max_ops;
+	uint16_t commit_max_bytes;
+	uint16_t pending_ops;
+	uint16_t pending_bytes;
+	//In-RAM filename index: open addressed hash table holding file slot+1 for each used slot, 0 meaning empty bucket
+	uint16_t index[FS_INDEX_SIZE];
+#if BFFS_STATS
+	bffs_stats_t stats;
+#endif
+#if BFFS_THREAD_SAFE
+	bffs_lock_hooks_t lock_hooks;
+	void* table_lock;
+	void* commit_lock;
+	void* file_locks[MAX_FILES];
+	void* bus_locks[FRAM_BUSES];
+#endif
+	//Asynchronous transfer in progress
+	const fram_segment_t* xfer_segments;
+	uint16_t xfer_segment_count;
+	uint8_t xfer_is_write;
+	fram_callback_t xfer_done;
+	bffs_xfer_chain_t xfer_chains[FRAM_BUSES];
+	unsigned xfer_buses; //buses still transferring, plus one while transfer_async is starting them
+	volatile fram_st xfer_status;
+#if BFFS_JOURNAL
+	fram_addr_t journal_used; //bytes of the journal taken by the records of the current epoch
+	uint8_t journal_headers[MAX_FILES+1][JOURNAL_HEADER_SIZE];
+	fram_segment_t journal_segments[2*(MAX_FILES+1)];
+#endif
+	//Asynchronous file operation in progress
+	volatile uint8_t async_busy;
+	file_t* async_file;
+	fram_addr_t async_length;
+	fram_segment_t async_segments[2];
+	uint16_t async_segment_count;
+	bffs_read_file_option async_option;
+	bffs_callback_t async_callback;
+	void* async_ctx;
+#if BFFS_READ_AHEAD
+	bffs_read_ahead_t read_ahead[MAX_FILES]; //indexed by file slot
+#endif
+#if BFFS_APPEND_BUFFER
+	bffs_append_buffer_t append_buffers[MAX_FILES]; //indexed by file slot
+#endif
+	//Chunk of read_file_stream being fetched by an asynchronous read
+	volatile uint8_t stream_pending;
+	volatile fram_st stream_status;
+} bffs_t;
 
+#if BFFS_DEFAULT_VOLUME
 bffs_st save_fs();
 /*******************************************************************
 * NAME :            save_fs
@@ -121,21 +521,167 @@ bffs_st save_fs();
 *       RETURN :
 *          	bffs_st status: Status of the operation
 * PROCESS :
-*          	[1]  Write FS struct in start of FRAM
+*          	[1]  With BFFS_JOURNAL set, move to a new journal epoch, invalidating the journal records
+*          	[2]  Write FS struct in start of FRAM (and, with BFFS_JOURNAL set, an empty record at the journal start)
+*
+*/
+bffs_st save_fs_changes();
+/*******************************************************************
+* NAME :            save_fs_changes
+*
+* DESCRIPTION :     Save only the file system struct fields that changed since the last save or load
+*
+* INPUTS :
+*       PARAMETERS:
+
+*       GLOBALS :
+*           file_system_t BFFS: File System Handle
+* OUTPUTS :
+*       PARAMETERS:
+*       GLOBALS :
+*       RETURN :
+*          	bffs_st status: Status of the operation
+* PROCESS :
+*          	[1]  For each file struct with changed fields, write the span of changed fields at its offset in FRAM
+*          	[2]  Write the span of changed FS header fields at its offset in FRAM
+*          	With BFFS_JOURNAL set, the spans are instead appended to the journal as a single batch of records, and
+*          	if the journal has no room left for them the whole FS struct is saved with save_fs (checkpoint)
+*
+*/
+bffs_st sync_fs();
+/*******************************************************************
+* NAME :            sync_fs
+*
+* DESCRIPTION :     Save all metadata changes left pending by the commit policy, and the data left in append
+* 					buffers with BFFS_APPEND_BUFFER set
+*
+* INPUTS :
+*       PARAMETERS:
+*       GLOBALS :
+*           file_system_t BFFS: File System Handle
+* OUTPUTS :
+*       PARAMETERS:
+*       GLOBALS :
+*       RETURN :
+*          	bffs_st status: Status of the operation
+* PROCESS :
+*          	[1]  Flush the append buffers of all files as flush_fs_buffers does
+*          	[2]  Save changed FS struct fields in FRAM
+*          	[3]  Reset pending operation and byte counts
+*
+*/
+bffs_st flush_fs_buffers();
+/*******************************************************************
+* NAME :            flush_fs_buffers
+*
+* DESCRIPTION :     Write out the append buffers of all files, as flush_file does. Meant to be called periodically
+* 					(from a timer task, not an interrupt) to bound how long appended data stays in RAM only.
+*
+* INPUTS :
+*       PARAMETERS:
+*       GLOBALS :
+*           file_system_t BFFS: File System Handle
+* OUTPUTS :
+*       PARAMETERS:
+*       GLOBALS :
+*       RETURN :
+*          	bffs_st status: Status of the operation
+* PROCESS :
+*          	[1]  Flush the append buffer of each file that has data in it, with the file locked
+*
+*/
+bffs_st set_fs_commit_policy(bffs_commit_policy policy, uint16_t max_ops, uint16_t max_bytes);
+/*******************************************************************
+* NAME :            set_fs_commit_policy
+*
+* DESCRIPTION :     Select when create_file, write_file and clear_file save their metadata changes in FRAM.
+* 					Can be called before mount_fs so the policy applies from mount time.
+*
+* INPUTS :
+*       PARAMETERS:
+*			bffs_commit_policy	policy: write through (default), every N or on demand
+*			uint16_t			max_ops: for every N, operations after which changes are saved (0 to ignore)
+*			uint16_t			max_bytes: for every N, written file bytes after which changes are saved (0 to ignore)
+*       GLOBALS :
+* OUTPUTS :
+*       PARAMETERS:
+*       GLOBALS :
+*           file_system_t BFFS: File System Handle
+*       RETURN :
+*          	bffs_st status: Status of the operation
+* PROCESS :
+*          	[1]  Check for invalid inputs
+*          	[2]  Save changes pending under the previous policy
+*          	[3]  Set policy and thresholds
 *
 */
+bffs_commit_policy get_fs_commit_policy(uint16_t* max_ops, uint16_t* max_bytes);
+/*******************************************************************
+* NAME :            get_fs_commit_policy
+*
+* DESCRIPTION :     Get the current commit policy and its thresholds
+*
+* INPUTS :
+*       PARAMETERS:
+*       GLOBALS :
+* OUTPUTS :
+*       PARAMETERS:
+*			uint16_t*			max_ops: if not NULL, set to the operation threshold
+*			uint16_t*			max_bytes: if not NULL, set to the byte threshold
+*       GLOBALS :
+*       RETURN :
+*          	bffs_commit_policy policy: Current commit policy
+* PROCESS :
+*          	[1]  Return policy and thresholds
+*
+*/
+#if BFFS_THREAD_SAFE
+bffs_st set_fs_lock_hooks(const bffs_lock_hooks_t* hooks);
+/*******************************************************************
+* NAME :            set_fs_lock_hooks
+*
+* DESCRIPTION :     Give BFFS the application locking primitives it guards its calls with, so they can be made from
+* 					several tasks. Must be called once, before mount_fs and before any task makes other BFFS calls.
+* 					The file table is under a reader-writer lock: calls on files take it shared plus the lock of
+* 					their file, so calls on different files overlap, while creating, deleting, shrinking, compacting,
+* 					mounting and full saves take it exclusive. Changes to file metadata and their commit are done
+* 					under a commit lock, and driver calls under a lock per SPI bus. The asynchronous functions and
+* 					the get_ functions take no lock. Hooks are kept per volume, and bus locks per driver context
+* 					(see get_bus_locks in bffs_driver_t), so volumes on other drivers or contexts never wait on
+* 					each other and may be set up from different tasks. Volumes sharing a driver context must be
+* 					given the same hooks.
+*
+* INPUTS :
+*       PARAMETERS:
+*			const bffs_lock_hooks_t*	hooks: create, lock and unlock functions, copied by BFFS
+*       GLOBALS :
+* OUTPUTS :
+*       PARAMETERS:
+*       GLOBALS :
+*       RETURN :
+*          	bffs_st status: Status of the operation
+* PROCESS :
+*          	[1]  Check the hooks are complete, weren't set before and match those of the driver context bus locks
+*          	[2]  Create the table lock, the commit lock and one lock per file slot
+*          	[3]  Take the bus locks of the driver context, creating those no volume on it created yet, or create
+*          	     bus locks of the volume's own if the driver has no get_bus_locks
+*
+*/
+#endif
 bffs_st load_fs();
 /*******************************************************************
 * NAME :            load_fs
 *
-* DESCRIPTION :     Load file system struct from the beginning of FRAM
+* DESCRIPTION :     Load file system struct from the beginning of FRAM, after checking its superblock
 *
 * INPUTS :
 *       PARAMETERS:
 
 *       GLOBALS :
 *           #define		  FS_STRCT_SIZE: Macro defining the size of the file system struct
-*           #define		  FRAM_SIZE: Total size of the FRAM in bytes
+*           #define		  BFFS_MAGIC: Magic number identifying a BFFS superblock
+*           #define		  BFFS_LAYOUT_VERSION: Version of the file system struct layout
+*           #define		  VOLUME_SIZE: Total size of the FRAM devices in bytes
 *           #define		  MAX_FILES: Maximum files that can be stored in the file system
 *
 * OUTPUTS :
@@ -145,7 +691,16 @@ bffs_st load_fs();
 *       RETURN :
 *          bffs_st 		  status: Status of the operation
 * PROCESS :
-*          [1] Load FS struct from start of FRAM
+*          [1] With BFFS_APPEND_BUFFER set, write the append buffers out first, as their appends were acknowledged
+*          [2] Load the superblock from start of FRAM
+*          [3] Fail with LOAD_FS_INVALID_FS if its magic is wrong, LOAD_FS_CORRUPT if its CRC is wrong and
+*              LOAD_FS_INCOMPATIBLE if its version or geometry differ from this build's. Without the magic, FRAM
+*              holding files in the layout from before the superblock also fails with LOAD_FS_INCOMPATIBLE
+*          [4] Load the rest of the FS struct
+*          [5] With BFFS_JOURNAL set, fail with LOAD_FS_CORRUPT if the checkpoint CRC is wrong (the last full save
+*              was cut short), then replay every complete batch of valid records of the current journal epoch
+*          [6] Validate the loaded FS struct, failing with LOAD_FS_CORRUPT
+*          [7] Rebuild the in-RAM filename index
 *
 */
 bffs_st reset_fs();
@@ -166,8 +721,9 @@ bffs_st reset_fs();
 *       RETURN :
 *          bffs_st 		 status: Status of the operation
 * PROCESS :
-*          [1] Reset file system: file idx; start pointer; end pointer; write pointer
-*          [2] Save FS struct in FRAM for loading at a future time
+*          [1] Fill the superblock with this build's layout version and geometry, and its CRC
+*          [2] Reset file system: file idx; start pointer; end pointer; write pointer
+*          [3] Save FS struct in FRAM for loading at a future time
 *
 */
 bffs_st mount_fs();
@@ -187,10 +743,12 @@ bffs_st mount_fs();
 *           bffs_st 			status: Status of the operation
 * PROCESS :
 *           [1] Attempt to load the FS
-*           [2] If failed, reset the FS to a clean state
+*           [2] If no FS was found, reset the FS to a clean state
+*           [3] If a corrupt or incompatible FS (including one from before the superblock) was found, return MOUNT_FS_CORRUPT or MOUNT_FS_INCOMPATIBLE
+*               without changing the FRAM, reset_fs having to be called explicitly to format it
 *
 */
-bffs_st create_file(char* filename, uint16_t file_size, file_t** file_ptr_ptr);
+bffs_st create_file(char* filename, fram_addr_t file_size, file_t** file_ptr_ptr);
 /*******************************************************************
 * NAME :           create_file
 *
@@ -199,7 +757,7 @@ bffs_st create_file(char* filename, uint16_t file_size, file_t** file_ptr_ptr);
 * INPUTS :
 *       PARAMETERS:
 *			char* 			filename: string by which the user can identify the file later
-*			uint16_t		file_size: number of bytes of file data to allocate to a given file
+*			fram_addr_t		file_size: number of bytes of file data to allocate to a given file
 *       GLOBALS :
 *       	#define			MAX_FILES: Maximum files that can be stored in the file system
 *       	#define			MAX_FILENAME_SIZE: Maximum number of chars that a filename can have
@@ -212,11 +770,66 @@ bffs_st create_file(char* filename, uint16_t file_size, file_t** file_ptr_ptr);
 *          bffs_st 			status: Status of the operation
 * PROCESS :
 *          [1] Check for invalid inputs given BFFS state
-*          [2] Set filename
-*          [3] Set file pointers
-*          [4] Assign file pointer that points to file within BFFS to input variable
-*          [5] Set BFSS pointers
-*          [6] Save FS struct in FRAM for loading at a future time
+*          [2] Take the smallest free extent the file fits in, or the space at the BFFS write pointer if none does
+*          [3] Set filename in a free file slot and add it to the filename index
+*          [4] Set file pointers
+*          [5] Assign file pointer that points to file within BFFS to input variable
+*          [6] Set BFSS pointers
+*          [7] Commit changed FS struct fields to FRAM according to the commit policy
+*
+*/
+bffs_st create_ring_file(char* filename, fram_addr_t file_size, file_t** file_ptr_ptr);
+/*******************************************************************
+* NAME :           create_ring_file
+*
+* DESCRIPTION :     same as create_file, but writes to the file wrap around to its start pointer instead of overflowing,
+* 					overwriting the oldest data. Its data is read back with read_ring_file.
+*
+* INPUTS :
+*       PARAMETERS:
+*			char* 			filename: string by which the user can identify the file later
+*			fram_addr_t		file_size: number of bytes of file data to allocate to a given file
+*       GLOBALS :
+*       	#define			MAX_FILES: Maximum files that can be stored in the file system
+*       	#define			MAX_FILENAME_SIZE: Maximum number of chars that a filename can have
+* OUTPUTS :
+*       PARAMETERS
+*       	file_t** 		file_ptr_ptr: pointer to the file pointer that will point to the file struct containing file fields
+*       GLOBALS :
+*           file_system_t 	BFFS: File System Handle
+*       RETURN :
+*          bffs_st 			status: Status of the operation
+* PROCESS :
+*          [1] Create the file as create_file does
+*          [2] Set file type to ring and wrap count to 0
+*
+*/
+bffs_st create_record_file(char* filename, uint16_t record_size, fram_addr_t max_records, file_t** file_ptr_ptr);
+/*******************************************************************
+* NAME :           create_record_file
+*
+* DESCRIPTION :     same as create_file, but the file is an array of records of record_size bytes, appended with
+* 					append_records and read by index with read_record and read_records.
+*
+* INPUTS :
+*       PARAMETERS:
+*			char* 			filename: string by which the user can identify the file later
+*			uint16_t		record_size: number of bytes of a record
+*			fram_addr_t		max_records: number of records to allocate file data for
+*       GLOBALS :
+*       	#define			MAX_FILES: Maximum files that can be stored in the file system
+*       	#define			MAX_FILENAME_SIZE: Maximum number of chars that a filename can have
+* OUTPUTS :
+*       PARAMETERS
+*       	file_t** 		file_ptr_ptr: pointer to the file pointer that will point to the file struct containing file fields
+*       GLOBALS :
+*           file_system_t 	BFFS: File System Handle
+*       RETURN :
+*          bffs_st 			status: Status of the operation
+* PROCESS :
+*          [1] Check record size and count are not 0 and their product fits fram_addr_t
+*          [2] Create the file as create_file does, with record_size*max_records bytes
+*          [3] Set file type to record and its record size
 *
 */
 bffs_st open_file(char* filename,file_t** file_ptr_ptr);
@@ -240,20 +853,50 @@ bffs_st open_file(char* filename,file_t** file_ptr_ptr);
 *          bffs_st status: Status of the operation
 * PROCESS :
 *          [1] Check for invalid inputs given BFFS state
-*          [2] Compare input string to filenames in the BFFS
+*          [2] Look up input string in the filename index
 *          [3] If a file with a matching file name is found, make the input pointer point to it.
 *
 */
-uint16_t write_file(file_t* file_ptr, uint16_t data_length, void* data_ptr);
+bffs_st delete_file(char* filename);
+/*******************************************************************
+* NAME :           delete_file
+*
+* DESCRIPTION :     remove a file, freeing its file slot and its FRAM space for later files. Pointers to the deleted
+* 					file must not be used anymore, since its slot can be given to another file.
+*
+* INPUTS :
+*       PARAMETERS:
+*			char* 			filename: name of the file to delete
+*       GLOBALS :
+*       	#define			MAX_FREE_EXTENTS: Maximum free regions tracked in the file system struct
+* OUTPUTS :
+*       PARAMETERS
+*       GLOBALS :
+*           file_system_t	BFFS: File System Handle
+*       RETURN :
+*          bffs_st status: Status of the operation
+* PROCESS :
+*          [1] Look up input string in the filename index
+*          [2] Add the file data region to the free extents, merging it with adjacent ones, or move the BFFS write
+*              pointer back if it ends there
+*          [3] Clear the file slot and rebuild the filename index
+*          [4] Commit changed FS struct fields to FRAM according to the commit policy
+*
+*/
+uint16_t write_file(file_t* file_ptr, fram_addr_t data_length, void* data_ptr);
 /*******************************************************************
 * NAME :           write_file
 *
-* DESCRIPTION :     copy a given amount of bytes to FRAM location pointed by file, from a given location
+* DESCRIPTION :     copy a given amount of bytes to FRAM location pointed by file, from a given location. With
+* 					BFFS_APPEND_BUFFER set, writes shorter than APPEND_BUFFER_SIZE to regular and record files are
+* 					copied to the append buffer of the file instead, which is written to FRAM with one metadata
+* 					update once full, or by flush_file, flush_fs_buffers or sync_fs. Until then the data is lost on a
+* 					reset, but reads of the file see it.
 *
 * INPUTS :
 *       PARAMETERS:
 *			file_t*			file_ptr: pointer to file struct from which write pointer is obtained
-*			uint16_t		data_length: amount of bytes to be written
+*			fram_addr_t		data_length: amount of bytes to be written
 *       GLOBALS :
 * OUTPUTS :
 *       PARAMETERS
@@ -263,21 +906,51 @@ uint16_t write_file(file_t* file_ptr, uint16_t data_length, void* data_ptr);
 *       RETURN :
 *          bffs_st 			status: Status of the operation
 * PROCESS :
-*          [1] Check for invalid inputs given BFFS state
-*          [2] Write data in the FRAM according to the file pointers in the file struct
-*          [3] Save FS struct in FRAM for loading at a future time
+*          [1] Check for invalid inputs given BFFS state, counting the data in the append buffer as written
+*          [2] Copy short writes to the append buffer, flushing it first if they don't fit and after if it is full
+*          [3] Otherwise flush the append buffer and move the write pointer past the data, wrapping it around (and
+*              counting the wrap) for ring files
+*          [4] Write data in the FRAM according to the file pointers in the file struct, in the same vectored
+*              driver call as the changed FS struct fields if the commit policy requires committing them
+*
+*/
+bffs_st flush_file(file_t* file_ptr);
+/*******************************************************************
+* NAME :           flush_file
+*
+* DESCRIPTION :     write the data in the append buffer of a file to FRAM, with BFFS_APPEND_BUFFER set. Does nothing
+* 					if the buffer is empty. Other calls that need the data in FRAM (vectored, asynchronous, streamed,
+* 					record and positional accesses, truncate_file, shrink_file_to_fit) flush the buffer of their file
+* 					first.
+*
+* INPUTS :
+*       PARAMETERS:
+*			file_t*			file_ptr: pointer to file struct
+*       GLOBALS :
+* OUTPUTS :
+*       PARAMETERS
+*       GLOBALS :
+*           file_system_t 	BFFS: File System Handle
+*       RETURN :
+*          bffs_st 			status: Status of the operation
+* PROCESS :
+*          [1] Empty the append buffer of the file
+*          [2] Write its data at the write pointer as write_file does, with one metadata update
 *
 */
-bffs_st read_file(file_t* file_ptr, uint16_t data_length, void* data_ptr, bffs_read_file_option option);
+bffs_st read_file(file_t* file_ptr, fram_addr_t data_length, void* data_ptr, bffs_read_file_option option);
 /*******************************************************************
 * NAME :            read_file
 *
-* DESCRIPTION :     copy a given amount of bytes to a given location, from a file
+* DESCRIPTION :     copy a given amount of bytes to a given location, from a file. Ring files are read with
+* 					read_ring_file instead. With BFFS_READ_AHEAD set, reads shorter than READ_AHEAD_SIZE are served
+* 					from a window of the file kept in RAM, filled with the READ_AHEAD_SIZE bytes from the read pointer
+* 					when the read is not within it
 *
 * INPUTS :
 *       PARAMETERS:
 *			file_t*					file_ptr: pointer to file struct from which read pointer is obtained
-*			uint16_t				data_length: amount of bytes to be read
+*			fram_addr_t				data_length: amount of bytes to be read
 *			bffs_read_file_option 	option: option to select whether to reset read pointer or not after read
 *       GLOBALS :
 * OUTPUTS :
@@ -289,15 +962,313 @@ bffs_st read_file(file_t* file_ptr, uint16_t data_length, void* data_ptr, bffs_r
 *          bffs_st 					status: Status of the operation
 * PROCESS :
 *          [1] Check for invalid inputs given BFFS state
-*          [2] Read data from the FRAM according to the file pointers in the file struct
-*          [3] Reset read pointer if such option is selected
+*          [2] Copy data from the read-ahead window of the file if it holds it, filling the window first if the
+*          	   read is short and only covers written bytes
+*          [3] Otherwise read data from the FRAM according to the file pointers in the file struct, take the bytes
+*          	   past the write pointer that are in the append buffer from it, and set the rest to 0 (or fail if
+*          	   READ_UNWRITTEN_ERROR is set)
+*          [4] Reset read pointer if such option is selected
+*
+*/
+bffs_st write_file_v(file_t* file_ptr, const bffs_iovec_t* iov, uint16_t iov_count);
+/*******************************************************************
+* NAME :           write_file_v
+*
+* DESCRIPTION :     copy several buffers one after the other to FRAM location pointed by file, as a single write
+*
+* INPUTS :
+*       PARAMETERS:
+*			file_t*				file_ptr: pointer to file struct from which write pointer is obtained
+*			const bffs_iovec_t*	iov: buffers to be written, in order
+*			uint16_t			iov_count: number of buffers in iov
+*       GLOBALS :
+*       	#define				SEGMENT_BATCH: Maximum buffers written in a single driver transaction
+* OUTPUTS :
+*       PARAMETERS
+*       GLOBALS :
+*           file_system_t 		BFFS: File System Handle
+*       RETURN :
+*          bffs_st 				status: Status of the operation
+* PROCESS :
+*          [1] Check for invalid inputs given BFFS state, once for the total length
+*          [2] Lay the buffers contiguously from the write pointer and move it past them
+*          [3] Write the buffers in the FRAM with vectored driver writes, the last one also carrying the changed FS
+*              struct fields if the commit policy requires committing them
+*
+*/
+bffs_st read_file_v(file_t* file_ptr, const bffs_iovec_t* iov, uint16_t iov_count, bffs_read_file_option option);
+/*******************************************************************
+* NAME :            read_file_v
+*
+* DESCRIPTION :     copy consecutive bytes from a file into several buffers, as a single read
+*
+* INPUTS :
+*       PARAMETERS:
+*			file_t*					file_ptr: pointer to file struct from which read pointer is obtained
+*			uint16_t				iov_count: number of buffers in iov
+*			bffs_read_file_option 	option: option to select whether to reset read pointer or not after read
+*       GLOBALS :
+*       	#define					SEGMENT_BATCH: Maximum buffers read in a single driver transaction
+* OUTPUTS :
+*       PARAMETERS
+*       	const bffs_iovec_t*		iov: buffers to which read data is written, in order
+*       GLOBALS :
+*           file_system_t 			BFFS: File System Handle
+*       RETURN :
+*          bffs_st 					status: Status of the operation
+* PROCESS :
+*          [1] Check for invalid inputs given BFFS state, once for the total length
+*          [2] Read data from the FRAM into the buffers with vectored driver reads
+*          [3] Set bytes past the write pointer to 0 (or fail if READ_UNWRITTEN_ERROR is set)
+*          [4] Reset read pointer if such option is selected
+*
+*/
+bffs_st read_ring_file(file_t* file_ptr, fram_addr_t data_length, void* data_ptr);
+/*******************************************************************
+* NAME :            read_ring_file
+*
+* DESCRIPTION :     copy the most recently written bytes of a ring file to a given location, oldest first.
+* 					The read pointer is not used.
+*
+* INPUTS :
+*       PARAMETERS:
+*			file_t*					file_ptr: pointer to a ring file struct from which write pointer is obtained
+*			fram_addr_t				data_length: amount of bytes to be read, not larger than the file's used bytes
+*       GLOBALS :
+* OUTPUTS :
+*       PARAMETERS
+*       	void*  					data_ptr: address of memory location to which read data is written
+*       GLOBALS :
+*           file_system_t 			BFFS: File System Handle
+*       RETURN :
+*          bffs_st 					status: Status of the operation
+* PROCESS :
+*          [1] Check for invalid inputs given BFFS state
+*          [2] Locate the data_length bytes before the write pointer, wrapping back from the end pointer if needed
+*          [3] Read them from the FRAM with a single vectored driver read
+*
+*/
+bffs_st append_records(file_t* file_ptr, fram_addr_t record_count, void* data_ptr);
+/*******************************************************************
+* NAME :            append_records
+*
+* DESCRIPTION :     append whole records to a record file, after its last one.
+*
+* INPUTS :
+*       PARAMETERS:
+*			file_t*					file_ptr: pointer to a record file struct
+*			fram_addr_t				record_count: number of records to append
+*			void*  					data_ptr: address of the records, record_count*record_size bytes
+*       GLOBALS :
+* OUTPUTS :
+*       PARAMETERS
+*       GLOBALS :
+*           file_system_t 			BFFS: File System Handle
+*       RETURN :
+*          bffs_st 					status: Status of the operation
+* PROCESS :
+*          [1] Check for invalid inputs given BFFS state, and that the file is a record file
+*          [2] Write the records as write_file does, in a single FRAM transfer and a single metadata update
+*
+*/
+bffs_st read_record(file_t* file_ptr, fram_addr_t record_idx, void* data_ptr);
+/*******************************************************************
+* NAME :            read_record
+*
+* DESCRIPTION :     copy one record of a record file to a given location. The read pointer is not used.
+*
+* INPUTS :
+*       PARAMETERS:
+*			file_t*					file_ptr: pointer to a record file struct
+*			fram_addr_t				record_idx: index of the record to read, 0 being the first appended
+*       GLOBALS :
+* OUTPUTS :
+*       PARAMETERS
+*       	void*  					data_ptr: address of memory location to which the record is written
+*       GLOBALS :
+*           file_system_t 			BFFS: File System Handle
+*       RETURN :
+*          bffs_st 					status: Status of the operation
+* PROCESS :
+*          [1] Read the record as read_records does with a record count of 1
+*
+*/
+bffs_st read_records(file_t* file_ptr, fram_addr_t first_record, fram_addr_t record_count, void* data_ptr);
+/*******************************************************************
+* NAME :            read_records
+*
+* DESCRIPTION :     copy consecutive records of a record file to a given location. The read pointer is not used.
+*
+* INPUTS :
+*       PARAMETERS:
+*			file_t*					file_ptr: pointer to a record file struct
+*			fram_addr_t				first_record: index of the first record to read, 0 being the first appended
+*			fram_addr_t				record_count: number of records to read
+*       GLOBALS :
+* OUTPUTS :
+*       PARAMETERS
+*       	void*  					data_ptr: address of memory location to which the records are written
+*       GLOBALS :
+*           file_system_t 			BFFS: File System Handle
+*       RETURN :
+*          bffs_st 					status: Status of the operation
+* PROCESS :
+*          [1] Check for invalid inputs given BFFS state, and that the records were appended
+*          [2] Read them from the FRAM at start_ptr+first_record*record_size in a single transfer
+*
+*/
+bffs_st write_file_at(file_t* file_ptr, fram_addr_t offset, fram_addr_t data_length, void* data_ptr);
+/*******************************************************************
+* NAME :            write_file_at
+*
+* DESCRIPTION :     overwrite bytes already written to a regular or record file, at a given offset from its start.
+* 					The file pointers are not used or moved and no metadata is written, so an update in place costs a
+* 					single data transfer.
+*
+* INPUTS :
+*       PARAMETERS:
+*			file_t*			file_ptr: pointer to a regular or record file struct
+*			fram_addr_t		offset: position of the first byte to overwrite, from the start of the file
+*			fram_addr_t		data_length: amount of bytes to be written
+*			void*  			data_ptr: pointer to the data that is to be written
+*       GLOBALS :
+*           file_system_t 	BFFS: File System Handle
+* OUTPUTS :
+*       PARAMETERS:
+*       GLOBALS :
+*       RETURN :
+*          bffs_st 			status: Status of the operation
+* PROCESS :
+*          [1] Check for invalid inputs, and that offset+data_length doesn't go past the write pointer
+*          [2] Write the data to the FRAM at start_ptr+offset
+*
+*/
+bffs_st read_file_at(file_t* file_ptr, fram_addr_t offset, fram_addr_t data_length, void* data_ptr);
+/*******************************************************************
+* NAME :            read_file_at
+*
+* DESCRIPTION :     copy bytes written to a regular or record file, from a given offset from its start, to a given
+* 					location. The read pointer is not used or moved.
+*
+* INPUTS :
+*       PARAMETERS:
+*			file_t*			file_ptr: pointer to a regular or record file struct
+*			fram_addr_t		offset: position of the first byte to read, from the start of the file
+*			fram_addr_t		data_length: amount of bytes to be read
+*       GLOBALS :
+* OUTPUTS :
+*       PARAMETERS
+*       	void*  			data_ptr: address of memory location to which the data is written
+*       GLOBALS :
+*           file_system_t 	BFFS: File System Handle
+*       RETURN :
+*          bffs_st 			status: Status of the operation
+* PROCESS :
+*          [1] Check for invalid inputs, and that offset+data_length doesn't go past the write pointer
+*          [2] Read the data from the FRAM at start_ptr+offset
+*
+*/
+bffs_st write_file_async(file_t* file_ptr, fram_addr_t data_length, void* data_ptr, bffs_callback_t callback, void* ctx);
+/*******************************************************************
+* NAME :           write_file_async
+*
+* DESCRIPTION :     start copying a given amount of bytes to FRAM location pointed by file and return without waiting.
+* 					The file pointers only move once the data is in FRAM, and callback is called once the metadata
+* 					is also committed according to the commit policy. Only one asynchronous operation can be in
+* 					progress, and no other BFFS call should be made until its callback is called.
+*
+* INPUTS :
+*       PARAMETERS:
+*			file_t*			file_ptr: pointer to file struct from which write pointer is obtained
+*			fram_addr_t		data_length: amount of bytes to be written
+*			void*  			data_ptr: pointer to the data that is to be written, must stay valid until callback
+*			bffs_callback_t	callback: function called with the final status once the operation completes
+*			void*			ctx: passed to callback
+*       GLOBALS :
+* OUTPUTS :
+*       PARAMETERS
+*       GLOBALS :
+*           file_system_t 	BFFS: File System Handle
+*       RETURN :
+*          bffs_st 			status: Status of the operation start (WRITE_FILE_SUCCESS if started)
+* PROCESS :
+*          [1] Check for invalid inputs given BFFS state
+*          [2] Start the asynchronous driver write of the data according to the file pointers in the file struct
+*          [3] On completion, move the write pointer and commit changed FS struct fields asynchronously
+*          [4] Call callback
+*
+*/
+bffs_st read_file_async(file_t* file_ptr, fram_addr_t data_length, void* data_ptr, bffs_read_file_option option,
+		bffs_callback_t callback, void* ctx);
+/*******************************************************************
+* NAME :            read_file_async
+*
+* DESCRIPTION :     start copying a given amount of bytes from a file to a given location and return without waiting.
+* 					Only one asynchronous operation can be in progress, and no other BFFS call should be made until
+* 					its callback is called.
+*
+* INPUTS :
+*       PARAMETERS:
+*			file_t*					file_ptr: pointer to file struct from which read pointer is obtained
+*			fram_addr_t				data_length: amount of bytes to be read
+*			bffs_read_file_option 	option: option to select whether to reset read pointer or not after read
+*			bffs_callback_t			callback: function called with the final status once the operation completes
+*			void*					ctx: passed to callback
+*       GLOBALS :
+* OUTPUTS :
+*       PARAMETERS
+*       	void*  					data_ptr: address to which read data is written, must stay valid until callback
+*       GLOBALS :
+*           file_system_t 			BFFS: File System Handle
+*       RETURN :
+*          bffs_st 					status: Status of the operation start (READ_FILE_SUCCESS if started)
+* PROCESS :
+*          [1] Check for invalid inputs given BFFS state
+*          [2] Set bytes past the write pointer to 0
+*          [3] Start the asynchronous driver read of the rest according to the file pointers in the file struct
+*          [4] On completion, reset read pointer if such option is selected and call callback
+*
+*/
+bffs_st read_file_stream(file_t* file_ptr, fram_addr_t data_length, fram_addr_t chunk_size,
+		bffs_stream_callback_t callback, void* ctx);
+/*******************************************************************
+* NAME :            read_file_stream
+*
+* DESCRIPTION :     hand a given amount of bytes of a file to a consumer in chunks, so forwarding or checksumming a
+* 					file only takes two chunks of RAM. With asynchronous driver reads, the next chunk is read while
+* 					the consumer handles the current one. Returns once every chunk was handed over. The read pointer
+* 					is not moved, and the consumer must not call BFFS functions on the same volume.
+*
+* INPUTS :
+*       PARAMETERS:
+*			file_t*					file_ptr: pointer to file struct from which read pointer is obtained
+*			fram_addr_t				data_length: amount of bytes to be read
+*			fram_addr_t				chunk_size: bytes handed to the consumer at a time (the last chunk may be
+*									shorter), up to READ_STREAM_CHUNK_SIZE
+*			bffs_stream_callback_t	callback: consumer called with each chunk, which is only valid during the call
+*			void*					ctx: passed to callback
+*       GLOBALS :
+* OUTPUTS :
+*       PARAMETERS
+*       GLOBALS :
+*           file_system_t 			BFFS: File System Handle
+*       RETURN :
+*          bffs_st 					status: Status of the operation
+* PROCESS :
+*          [1] Check for invalid inputs given BFFS state, as read_file does for the whole length
+*          [2] Read the first chunk into one of two stack buffers
+*          [3] Start reading the next chunk into the other buffer (asynchronously if the driver can), call the
+*          	   consumer with the current one, wait for the next one and swap the buffers, until all were handed over.
+*          	   The wait goes through the wait_async hook of the driver, failing with READ_FILE_DRIVER_ERROR if it
+*          	   gives up, and spins until the driver calls back if there is none
 *
 */
 bffs_st clear_file(file_t* file_ptr);
 /*******************************************************************
 * NAME :            clear_file
 *
-* DESCRIPTION :     write all 0's to FRAM in location
+* DESCRIPTION :     empty a file. Since unwritten bytes read as 0, only resetting the file pointers is needed,
+* 					unless CLEAR_FILE_ZERO_DATA is set to also write all 0's to the file location in FRAM
 *
 * INPUTS :
 *       PARAMETERS:
@@ -311,13 +1282,94 @@ bffs_st clear_file(file_t* file_ptr);
 *          bffs_st 			status: Status of the operation
 * PROCESS :
 *          [1] Check for invalid inputs given BFFS state
-*          [2] Write 0 data in the FRAM according to the file pointers in the file struct
-*          [3] Reset file pointers
-*          [4] Save FS struct in FRAM for loading at a future time
+*          [2] If CLEAR_FILE_ZERO_DATA is set, write 0 data in the FRAM according to the file pointers in the file struct
+*          [3] Reset file pointers and wrap count
+*          [4] Commit changed FS struct fields to FRAM according to the commit policy
+*
+*
+*/
+bffs_st truncate_file(file_t* file_ptr, fram_addr_t new_length);
+/*******************************************************************
+* NAME :            truncate_file
+*
+* DESCRIPTION :     discard the written bytes of a file past a given length, without touching the file data in FRAM.
+* 					Not available for ring files.
+*
+* INPUTS :
+*       PARAMETERS:
+*			file_t*			file_ptr: pointer to file struct whose write pointer is moved back
+*			fram_addr_t 		new_length: number of written bytes the file keeps, not larger than its used bytes
+*       GLOBALS :
+* OUTPUTS :
+*       PARAMETERS
+*       GLOBALS :
+*           file_system_t 	BFFS: File System Handle
+*       RETURN :
+*          bffs_st 			status: Status of the operation
+* PROCESS :
+*          [1] Check for invalid inputs given BFFS state
+*          [2] Set the write pointer new_length bytes after the start pointer
+*          [3] Move the read pointer back to the write pointer if it was past it
+*          [4] Commit changed FS struct fields to FRAM according to the commit policy
+*
+*/
+bffs_st shrink_file_to_fit(file_t* file_ptr);
+/*******************************************************************
+* NAME :            shrink_file_to_fit
+*
+* DESCRIPTION :     give the unwritten tail of a file back to the file system, so its size becomes its used bytes.
+* 					Not available for ring files.
+*
+* INPUTS :
+*       PARAMETERS:
+*			file_t*			file_ptr: pointer to file struct whose end pointer is moved back to its write pointer
+*       GLOBALS :
+* OUTPUTS :
+*       PARAMETERS
+*       GLOBALS :
+*           file_system_t 	BFFS: File System Handle
+*       RETURN :
+*          bffs_st 			status: Status of the operation
+* PROCESS :
+*          [1] Check for invalid inputs given BFFS state
+*          [2] Set the end pointer to the write pointer, and move the read pointer back to it if it was past it
+*          [3] Add the region past the new end pointer to the free extents
+*          [4] Commit changed FS struct fields to FRAM according to the commit policy
+*
+*/
+bffs_st compact_fs_step(fram_addr_t max_bytes);
+/*******************************************************************
+* NAME :            compact_fs_step
+*
+* DESCRIPTION :     move at most max_bytes of file data towards the start of the file system, sliding files down
+* 					over the free extents so the free space gathers after the last file. Meant to be called
+* 					repeatedly in idle time until it returns COMPACT_FS_DONE. The progress of the file being moved is
+*					saved with every chunk, so an interrupted compaction resumes on the next call after mount_fs.
+* 					Chunks are at most the smaller of COMPACT_CHUNK_SIZE and the gap the file slides into, and each
+* 					one is a driver write that also carries the move progress, so sliding a file of n bytes into a
+* 					gap of g bytes takes about n/min(g,COMPACT_CHUNK_SIZE) writes: filling a gap of a byte or two
+* 					in front of a large file costs a metadata write per byte or two moved.
 *
+* INPUTS :
+*       PARAMETERS:
+*			fram_addr_t 		max_bytes: budget of bytes to copy in this call, a finished file move counting as 1
+*       GLOBALS :
+*       	#define			COMPACT_CHUNK_SIZE: Maximum bytes copied per driver read and write
+* OUTPUTS :
+*       PARAMETERS
+*       GLOBALS :
+*           file_system_t 	BFFS: File System Handle
+*       RETURN :
+*          bffs_st 			status: COMPACT_FS_DONE if there are no free extents left, COMPACT_FS_IN_PROGRESS if not
+* PROCESS :
+*          [1] If no file is being moved, take the lowest free extent and start moving the file after it down into it
+*          [2] Copy the next chunk of the file, no larger than the gap so uncopied data is never overwritten, and save
+*              it together with the move progress
+*          [3] Once all file data is copied, move the file pointers down and free the region past the new end pointer
+*          [4] Repeat until the budget is spent or there are no free extents left
 *
 */
-bffs_st seek_file(file_t* file_ptr, uint16_t byte);
+bffs_st seek_file(file_t* file_ptr, fram_addr_t byte);
 /*******************************************************************
 * NAME :            seek_file
 *
@@ -326,7 +1378,7 @@ bffs_st seek_file(file_t* file_ptr, uint16_t byte);
 * INPUTS :
 *       PARAMETERS:
 *			file_t*			file_ptr: pointer to file struct from which start and end pointers are obtained
-*			uint16_t 		byte:	  byte within file that the read pointer must be changed to
+*			fram_addr_t 		byte:	  byte within file that the read pointer must be changed to
 *       GLOBALS :
 * OUTPUTS :
 *       PARAMETERS
@@ -339,7 +1391,7 @@ bffs_st seek_file(file_t* file_ptr, uint16_t byte);
 *          [2] Set file read pointer
 *
 */
-uint16_t tell_file(file_t* file_ptr);
+fram_addr_t tell_file(file_t* file_ptr);
 /*******************************************************************
 * NAME :            tell_file
 *
@@ -354,23 +1406,129 @@ uint16_t tell_file(file_t* file_ptr);
 *       GLOBALS :
 *           file_system_t 	BFFS: File System Handle
 *       RETURN :
-*          uint16_t 		byte: Byte within file that the write read pointer is currently at
+*          fram_addr_t 		byte: Byte within file that the write read pointer is currently at
 * PROCESS :
 *          [1] Return current read pointer in relation to the start of the file
 *
 */
 
 //From now on functions are pretty self explanatory and simple, so i didnt bother putting a header
-uint16_t get_fs_free_bytes(void);
-uint16_t get_fs_size(void);
+fram_addr_t get_fs_free_bytes(void);
+fram_addr_t get_fs_size(void);
 uint16_t get_fs_free_file_slots(void);
 uint16_t get_fs_total_file_slots(void);
 uint16_t get_fs_total_files(void);
-uint16_t get_file_free_bytes(file_t* file_ptr);
-uint16_t get_file_used_bytes(file_t* file_ptr);
-uint16_t get_file_size(file_t* file_ptr);
+uint16_t get_fs_free_extents(void);
+fram_addr_t get_fs_largest_free_extent(void);
+uint16_t get_fs_pending_ops(void);
+uint16_t get_fs_pending_bytes(void);
+fram_addr_t get_file_free_bytes(file_t* file_ptr);
+fram_addr_t get_file_used_bytes(file_t* file_ptr);
+fram_addr_t get_file_size(file_t* file_ptr);
+fram_addr_t get_file_records(file_t* file_ptr);
+
+#if BFFS_STATS
+void bffs_get_stats(bffs_stats_t* stats);
+void bffs_reset_stats(void);
+#endif
+bffs_t* get_default_volume(void); //handle of the volume the functions above work on, for layers taking a volume
 
 extern file_system_t BFFS;
+#endif
+
+bffs_st bffs_init(bffs_t* bffs, file_system_t* fs, const bffs_driver_t* driver, void* driver_ctx,
+		const bffs_geometry_t* geometry);
+/*******************************************************************
+* NAME :            bffs_init
+*
+* DESCRIPTION :     Set up a volume handle, so several file systems (on different devices, or partitions of the same
+* 					ones) can be used by one application. Must be called before any other function on the handle,
+* 					which is then mounted with bffs_mount_fs
+*
+* INPUTS :
+*       PARAMETERS:
+*			bffs_t*					bffs: volume handle to set up
+*			file_system_t*			fs: file system struct of the volume, kept by the application like BFFS
+*			const bffs_driver_t*	driver: FRAM driver of the volume (NULL: the fram_driver.h functions, with
+*									BFFS_DEFAULT_VOLUME set)
+*			void*					driver_ctx: context passed to every driver operation
+*			const bffs_geometry_t*	geometry: where the volume lives on its devices (NULL: the whole of the
+*									FRAM_DEVICES devices of FRAM_SIZE bytes)
+*       GLOBALS :
+* OUTPUTS :
+*       PARAMETERS:
+*			bffs_t*					bffs: volume handle ready to be mounted, with the default commit policy
+*       GLOBALS :
+*       RETURN :
+*          	bffs_st status: Status of the operation
+* PROCESS :
+*          	[1]  Check the driver has its synchronous operations and the geometry fits the devices, the address type
+*          	     and the file system struct
+*          	[2]  Clear the handle and set its file system struct, driver and geometry
+*
+*/
+
+/*Functions on a volume handle set up with bffs_init. Each one behaves as the function of the same name without the
+ * bffs_ prefix documented above, which is the same function on the default volume (BFFS, on the whole of the
+ * fram_driver.h devices). Files of a volume must only be passed to functions on that volume. Volumes don't share any
+ * state but the bus locks of their driver context, so calls on different volumes may overlap even without lock hooks,
+ * as long as their drivers allow it (and each volume is only used by one task at a time)*/
+bffs_st bffs_save_fs(bffs_t* bffs);
+bffs_st bffs_save_fs_changes(bffs_t* bffs);
+bffs_st bffs_sync_fs(bffs_t* bffs);
+bffs_st bffs_flush_fs_buffers(bffs_t* bffs);
+bffs_st bffs_set_fs_commit_policy(bffs_t* bffs, bffs_commit_policy policy, uint16_t max_ops, uint16_t max_bytes);
+bffs_commit_policy bffs_get_fs_commit_policy(bffs_t* bffs, uint16_t* max_ops, uint16_t* max_bytes);
+#if BFFS_THREAD_SAFE
+bffs_st bffs_set_fs_lock_hooks(bffs_t* bffs, const bffs_lock_hooks_t* hooks);
+#endif
+bffs_st bffs_load_fs(bffs_t* bffs);
+bffs_st bffs_reset_fs(bffs_t* bffs);
+bffs_st bffs_mount_fs(bffs_t* bffs);
+bffs_st bffs_create_file(bffs_t* bffs, char* filename, fram_addr_t file_size, file_t** file_ptr_ptr);
+bffs_st bffs_create_ring_file(bffs_t* bffs, char* filename, fram_addr_t file_size, file_t** file_ptr_ptr);
+bffs_st bffs_create_record_file(bffs_t* bffs, char* filename, uint16_t record_size, fram_addr_t max_records, file_t** file_ptr_ptr);
+bffs_st bffs_open_file(bffs_t* bffs, char* filename,file_t** file_ptr_ptr);
+bffs_st bffs_delete_file(bffs_t* bffs, char* filename);
+uint16_t bffs_write_file(bffs_t* bffs, file_t* file_ptr, fram_addr_t data_length, void* data_ptr);
+bffs_st bffs_flush_file(bffs_t* bffs, file_t* file_ptr);
+bffs_st bffs_read_file(bffs_t* bffs, file_t* file_ptr, fram_addr_t data_length, void* data_ptr, bffs_read_file_option option);
+bffs_st bffs_write_file_v(bffs_t* bffs, file_t* file_ptr, const bffs_iovec_t* iov, uint16_t iov_count);
+bffs_st bffs_read_file_v(bffs_t* bffs, file_t* file_ptr, const bffs_iovec_t* iov, uint16_t iov_count, bffs_read_file_option option);
+bffs_st bffs_read_ring_file(bffs_t* bffs, file_t* file_ptr, fram_addr_t data_length, void* data_ptr);
+bffs_st bffs_append_records(bffs_t* bffs, file_t* file_ptr, fram_addr_t record_count, void* data_ptr);
+bffs_st bffs_read_record(bffs_t* bffs, file_t* file_ptr, fram_addr_t record_idx, void* data_ptr);
+bffs_st bffs_read_records(bffs_t* bffs, file_t* file_ptr, fram_addr_t first_record, fram_addr_t record_count, void* data_ptr);
+bffs_st bffs_write_file_at(bffs_t* bffs, file_t* file_ptr, fram_addr_t offset, fram_addr_t data_length, void* data_ptr);
+bffs_st bffs_read_file_at(bffs_t* bffs, file_t* file_ptr, fram_addr_t offset, fram_addr_t data_length, void* data_ptr);
+bffs_st bffs_write_file_async(bffs_t* bffs, file_t* file_ptr, fram_addr_t data_length, void* data_ptr, bffs_callback_t callback, void* ctx);
+bffs_st bffs_read_file_async(bffs_t* bffs, file_t* file_ptr, fram_addr_t data_length, void* data_ptr, bffs_read_file_option option,
+		bffs_callback_t callback, void* ctx);
+bffs_st bffs_read_file_stream(bffs_t* bffs, file_t* file_ptr, fram_addr_t data_length, fram_addr_t chunk_size,
+		bffs_stream_callback_t callback, void* ctx);
+bffs_st bffs_clear_file(bffs_t* bffs, file_t* file_ptr);
+bffs_st bffs_truncate_file(bffs_t* bffs, file_t* file_ptr, fram_addr_t new_length);
+bffs_st bffs_shrink_file_to_fit(bffs_t* bffs, file_t* file_ptr);
+bffs_st bffs_compact_fs_step(bffs_t* bffs, fram_addr_t max_bytes);
+bffs_st bffs_seek_file(bffs_t* bffs, file_t* file_ptr, fram_addr_t byte);
+fram_addr_t bffs_tell_file(bffs_t* bffs, file_t* file_ptr);
+fram_addr_t bffs_get_fs_free_bytes(bffs_t* bffs);
+fram_addr_t bffs_get_fs_size(bffs_t* bffs);
+uint16_t bffs_get_fs_free_file_slots(bffs_t* bffs);
+uint16_t bffs_get_fs_total_file_slots(bffs_t* bffs);
+uint16_t bffs_get_fs_total_files(bffs_t* bffs);
+uint16_t bffs_get_fs_free_extents(bffs_t* bffs);
+fram_addr_t bffs_get_fs_largest_free_extent(bffs_t* bffs);
+uint16_t bffs_get_fs_pending_ops(bffs_t* bffs);
+uint16_t bffs_get_fs_pending_bytes(bffs_t* bffs);
+fram_addr_t bffs_get_file_free_bytes(bffs_t* bffs, file_t* file_ptr);
+fram_addr_t bffs_get_file_used_bytes(bffs_t* bffs, file_t* file_ptr);
+fram_addr_t bffs_get_file_size(bffs_t* bffs, file_t* file_ptr);
+fram_addr_t bffs_get_file_records(bffs_t* bffs, file_t* file_ptr);
+#if BFFS_STATS
+void bffs_get_volume_stats(bffs_t* bffs, bffs_stats_t* stats);
+void bffs_reset_volume_stats(bffs_t* bffs);
+#endif
 
 
 #endif /* INC_B_FRAM_FILESYSTEM_H_ */
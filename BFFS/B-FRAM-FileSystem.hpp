@@ -0,0 +1,302 @@
+/*
+ * B-FRAM-FileSystem.hpp
+ *
+ *  Created on: 17/10/2026
+ *      Author: hugobpontes
+ */
+
+#ifndef INC_B_FRAM_FILESYSTEM_HPP_
+#define INC_B_FRAM_FILESYSTEM_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <type_traits>
+
+extern "C" {
+#include "B-FRAM-FileSystem.h"
+}
+
+/*Header only C++ wrapper of BFFS volume handles (C++20). Each bffs::FileSystem is a volume with its own statically
+ * sized file system struct, whose geometry and FRAM layout are checked at compile time, and whose calls are inline
+ * forwards to the bffs_ functions. The file table (MaxFiles, NameLen) and address type (AddrT) are those the C source
+ * was built with, so they are checked against MAX_FILES, MAX_FILENAME_SIZE and fram_addr_t rather than chosen per
+ * volume. FramSize and Devices set the volume size and are free per volume*/
+
+namespace bffs
+{
+
+/*Smallest address type that reaches every byte of a size byte volume*/
+template <std::size_t Size>
+using addr_for = std::conditional_t<(Size-1 <= UINT16_MAX), std::uint16_t, std::uint32_t>;
+
+/*FRAM layout of a file system struct with MaxFiles files of NameLen character names and AddrT pointers, computed the
+ * way a C compiler lays out file_t and file_system_t (each field aligned to its size)*/
+template <std::size_t MaxFiles, std::size_t NameLen, typename AddrT>
+struct Layout
+{
+	static constexpr std::size_t align_up(std::size_t offset, std::size_t alignment)
+	{
+		return (offset+alignment-1)/alignment*alignment;
+	}
+
+	//file_t
+	static constexpr std::size_t file_read_ptr = align_up(NameLen,alignof(AddrT));
+	static constexpr std::size_t file_write_ptr = file_read_ptr+sizeof(AddrT);
+	static constexpr std::size_t file_start_ptr = file_write_ptr+sizeof(AddrT);
+	static constexpr std::size_t file_end_ptr = file_start_ptr+sizeof(AddrT);
+	static constexpr std::size_t file_type = file_end_ptr+sizeof(AddrT);
+	static constexpr std::size_t file_wrap_count = file_type+sizeof(std::uint16_t);
+	static constexpr std::size_t file_record_size = file_wrap_count+sizeof(std::uint16_t);
+	static constexpr std::size_t file_size = align_up(file_record_size+sizeof(std::uint16_t),alignof(AddrT));
+
+	//file_system_t, the superblock being first
+	static constexpr std::size_t fs_files = sizeof(bffs_superblock_t);
+	static constexpr std::size_t fs_file_idx = fs_files+MaxFiles*file_size;
+	static constexpr std::size_t fs_write_ptr = align_up(fs_file_idx+sizeof(std::uint16_t),alignof(AddrT));
+	static constexpr std::size_t fs_end_ptr = fs_write_ptr+sizeof(AddrT);
+	static constexpr std::size_t fs_start_ptr = fs_end_ptr+sizeof(AddrT);
+	static constexpr std::size_t fs_move_slot = fs_start_ptr+sizeof(AddrT);
+	static constexpr std::size_t fs_move_dst = align_up(fs_move_slot+sizeof(std::uint16_t),alignof(AddrT));
+	static constexpr std::size_t fs_move_done = fs_move_dst+sizeof(AddrT);
+	static constexpr std::size_t fs_free_extent_count = fs_move_done+sizeof(AddrT);
+	static constexpr std::size_t fs_free_extents = align_up(fs_free_extent_count+sizeof(std::uint16_t),alignof(AddrT));
+	static constexpr std::size_t fs_journal_epoch = align_up(fs_free_extents+MAX_FREE_EXTENTS*2*sizeof(AddrT),4);
+	static constexpr std::size_t fs_checkpoint_crc = fs_journal_epoch+sizeof(std::uint32_t);
+	static constexpr std::size_t fs_size = align_up(fs_checkpoint_crc+sizeof(std::uint32_t),4);
+
+	static constexpr std::size_t file_offset(std::size_t slot)
+	{
+		return fs_files+slot*file_size;
+	}
+	static constexpr std::size_t data_offset = fs_size+JOURNAL_REGION_SIZE; //FS_OFFSET
+};
+
+template <std::size_t FramSize, std::size_t MaxFiles = MAX_FILES, std::size_t NameLen = MAX_FILENAME_SIZE,
+		typename AddrT = fram_addr_t, std::uint8_t Devices = 1>
+class FileSystem
+{
+public:
+	using layout = Layout<MaxFiles,NameLen,AddrT>;
+	static constexpr std::size_t volume_size = FramSize*Devices;
+	static constexpr std::size_t usable_size = volume_size-layout::data_offset;
+
+	//The file table and address type are those of the C build
+	static_assert(MaxFiles == MAX_FILES, "MaxFiles must be the MAX_FILES BFFS is built with");
+	static_assert(NameLen == MAX_FILENAME_SIZE, "NameLen must be the MAX_FILENAME_SIZE BFFS is built with");
+	static_assert(std::is_same_v<AddrT,fram_addr_t>, "AddrT must be the fram_addr_t BFFS is built with (see FRAM_ADDR_BYTES)");
+	static_assert(sizeof(AddrT) >= sizeof(addr_for<volume_size>), "AddrT can't address every byte of the volume");
+
+	//On-media layout: the structs are written to FRAM as they are laid out in RAM
+	static_assert(std::is_standard_layout_v<file_t> && std::is_trivially_copyable_v<file_t>);
+	static_assert(std::is_standard_layout_v<file_system_t> && std::is_trivially_copyable_v<file_system_t>);
+	static_assert(sizeof(bffs_superblock_t) == 32, "superblock must stay 32 bytes");
+	static_assert(offsetof(file_t,read_ptr) == layout::file_read_ptr);
+	static_assert(offsetof(file_t,wrap_count) == layout::file_wrap_count);
+	static_assert(offsetof(file_t,record_size) == layout::file_record_size);
+	static_assert(sizeof(file_t) == layout::file_size && FILE_STRCT_SIZE == layout::file_size);
+	static_assert(offsetof(file_system_t,superblock) == 0);
+	static_assert(offsetof(file_system_t,files) == layout::fs_files);
+	static_assert(offsetof(file_system_t,file_idx) == layout::fs_file_idx);
+	static_assert(offsetof(file_system_t,move_slot) == layout::fs_move_slot);
+	static_assert(offsetof(file_system_t,free_extents) == layout::fs_free_extents);
+	static_assert(offsetof(file_system_t,journal_epoch) == layout::fs_journal_epoch);
+	static_assert(offsetof(file_system_t,checkpoint_crc) == layout::fs_checkpoint_crc, "checkpoint CRC must cover the whole struct");
+	static_assert(sizeof(file_system_t) == layout::fs_size && FS_STRCT_SIZE == layout::fs_size);
+	static_assert(FS_OFFSET == layout::data_offset);
+
+	//Geometry, as bffs_init checks it
+	static_assert((Devices >= 1) && (Devices <= FRAM_DEVICES), "Devices must be 1 to FRAM_DEVICES");
+	static_assert((Devices == 1) || (FramSize % STRIPE_SIZE == 0), "FramSize must be a multiple of STRIPE_SIZE when striped");
+	static_assert(volume_size > layout::data_offset, "volume too small for the file system struct");
+
+	/*Volume of FramSize bytes from base on each of Devices devices of a driver (nullptr: the fram_driver.h functions)*/
+	explicit FileSystem(AddrT base = 0, const bffs_driver_t* driver = nullptr, void* driver_ctx = nullptr)
+	{
+		const bffs_geometry_t geometry = {base,static_cast<fram_addr_t>(FramSize),Devices};
+		init_status_ = bffs_init(&handle_,&fs_,driver,driver_ctx,&geometry);
+	}
+	FileSystem(const FileSystem&) = delete;
+	FileSystem& operator=(const FileSystem&) = delete;
+
+	bffs_st init_status() const { return init_status_; }
+	bffs_t* handle() { return &handle_; }
+	const file_system_t& table() const { return fs_; }
+
+	bffs_st mount() { return bffs_mount_fs(&handle_); }
+	bffs_st load() { return bffs_load_fs(&handle_); }
+	bffs_st reset() { return bffs_reset_fs(&handle_); }
+	bffs_st save() { return bffs_save_fs(&handle_); }
+	bffs_st sync() { return bffs_sync_fs(&handle_); }
+	bffs_st flush_buffers() { return bffs_flush_fs_buffers(&handle_); }
+	bffs_st set_commit_policy(bffs_commit_policy policy, std::uint16_t max_ops = 0, std::uint16_t max_bytes = 0)
+	{
+		return bffs_set_fs_commit_policy(&handle_,policy,max_ops,max_bytes);
+	}
+#if BFFS_THREAD_SAFE
+	bffs_st set_lock_hooks(const bffs_lock_hooks_t& hooks) { return bffs_set_fs_lock_hooks(&handle_,&hooks); }
+#endif
+
+	bffs_st create(const char* filename, AddrT bytes, file_t*& file)
+	{
+		return bffs_create_file(&handle_,const_cast<char*>(filename),bytes,&file);
+	}
+	bffs_st create_ring(const char* filename, AddrT bytes, file_t*& file)
+	{
+		return bffs_create_ring_file(&handle_,const_cast<char*>(filename),bytes,&file);
+	}
+	/*Record file of up to max_records elements of type T*/
+	template <typename T>
+	bffs_st create_records(const char* filename, AddrT max_records, file_t*& file)
+	{
+		static_assert(std::is_trivially_copyable_v<T> && (sizeof(T) <= UINT16_MAX));
+		return bffs_create_record_file(&handle_,const_cast<char*>(filename),sizeof(T),max_records,&file);
+	}
+	bffs_st open(const char* filename, file_t*& file)
+	{
+		return bffs_open_file(&handle_,const_cast<char*>(filename),&file);
+	}
+	bffs_st remove(const char* filename) { return bffs_delete_file(&handle_,const_cast<char*>(filename)); }
+
+	/*File data is passed as spans of trivially copyable elements, written and read as their bytes*/
+	template <typename T, std::size_t N>
+	bffs_st write(file_t* file, std::span<const T,N> data)
+	{
+		static_assert(std::is_trivially_copyable_v<T>);
+		return static_cast<bffs_st>(bffs_write_file(&handle_,file,length_of(data),const_cast<T*>(data.data())));
+	}
+	template <typename T, std::size_t N>
+	bffs_st write(file_t* file, std::span<T,N> data)
+	{
+		return write(file,std::span<const T,N>(data));
+	}
+	bffs_st flush(file_t* file) { return bffs_flush_file(&handle_,file); }
+	template <typename T, std::size_t N>
+	bffs_st read(file_t* file, std::span<T,N> data, bffs_read_file_option option = READ_FILE_RESET_DONT_READ_PTR)
+	{
+		static_assert(std::is_trivially_copyable_v<T> && !std::is_const_v<T>);
+		return bffs_read_file(&handle_,file,length_of(data),data.data(),option);
+	}
+	template <typename T, std::size_t N>
+	bffs_st read_ring(file_t* file, std::span<T,N> data)
+	{
+		static_assert(std::is_trivially_copyable_v<T> && !std::is_const_v<T>);
+		return bffs_read_ring_file(&handle_,file,length_of(data),data.data());
+	}
+	/*Records are passed as spans of elements of the type the record file was created for*/
+	template <typename T, std::size_t N>
+	bffs_st append_records(file_t* file, std::span<const T,N> records)
+	{
+		static_assert(std::is_trivially_copyable_v<T>);
+		if ((file != nullptr) && (file->record_size != sizeof(T)))
+		{
+			return WRITE_FILE_BAD_LENGTH;
+		}
+		return bffs_append_records(&handle_,file,static_cast<AddrT>(records.size()),const_cast<T*>(records.data()));
+	}
+	template <typename T, std::size_t N>
+	bffs_st append_records(file_t* file, std::span<T,N> records)
+	{
+		return append_records(file,std::span<const T,N>(records));
+	}
+	template <typename T, std::size_t N>
+	bffs_st read_records(file_t* file, AddrT first_record, std::span<T,N> records)
+	{
+		static_assert(std::is_trivially_copyable_v<T> && !std::is_const_v<T>);
+		if ((file != nullptr) && (file->record_size != sizeof(T)))
+		{
+			return READ_FILE_BAD_LENGTH;
+		}
+		return bffs_read_records(&handle_,file,first_record,static_cast<AddrT>(records.size()),records.data());
+	}
+	template <typename T>
+	bffs_st read_record(file_t* file, AddrT record_idx, T& record)
+	{
+		return read_records(file,record_idx,std::span<T,1>(&record,1));
+	}
+	template <typename T, std::size_t N>
+	bffs_st write_at(file_t* file, AddrT offset, std::span<const T,N> data)
+	{
+		static_assert(std::is_trivially_copyable_v<T>);
+		return bffs_write_file_at(&handle_,file,offset,length_of(data),const_cast<T*>(data.data()));
+	}
+	template <typename T, std::size_t N>
+	bffs_st write_at(file_t* file, AddrT offset, std::span<T,N> data)
+	{
+		return write_at(file,offset,std::span<const T,N>(data));
+	}
+	template <typename T, std::size_t N>
+	bffs_st read_at(file_t* file, AddrT offset, std::span<T,N> data)
+	{
+		static_assert(std::is_trivially_copyable_v<T> && !std::is_const_v<T>);
+		return bffs_read_file_at(&handle_,file,offset,length_of(data),data.data());
+	}
+	/*Consumer called with a std::span<const std::uint8_t> of each chunk*/
+	template <typename F>
+	bffs_st read_stream(file_t* file, AddrT length, AddrT chunk_size, F&& consumer)
+	{
+		auto forward = [](const void* chunk, fram_addr_t chunk_length, void* ctx)
+		{
+			(*static_cast<std::remove_reference_t<F>*>(ctx))(
+					std::span<const std::uint8_t>(static_cast<const std::uint8_t*>(chunk),chunk_length));
+		};
+		return bffs_read_file_stream(&handle_,file,length,chunk_size,forward,
+				const_cast<void*>(static_cast<const void*>(&consumer)));
+	}
+	bffs_st write_v(file_t* file, std::span<const bffs_iovec_t> iov)
+	{
+		return bffs_write_file_v(&handle_,file,iov.data(),static_cast<std::uint16_t>(iov.size()));
+	}
+	bffs_st read_v(file_t* file, std::span<const bffs_iovec_t> iov, bffs_read_file_option option = READ_FILE_RESET_DONT_READ_PTR)
+	{
+		return bffs_read_file_v(&handle_,file,iov.data(),static_cast<std::uint16_t>(iov.size()),option);
+	}
+
+	bffs_st clear(file_t* file) { return bffs_clear_file(&handle_,file); }
+	bffs_st truncate(file_t* file, AddrT new_length) { return bffs_truncate_file(&handle_,file,new_length); }
+	bffs_st shrink_to_fit(file_t* file) { return bffs_shrink_file_to_fit(&handle_,file); }
+	bffs_st compact_step(AddrT max_bytes) { return bffs_compact_fs_step(&handle_,max_bytes); }
+	bffs_st seek(file_t* file, AddrT byte) { return bffs_seek_file(&handle_,file,byte); }
+	AddrT tell(file_t* file) { return bffs_tell_file(&handle_,file); }
+
+	AddrT free_bytes() { return bffs_get_fs_free_bytes(&handle_); }
+	AddrT size() { return bffs_get_fs_size(&handle_); }
+	AddrT largest_free_extent() { return bffs_get_fs_largest_free_extent(&handle_); }
+	std::uint16_t total_files() { return bffs_get_fs_total_files(&handle_); }
+	std::uint16_t free_file_slots() { return bffs_get_fs_free_file_slots(&handle_); }
+	static constexpr std::uint16_t total_file_slots() { return MaxFiles; }
+	AddrT file_used_bytes(file_t* file) { return bffs_get_file_used_bytes(&handle_,file); }
+	AddrT file_free_bytes(file_t* file) { return bffs_get_file_free_bytes(&handle_,file); }
+	AddrT file_size(file_t* file) { return bffs_get_file_size(&handle_,file); }
+	AddrT file_records(file_t* file) { return bffs_get_file_records(&handle_,file); }
+#if BFFS_STATS
+	bffs_stats_t stats() { bffs_stats_t counters; bffs_get_volume_stats(&handle_,&counters); return counters; }
+	void reset_stats() { bffs_reset_volume_stats(&handle_); }
+#endif
+
+private:
+	/*Spans of a static extent longer than the volume are rejected at compile time, others are left to BFFS, a span
+	 too long for AddrT being passed as 0 bytes so it fails with a bad length*/
+	template <typename T, std::size_t N>
+	static AddrT length_of(std::span<T,N> data)
+	{
+		if constexpr (N != std::dynamic_extent)
+		{
+			static_assert(N*sizeof(T) <= usable_size, "buffer larger than the volume");
+		}
+		if (data.size_bytes() > std::numeric_limits<AddrT>::max())
+		{
+			return 0;
+		}
+		return static_cast<AddrT>(data.size_bytes());
+	}
+
+	file_system_t fs_ {};
+	bffs_t handle_ {};
+	bffs_st init_status_;
+};
+
+} //namespace bffs
+
+#endif /* INC_B_FRAM_FILESYSTEM_HPP_ */
@@ -0,0 +1,300 @@
+#include <B-FRAM-KeyValue.h>
+
+/* States of a bucket, an empty one ending the probe sequence of the keys hashed before it */
+#define KV_BUCKET_EMPTY		0x00
+#define KV_BUCKET_USED		0x01
+#define KV_BUCKET_DELETED	0x02
+
+#define KV_MAX_BUCKET_SIZE KV_BUCKET_SIZE(KV_MAX_VALUE_SIZE)
+
+/* Volume a store is on, the default one if none is given */
+static bffs_t* get_volume(bffs_t* bffs)
+{
+#if BFFS_DEFAULT_VOLUME
+	if (bffs == NULL)
+	{
+		return get_default_volume();
+	}
+#endif
+	return bffs;
+}
+
+/* Copy a user key into a zero padded fixed width buffer. Returns 0 if it is empty or doesn't fit */
+static uint8_t get_key(const char* key, char* name)
+{
+	if ((key == NULL) || (*key == '\0'))
+	{
+		return 0;
+	}
+	memset(name,0,KV_KEY_SIZE);
+	for (uint16_t idx = 0; *(key+idx) != '\0'; idx++)
+	{
+		if (idx == KV_KEY_SIZE)
+		{
+			return 0;
+		}
+		name[idx] = *(key+idx);
+	}
+	return 1;
+}
+
+/* FNV-1a hash over the whole fixed width (zero padded) key, as for filenames */
+static fram_addr_t hash_key(const kv_store_t* kv, const char* name)
+{
+	uint32_t hash = 2166136261u;
+	for (uint16_t idx = 0; idx<KV_KEY_SIZE; idx++)
+	{
+		hash ^= (uint8_t)name[idx];
+		hash *= 16777619u;
+	}
+	return (fram_addr_t)((hash ^ (hash >> 16)) % kv->buckets);
+}
+
+/* Read the first read_length bytes of the buckets from the home bucket of a key on, until the bucket holding the key or
+ * an empty one. free_ptr gets the first bucket a new key could take (deleted or empty), kv->buckets if there is none.
+ * Returns KV_GET_SUCCESS with the bucket of the key in slot_ptr and its bytes in bucket, KV_GET_NOT_FOUND or
+ * KV_GET_FS_ERROR */
+static kv_st probe_key(kv_store_t* kv, const char* name, uint8_t* bucket, uint16_t read_length, fram_addr_t* slot_ptr,
+		fram_addr_t* free_ptr)
+{
+	fram_addr_t slot = hash_key(kv,name);
+
+	*free_ptr = kv->buckets;
+	for (fram_addr_t probes = 0; probes<kv->buckets; probes++)
+	{
+		bffs_st status = bffs_read_file_at(kv->bffs,kv->file,slot*kv->bucket_size,read_length,bucket);
+		if (status != READ_FILE_SUCCESS)
+		{
+			kv->fs_status = status;
+			return KV_GET_FS_ERROR;
+		}
+		if (bucket[KV_STATE_OFFSET] == KV_BUCKET_USED)
+		{
+			if (!memcmp(&bucket[KV_KEY_OFFSET],name,KV_KEY_SIZE))
+			{
+				*slot_ptr = slot;
+				return KV_GET_SUCCESS;
+			}
+		}
+		else if (*free_ptr == kv->buckets)
+		{
+			*free_ptr = slot;
+		}
+		/*No key probed past an empty bucket, so the key is not in the store */
+		if (bucket[KV_STATE_OFFSET] == KV_BUCKET_EMPTY)
+		{
+			return KV_GET_NOT_FOUND;
+		}
+		slot = (slot+1 == kv->buckets) ? 0 : slot+1;
+	}
+	return KV_GET_NOT_FOUND;
+}
+
+kv_st kv_open(kv_store_t* kv, bffs_t* bffs, char* filename)
+{
+	/*Check pointer validity */
+	if (kv == NULL)
+	{
+		return KV_OPEN_INVALID_PTR;
+	}
+	kv->bffs = get_volume(bffs);
+	if (kv->bffs == NULL)
+	{
+		return KV_OPEN_INVALID_PTR;
+	}
+	bffs_st status = bffs_open_file(kv->bffs,filename,&kv->file);
+	if (status != OPEN_FILE_SUCCESS)
+	{
+		kv->fs_status = status;
+		return KV_OPEN_FS_ERROR;
+	}
+	/*Check the file holds buckets this build can read */
+	if ((kv->file->type != FILE_TYPE_RECORD) || (kv->file->record_size <= KV_VALUE_OFFSET) ||
+			(kv->file->record_size > KV_MAX_BUCKET_SIZE))
+	{
+		return KV_OPEN_NOT_A_STORE;
+	}
+	kv->bucket_size = kv->file->record_size;
+	kv->value_size = kv->bucket_size-KV_VALUE_OFFSET;
+	kv->buckets = bffs_get_file_size(kv->bffs,kv->file)/kv->bucket_size;
+
+	/*Buckets not appended yet (all of them for a new store, some if its creation was cut short) are written empty,
+	 *the same zeroed bucket being laid out several times by each vectored write */
+	uint8_t empty[KV_MAX_BUCKET_SIZE] = {0};
+	bffs_iovec_t iov[SEGMENT_BATCH];
+	for (uint16_t idx = 0; idx<SEGMENT_BATCH; idx++)
+	{
+		iov[idx].data_ptr = empty;
+		iov[idx].data_length = kv->bucket_size;
+	}
+	fram_addr_t appended = bffs_get_file_records(kv->bffs,kv->file);
+	while (appended < kv->buckets)
+	{
+		uint16_t count = (kv->buckets-appended > SEGMENT_BATCH) ? SEGMENT_BATCH : kv->buckets-appended;
+		status = bffs_write_file_v(kv->bffs,kv->file,iov,count);
+		if (status != WRITE_FILE_SUCCESS)
+		{
+			kv->fs_status = status;
+			return KV_OPEN_FS_ERROR;
+		}
+		appended += count;
+	}
+	return KV_OPEN_SUCCESS;
+}
+
+kv_st kv_create(kv_store_t* kv, bffs_t* bffs, char* filename, fram_addr_t buckets, uint8_t value_size)
+{
+	/*Check for invalid inputs */
+	if (kv == NULL)
+	{
+		return KV_OPEN_INVALID_PTR;
+	}
+	if ((!buckets) || (!value_size) || (value_size > KV_MAX_VALUE_SIZE))
+	{
+		return KV_OPEN_BAD_SIZE;
+	}
+	bffs = get_volume(bffs);
+	if (bffs == NULL)
+	{
+		return KV_OPEN_INVALID_PTR;
+	}
+	file_t* file_ptr;
+	bffs_st status = bffs_create_record_file(bffs,filename,KV_BUCKET_SIZE(value_size),buckets,&file_ptr);
+	if (status != CREATE_FILE_SUCCESS)
+	{
+		kv->fs_status = status;
+		return KV_OPEN_FS_ERROR;
+	}
+	return kv_open(kv,bffs,filename);
+}
+
+kv_st kv_get(kv_store_t* kv, const char* key, void* value_ptr, uint8_t* value_length_ptr)
+{
+	char name[KV_KEY_SIZE];
+
+	/*Check for invalid inputs */
+	if ((kv == NULL) || (value_ptr == NULL))
+	{
+		return KV_GET_INVALID_PTR;
+	}
+	if (!get_key(key,name))
+	{
+		return KV_GET_BAD_KEY;
+	}
+	/*Whole buckets are read, so a key in its home bucket takes a single read */
+	uint8_t bucket[KV_MAX_BUCKET_SIZE];
+	fram_addr_t slot;
+	fram_addr_t free_slot;
+	kv_st status = probe_key(kv,name,bucket,kv->bucket_size,&slot,&free_slot);
+	if (status != KV_GET_SUCCESS)
+	{
+		return status;
+	}
+	uint8_t value_length = bucket[KV_LENGTH_OFFSET];
+	if (value_length > kv->value_size)
+	{
+		value_length = kv->value_size;
+	}
+	memcpy(value_ptr,&bucket[KV_VALUE_OFFSET],value_length);
+	if (value_length_ptr != NULL)
+	{
+		*value_length_ptr = value_length;
+	}
+	return KV_GET_SUCCESS;
+}
+
+kv_st kv_put(kv_store_t* kv, const char* key, uint8_t value_length, const void* value_ptr)
+{
+	char name[KV_KEY_SIZE];
+
+	/*Check for invalid inputs */
+	if ((kv == NULL) || (value_ptr == NULL))
+	{
+		return KV_PUT_INVALID_PTR;
+	}
+	if (!get_key(key,name))
+	{
+		return KV_PUT_BAD_KEY;
+	}
+	if ((!value_length) || (value_length > kv->value_size))
+	{
+		return KV_PUT_BAD_LENGTH;
+	}
+	/*Only the state and key of the probed buckets are read */
+	uint8_t bucket[KV_MAX_BUCKET_SIZE];
+	fram_addr_t slot;
+	fram_addr_t free_slot;
+	kv_st status = probe_key(kv,name,bucket,KV_LENGTH_OFFSET,&slot,&free_slot);
+	if (status == KV_GET_FS_ERROR)
+	{
+		return KV_PUT_FS_ERROR;
+	}
+	bffs_st fs_status;
+	bucket[KV_LENGTH_OFFSET] = value_length;
+	memcpy(&bucket[KV_VALUE_OFFSET],value_ptr,value_length);
+	if (status == KV_GET_SUCCESS)
+	{
+		/*Update the value in place, the key and state staying as they are */
+		fs_status = bffs_write_file_at(kv->bffs,kv->file,slot*kv->bucket_size+KV_LENGTH_OFFSET,1+value_length,
+				&bucket[KV_LENGTH_OFFSET]);
+	}
+	else
+	{
+		if (free_slot == kv->buckets)
+		{
+			return KV_PUT_FULL;
+		}
+		/*Fill the free bucket first and mark it as used last, so a reset in between leaves it free */
+		memcpy(&bucket[KV_KEY_OFFSET],name,KV_KEY_SIZE);
+		fs_status = bffs_write_file_at(kv->bffs,kv->file,free_slot*kv->bucket_size+KV_KEY_OFFSET,
+				KV_VALUE_OFFSET-KV_KEY_OFFSET+value_length,&bucket[KV_KEY_OFFSET]);
+		if (fs_status == WRITE_FILE_SUCCESS)
+		{
+			bucket[KV_STATE_OFFSET] = KV_BUCKET_USED;
+			fs_status = bffs_write_file_at(kv->bffs,kv->file,free_slot*kv->bucket_size+KV_STATE_OFFSET,1,
+					&bucket[KV_STATE_OFFSET]);
+		}
+	}
+	if (fs_status != WRITE_FILE_SUCCESS)
+	{
+		kv->fs_status = fs_status;
+		return KV_PUT_FS_ERROR;
+	}
+	return KV_PUT_SUCCESS;
+}
+
+kv_st kv_delete(kv_store_t* kv, const char* key)
+{
+	char name[KV_KEY_SIZE];
+
+	/*Check for invalid inputs */
+	if (kv == NULL)
+	{
+		return KV_DELETE_INVALID_PTR;
+	}
+	if (!get_key(key,name))
+	{
+		return KV_DELETE_BAD_KEY;
+	}
+	uint8_t bucket[KV_LENGTH_OFFSET];
+	fram_addr_t slot;
+	fram_addr_t free_slot;
+	kv_st status = probe_key(kv,name,bucket,KV_LENGTH_OFFSET,&slot,&free_slot);
+	if (status == KV_GET_FS_ERROR)
+	{
+		return KV_DELETE_FS_ERROR;
+	}
+	if (status == KV_GET_NOT_FOUND)
+	{
+		return KV_DELETE_NOT_FOUND;
+	}
+	/*A single byte write, so a reset leaves the key either there or deleted */
+	bucket[KV_STATE_OFFSET] = KV_BUCKET_DELETED;
+	bffs_st fs_status = bffs_write_file_at(kv->bffs,kv->file,slot*kv->bucket_size+KV_STATE_OFFSET,1,bucket);
+	if (fs_status != WRITE_FILE_SUCCESS)
+	{
+		kv->fs_status = fs_status;
+		return KV_DELETE_FS_ERROR;
+	}
+	return KV_DELETE_SUCCESS;
+}
@@ -0,0 +1,193 @@
+/*
+ * B-FRAM-KeyValue.h
+ *
+ *  Created on: 17/10/2026
+ *      Author: hugobpontes
+ */
+
+#ifndef INC_B_FRAM_KEYVALUE_H_
+#define INC_B_FRAM_KEYVALUE_H_
+
+#include "B-FRAM-FileSystem.h"
+
+#define KV_KEY_SIZE 12 //Max size of a key, stored zero padded like filenames
+#define KV_MAX_VALUE_SIZE 32 //Largest value a store can be created for, a bucket of this size is read on the stack
+
+/*Layout of a bucket in FRAM: a state byte, the key, the length of the value and room for value_size bytes of value*/
+#define KV_STATE_OFFSET 0
+#define KV_KEY_OFFSET 1
+#define KV_LENGTH_OFFSET (KV_KEY_OFFSET+KV_KEY_SIZE)
+#define KV_VALUE_OFFSET (KV_LENGTH_OFFSET+1)
+#define KV_BUCKET_SIZE(value_size) (KV_VALUE_OFFSET+(value_size))
+
+#if KV_MAX_VALUE_SIZE > 255
+#error "KV_MAX_VALUE_SIZE must fit the length byte of a bucket"
+#endif
+
+/*Enumeration to define all return statuses for the key-value store functions*/
+typedef enum
+{
+	KV_OPEN_SUCCESS,
+	KV_OPEN_INVALID_PTR,
+	KV_OPEN_BAD_SIZE,
+	KV_OPEN_NOT_A_STORE, //the file is not a record file of buckets
+	KV_OPEN_FS_ERROR, //a BFFS call failed, its status is in the store's fs_status
+	//
+	KV_GET_SUCCESS,
+	KV_GET_NOT_FOUND,
+	KV_GET_BAD_KEY,
+	KV_GET_INVALID_PTR,
+	KV_GET_FS_ERROR,
+	//
+	KV_PUT_SUCCESS,
+	KV_PUT_FULL,
+	KV_PUT_BAD_KEY,
+	KV_PUT_BAD_LENGTH,
+	KV_PUT_INVALID_PTR,
+	KV_PUT_FS_ERROR,
+	//
+	KV_DELETE_SUCCESS,
+	KV_DELETE_NOT_FOUND,
+	KV_DELETE_BAD_KEY,
+	KV_DELETE_INVALID_PTR,
+	KV_DELETE_FS_ERROR,
+}
+	kv_st;
+
+/*Handle of a key-value store kept in a record file, whose records are the buckets of an open addressed hash table*/
+typedef struct
+{
+	bffs_t* bffs; //volume of the file
+	file_t* file;
+	fram_addr_t buckets;
+	uint16_t bucket_size;
+	uint8_t value_size; //largest value a bucket holds
+	bffs_st fs_status; //status of the last BFFS call that failed
+} kv_store_t;
+
+kv_st kv_create(kv_store_t* kv, bffs_t* bffs, char* filename, fram_addr_t buckets, uint8_t value_size);
+/*******************************************************************
+* NAME :            kv_create
+*
+* DESCRIPTION :     Create a key-value store in a new file of a volume, with a fixed number of buckets each holding a
+* 					key and a value of up to value_size bytes. Keys are found by hashing them to a bucket and probing
+* 					the following ones, so a store should be kept well below full for lookups to stay short.
+*
+* INPUTS :
+*       PARAMETERS:
+*			bffs_t*			bffs: volume the store is created in (NULL: the default volume)
+*			char*			filename: name of the file holding the store
+*			fram_addr_t		buckets: number of buckets, the largest number of keys the store can hold
+*			uint8_t			value_size: largest value in bytes, up to KV_MAX_VALUE_SIZE
+*       GLOBALS :
+* OUTPUTS :
+*       PARAMETERS:
+*			kv_store_t*		kv: store handle, ready to be used
+*       GLOBALS :
+*       RETURN :
+*          kv_st 			status: Status of the operation (as kv_open)
+* PROCESS :
+*          [1] Create a record file of buckets records of KV_BUCKET_SIZE(value_size) bytes
+*          [2] Open it as kv_open does, which writes every bucket as empty
+*
+*/
+kv_st kv_open(kv_store_t* kv, bffs_t* bffs, char* filename);
+/*******************************************************************
+* NAME :            kv_open
+*
+* DESCRIPTION :     Open a key-value store created with kv_create. Like file pointers, the handle must be opened again
+* 					after the volume is loaded or reset. A store whose creation was interrupted by a reset is finished.
+*
+* INPUTS :
+*       PARAMETERS:
+*			bffs_t*			bffs: volume of the store (NULL: the default volume)
+*			char*			filename: name of the file holding the store
+*       GLOBALS :
+* OUTPUTS :
+*       PARAMETERS:
+*			kv_store_t*		kv: store handle, ready to be used
+*       GLOBALS :
+*       RETURN :
+*          kv_st 			status: Status of the operation
+* PROCESS :
+*          [1] Open the file and check it is a record file with buckets of a supported size
+*          [2] Append empty buckets until the file is full, in batches of SEGMENT_BATCH buckets
+*
+*/
+kv_st kv_get(kv_store_t* kv, const char* key, void* value_ptr, uint8_t* value_length_ptr);
+/*******************************************************************
+* NAME :            kv_get
+*
+* DESCRIPTION :     Copy the value of a key to a given location. A key found in its home bucket takes a single FRAM
+* 					read of that bucket.
+*
+* INPUTS :
+*       PARAMETERS:
+*			kv_store_t*		kv: store handle
+*			const char*		key: key, of up to KV_KEY_SIZE characters
+*       GLOBALS :
+* OUTPUTS :
+*       PARAMETERS:
+*			void*			value_ptr: address of memory location to which the value is written, which must fit
+*							the value_size of the store
+*			uint8_t*		value_length_ptr: length of the value (may be NULL)
+*       GLOBALS :
+*       RETURN :
+*          kv_st 			status: Status of the operation
+* PROCESS :
+*          [1] Read the buckets from the home bucket of the key on, until the key or an empty bucket is found
+*          [2] Copy the value out of the bucket holding the key
+*
+*/
+kv_st kv_put(kv_store_t* kv, const char* key, uint8_t value_length, const void* value_ptr);
+/*******************************************************************
+* NAME :            kv_put
+*
+* DESCRIPTION :     Set the value of a key. The value of a key already in the store is updated in place, in a single
+* 					write of its length and bytes. A new key is written to its bucket before the bucket is marked as
+* 					used, so a reset in between leaves the store as it was. An update in place is not atomic: a reset
+* 					during it may leave part of the new value.
+*
+* INPUTS :
+*       PARAMETERS:
+*			kv_store_t*		kv: store handle
+*			const char*		key: key, of up to KV_KEY_SIZE characters
+*			uint8_t			value_length: length of the value, up to the value_size of the store
+*			const void*		value_ptr: pointer to the value
+*       GLOBALS :
+* OUTPUTS :
+*       PARAMETERS:
+*       GLOBALS :
+*       RETURN :
+*          kv_st 			status: Status of the operation
+* PROCESS :
+*          [1] Read the state and key of the buckets from the home bucket of the key on, until the key or an empty
+*          	   bucket is found, remembering the first bucket a new key could take
+*          [2] Write the length and value after the key if it was found
+*          [3] Otherwise write key, length and value to the free bucket, then its state
+*
+*/
+kv_st kv_delete(kv_store_t* kv, const char* key);
+/*******************************************************************
+* NAME :            kv_delete
+*
+* DESCRIPTION :     Remove a key from the store. Its bucket is marked as deleted rather than empty so keys probed past
+* 					it are still found, and is taken again by the next new key probing it.
+*
+* INPUTS :
+*       PARAMETERS:
+*			kv_store_t*		kv: store handle
+*			const char*		key: key, of up to KV_KEY_SIZE characters
+*       GLOBALS :
+* OUTPUTS :
+*       PARAMETERS:
+*       GLOBALS :
+*       RETURN :
+*          kv_st 			status: Status of the operation
+* PROCESS :
+*          [1] Find the bucket of the key as kv_put does
+*          [2] Write its state byte
+*
+*/
+
+#endif /* INC_B_FRAM_KEYVALUE_H_ */
@@ -0,0 +1,255 @@
+#include <stdio.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "B-FRAM-FileSystem.h"
+#include "fram_driver.h"
+
+/*Host check of the asynchronous file functions over the worker thread of the host FRAM driver. Regular and ring
+ * files are written and read back asynchronously, the busy and synchronous completion paths are taken on purpose,
+ * and the file system is loaded back from FRAM at the end. Build and run on a Linux machine with:
+ *   gcc -IBFFS -Ihost_fram_driver BFFS/B-FRAM-FileSystem.c host_fram_driver/fram_driver.c examples/host_async_io.c -pthread
+ *   ./a.out
+ * Add -DFRAM_DEVICES=2 -DFRAM_BUSES=2 to run the same transfers striped over two chips on two buses.
+ */
+
+#define DATA_SIZE 1024 //spans several stripes when striped
+#define DATA_CHUNK 300
+#define DATA_CHUNKS 3
+#define HELD_CHUNK 100 //written while the driver is held, filling the file up to 1000 bytes
+#define RING_SIZE 100
+#define RING_CHUNK 40
+#define RING_CHUNKS 4 //writes 160 bytes, wrapping once
+
+/*Need to declare FS struct as a global variable*/
+
+file_system_t BFFS;
+
+static int errors;
+
+static void check(int ok, const char* what)
+{
+	if (!ok)
+	{
+		printf("%s: FAILED\n",what);
+		errors++;
+	}
+}
+
+/*Completion of the asynchronous operation in progress, signalled from the driver worker thread*/
+static pthread_mutex_t done_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+static int done;
+static bffs_st done_status;
+
+static void async_done(bffs_st status, file_t* file_ptr, void* ctx)
+{
+	(void)file_ptr;
+	(void)ctx;
+	pthread_mutex_lock(&done_lock);
+	done_status = status;
+	done = 1;
+	pthread_cond_signal(&done_cond);
+	pthread_mutex_unlock(&done_lock);
+}
+
+static bffs_st wait_done(void)
+{
+	pthread_mutex_lock(&done_lock);
+	while (!done)
+	{
+		pthread_cond_wait(&done_cond,&done_lock);
+	}
+	done = 0;
+	pthread_mutex_unlock(&done_lock);
+	return done_status;
+}
+
+static int is_done(void)
+{
+	pthread_mutex_lock(&done_lock);
+	int result = done;
+	pthread_mutex_unlock(&done_lock);
+	return result;
+}
+
+/*The host driver has a single worker thread, so a driver callback that doesn't return holds back every transfer
+ * started meanwhile. This keeps an asynchronous operation in progress for as long as a check needs it*/
+static int holding;
+static int released;
+static int raw_reads_done;
+
+static void hold_callback(fram_st status, void* ctx)
+{
+	(void)status;
+	(void)ctx;
+	__atomic_store_n(&holding,1,__ATOMIC_RELEASE);
+	while (!__atomic_load_n(&released,__ATOMIC_ACQUIRE))
+	{
+		sched_yield();
+	}
+	__atomic_store_n(&holding,0,__ATOMIC_RELEASE);
+}
+
+static void hold_worker(void)
+{
+	static uint8_t byte;
+
+	__atomic_store_n(&released,0,__ATOMIC_RELEASE);
+	while (read_FRAM_async(0,0,1,&byte,hold_callback,NULL) != FRAM_OK)
+	{
+		sched_yield();
+	}
+	while (!__atomic_load_n(&holding,__ATOMIC_ACQUIRE))
+	{
+		sched_yield();
+	}
+}
+
+static void release_worker(void)
+{
+	__atomic_store_n(&released,1,__ATOMIC_RELEASE);
+	while (__atomic_load_n(&holding,__ATOMIC_ACQUIRE))
+	{
+		sched_yield();
+	}
+}
+
+static void raw_read_done(fram_st status, void* ctx)
+{
+	(void)status;
+	(void)ctx;
+	__atomic_fetch_add(&raw_reads_done,1,__ATOMIC_RELEASE);
+}
+
+/*Fill the request slot of every bus with a read of its own, so the driver reports them all busy*/
+static int occupy_buses(void)
+{
+	static uint8_t bytes[FRAM_BUSES];
+	int count = 0;
+
+	for (uint8_t bus = 0; (bus<FRAM_BUSES) && (bus<FRAM_DEVICES); bus++)
+	{
+		if (read_FRAM_async(bus,0,1,&bytes[bus],raw_read_done,NULL) == FRAM_OK)
+		{
+			count++;
+		}
+	}
+	return count;
+}
+
+static void fill_pattern(uint8_t* data, fram_addr_t length, uint8_t seed)
+{
+	for (fram_addr_t idx = 0; idx<length; idx++)
+	{
+		data[idx] = (uint8_t)(seed+idx*7);
+	}
+}
+
+/*Read a regular file of length bytes back asynchronously, whole and past its write pointer*/
+static void check_round_trip(file_t* data, const uint8_t* expected, fram_addr_t length)
+{
+	static uint8_t read_back[DATA_SIZE];
+
+	/*Whole file back in one asynchronous read*/
+	memset(read_back,0xAA,sizeof(read_back));
+	check((seek_file(data,0) == SEEK_FILE_SUCCESS) &&
+			(read_file_async(data,length,read_back,READ_FILE_RESET_READ_PTR,async_done,NULL) == READ_FILE_SUCCESS) &&
+			(wait_done() == READ_FILE_SUCCESS),"async read");
+	check(!memcmp(read_back,expected,length),"async read data");
+
+	/*A read running past the write pointer gets the written part from FRAM and 0s for the rest*/
+	memset(read_back,0xAA,sizeof(read_back));
+	check((seek_file(data,length-20) == SEEK_FILE_SUCCESS) &&
+			(read_file_async(data,40,read_back,READ_FILE_RESET_READ_PTR,async_done,NULL) == READ_FILE_SUCCESS) &&
+			(wait_done() == READ_FILE_SUCCESS),"async read past the write pointer");
+	check(!memcmp(read_back,&expected[length-20],20),"async read past the write pointer, written part");
+	for (uint8_t idx = 20; idx<40; idx++)
+	{
+		check(read_back[idx] == 0,"async read past the write pointer, unwritten part");
+	}
+}
+
+int main(void)
+{
+	static uint8_t expected[DATA_SIZE];
+	static uint8_t ring_expected[RING_CHUNKS*RING_CHUNK];
+	uint8_t read_back[RING_SIZE];
+	file_t* data;
+	file_t* ring;
+
+	if ((mount_fs() != MOUNT_FS_SUCCESS) || (reset_fs() != RESET_FS_SUCCESS) ||
+			(create_file("data",DATA_SIZE,&data) != CREATE_FILE_SUCCESS) ||
+			(create_ring_file("ring",RING_SIZE,&ring) != CREATE_FILE_SUCCESS))
+	{
+		printf("file system setup failed\n");
+		return 1;
+	}
+
+	/*Regular file: appends one after another, each waited for*/
+	fill_pattern(expected,sizeof(expected),1);
+	for (uint8_t chunk = 0; chunk<DATA_CHUNKS; chunk++)
+	{
+		check((write_file_async(data,DATA_CHUNK,&expected[chunk*DATA_CHUNK],async_done,NULL) == WRITE_FILE_SUCCESS) &&
+				(wait_done() == WRITE_FILE_SUCCESS),"async write");
+	}
+	check(get_file_used_bytes(data) == DATA_CHUNKS*DATA_CHUNK,"write pointer after async writes");
+	check_round_trip(data,expected,DATA_CHUNKS*DATA_CHUNK);
+
+	/*A read entirely past the write pointer has nothing to transfer, and calls back before returning*/
+	memset(read_back,0xAA,sizeof(read_back));
+	check((seek_file(data,DATA_CHUNKS*DATA_CHUNK) == SEEK_FILE_SUCCESS) &&
+			(read_file_async(data,10,read_back,READ_FILE_RESET_READ_PTR,async_done,NULL) == READ_FILE_SUCCESS) &&
+			is_done() && (wait_done() == READ_FILE_SUCCESS) && (read_back[0] == 0) && (read_back[9] == 0),
+			"async read of unwritten bytes calls back right away");
+
+	/*Ring file: async appends wrap around, and read_ring_file returns the most recent bytes*/
+	fill_pattern(ring_expected,sizeof(ring_expected),101);
+	for (uint8_t chunk = 0; chunk<RING_CHUNKS; chunk++)
+	{
+		check((write_file_async(ring,RING_CHUNK,&ring_expected[chunk*RING_CHUNK],async_done,NULL) == WRITE_FILE_SUCCESS) &&
+				(wait_done() == WRITE_FILE_SUCCESS),"async ring write");
+	}
+	check((ring->wrap_count == 1) && (read_ring_file(ring,RING_SIZE,read_back) == READ_FILE_SUCCESS) &&
+			!memcmp(read_back,&ring_expected[sizeof(ring_expected)-RING_SIZE],RING_SIZE),"async ring write data");
+	check(read_file_async(ring,10,read_back,READ_FILE_RESET_READ_PTR,async_done,NULL) == READ_FILE_BAD_TYPE,
+			"async read of a ring file");
+
+	/*Every bus busy in the driver: nothing is started and the file is left as it was*/
+	hold_worker();
+	int raw_reads = occupy_buses();
+	check(write_file_async(data,10,expected,async_done,NULL) == WRITE_FILE_BUSY,"async write on busy buses");
+	check(read_file_async(data,10,read_back,READ_FILE_RESET_READ_PTR,async_done,NULL) == READ_FILE_BUSY,
+			"async read on busy buses");
+	release_worker();
+	while (__atomic_load_n(&raw_reads_done,__ATOMIC_ACQUIRE) < raw_reads)
+	{
+		sched_yield();
+	}
+	check(!is_done() && (get_file_used_bytes(data) == DATA_CHUNKS*DATA_CHUNK),"file after busy buses");
+
+	/*An operation in progress: others are refused until it calls back*/
+	hold_worker();
+	check(write_file_async(data,HELD_CHUNK,&expected[DATA_CHUNKS*DATA_CHUNK],async_done,NULL) == WRITE_FILE_SUCCESS,
+			"async write held by the driver");
+	check(write_file_async(data,10,expected,async_done,NULL) == WRITE_FILE_BUSY,"async write while one is in progress");
+	check(read_file_async(data,10,read_back,READ_FILE_RESET_READ_PTR,async_done,NULL) == READ_FILE_BUSY,
+			"async read while one is in progress");
+	check(!is_done() && (get_file_used_bytes(data) == DATA_CHUNKS*DATA_CHUNK),"file while the write is held");
+	release_worker();
+	check(wait_done() == WRITE_FILE_SUCCESS,"held async write");
+	check(get_file_used_bytes(data) == DATA_CHUNKS*DATA_CHUNK+HELD_CHUNK,"write pointer after the held write");
+
+	/*What the callbacks reported must be in FRAM*/
+	check(load_fs() == LOAD_FS_SUCCESS,"load_fs");
+	check((open_file("data",&data) == OPEN_FILE_SUCCESS) && (get_file_used_bytes(data) == DATA_CHUNKS*DATA_CHUNK+HELD_CHUNK),
+			"loaded regular file");
+	check_round_trip(data,expected,DATA_CHUNKS*DATA_CHUNK+HELD_CHUNK);
+	check((open_file("ring",&ring) == OPEN_FILE_SUCCESS) && (ring->wrap_count == 1) &&
+			(read_ring_file(ring,RING_SIZE,read_back) == READ_FILE_SUCCESS) &&
+			!memcmp(read_back,&ring_expected[sizeof(ring_expected)-RING_SIZE],RING_SIZE),"loaded ring file");
+
+	printf("async file I/O over %u device(s) on %u bus(es): %s\n",FRAM_DEVICES,FRAM_BUSES,errors ? "FAILED" : "ok");
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "B-FRAM-FileSystem.h"
+#include "fram_driver.h"
+
+/*Host example estimating the on-target SPI bus cost of BFFS call sequences with the host FRAM driver.
+ * Build and run on a Linux machine with:
+ *   gcc -IBFFS -Ihost_fram_driver BFFS/B-FRAM-FileSystem.c host_fram_driver/fram_driver.c examples/host_bus_cost.c -pthread
+ *   ./a.out [image file]
+ * If an image file is given, the FRAM contents are kept in it, so the file system is loaded again on the next run.
+ * Add e.g. -DFRAM_DEVICES=4 -DFRAM_BUSES=2 to model a volume striped over four chips on two buses.
+ */
+
+#define SAMPLES 200 //4 byte samples appended per scenario
+
+/*Need to declare FS struct as a global variable*/
+
+file_system_t BFFS;
+
+static void print_cost(const char* scenario, uint32_t calls)
+{
+	fram_bus_cost_t cost;
+	uint64_t busiest_ns = 0;
+	get_FRAM_bus_cost(&cost);
+
+	/*With FRAM_BUSES > 1, asynchronous transfers on different buses overlap, so the busiest bus bounds their elapsed time*/
+	for (uint8_t bus = 0; bus < FRAM_BUSES; bus++)
+	{
+		if (cost.bus_busy_ns[bus] > busiest_ns)
+		{
+			busiest_ns = cost.bus_busy_ns[bus];
+		}
+	}
+	printf("%-28s %6u frames %7u bytes %9.1f us total %9.1f us busiest bus %7.2f us/call\n",
+			scenario,
+			cost.transactions,
+			cost.opcode_bytes+cost.address_bytes+cost.write_bytes+cost.read_bytes,
+			cost.bus_ns/1000.0,
+			busiest_ns/1000.0,
+			cost.bus_ns/1000.0/calls);
+}
+
+static void append_samples(const char* scenario, file_t* file)
+{
+	uint32_t sample;
+
+	clear_file(file);
+	reset_FRAM_bus_cost();
+	for (sample = 0; sample < SAMPLES; sample++)
+	{
+		if (write_file(file,sizeof(sample),&sample) != WRITE_FILE_SUCCESS)
+		{
+			printf("%s: write failed\n",scenario);
+			return;
+		}
+	}
+	sync_fs();
+	print_cost(scenario,SAMPLES);
+}
+
+int main(int argc, char** argv)
+{
+	file_t* file;
+	fram_bus_config_t config;
+
+	if ((argc > 1) && (open_FRAM_image(argv[1]) != 0))
+	{
+		printf("Could not open image %s\n",argv[1]);
+		return 1;
+	}
+	get_FRAM_bus_config(&config);
+	printf("SPI clock: %u Hz, CS edge: %u ns, frame overhead: %u ns\n",
+			config.clock_hz,config.cs_toggle_ns,config.transaction_ns);
+
+	reset_FRAM_bus_cost();
+	if (mount_fs() != MOUNT_FS_SUCCESS)
+		return 1;
+	print_cost("mount_fs",1);
+
+	if (open_file("log",&file) != OPEN_FILE_SUCCESS)
+	{
+		reset_FRAM_bus_cost();
+		if (create_file("log",4*SAMPLES,&file) != CREATE_FILE_SUCCESS)
+			return 1;
+		print_cost("create_file",1);
+	}
+
+	set_fs_commit_policy(FS_COMMIT_WRITE_THROUGH,0,0);
+	append_samples("append, write through",file);
+
+	set_fs_commit_policy(FS_COMMIT_EVERY_N,16,0);
+	append_samples("append, every 16 ops",file);
+
+	set_fs_commit_policy(FS_COMMIT_ON_DEMAND,0,0);
+	append_samples("append, on demand",file);
+
+	reset_FRAM_bus_cost();
+	clear_file(file);
+	sync_fs();
+	print_cost("clear_file",1);
+
+	close_FRAM_image();
+	return 0;
+}
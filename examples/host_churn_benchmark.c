@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "B-FRAM-FileSystem.h"
+#include "fram_driver.h"
+
+/*Host benchmark of the free extent allocator under create/delete churn. Files of random sizes are created and deleted
+ * at random, and the CPU time and SPI bus time of create_file and delete_file are reported against the number of
+ * free extents present when the call was made. Build and run on a Linux machine with:
+ *   gcc -O2 -IBFFS -Ihost_fram_driver BFFS/B-FRAM-FileSystem.c host_fram_driver/fram_driver.c examples/host_churn_benchmark.c -pthread
+ *   ./a.out [iterations]
+ * Raise MAX_FILES (and FS_INDEX_SIZE) in B-FRAM-FileSystem.h to see how the allocator scales with more extents.
+ */
+
+#define DEFAULT_ITERATIONS 100000
+#define MAX_CREATE_SIZE 400 //files are 1 to MAX_CREATE_SIZE bytes
+
+/*Need to declare FS struct as a global variable*/
+
+file_system_t BFFS;
+
+/*Totals per number of free extents when the call was made*/
+typedef struct
+{
+	uint32_t calls;
+	uint64_t cpu_ns;
+	uint64_t bus_ns;
+} churn_bucket_t;
+
+static churn_bucket_t create_buckets[MAX_FREE_EXTENTS+1];
+static churn_bucket_t delete_buckets[MAX_FREE_EXTENTS+1];
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (uint64_t)ts.tv_sec*1000000000u+ts.tv_nsec;
+}
+
+static void account(churn_bucket_t* bucket, uint64_t start_ns)
+{
+	fram_bus_cost_t cost;
+	uint64_t cpu_ns = now_ns()-start_ns;
+
+	get_FRAM_bus_cost(&cost);
+	bucket->calls++;
+	bucket->cpu_ns += cpu_ns;
+	bucket->bus_ns += cost.bus_ns;
+}
+
+static void print_buckets(const char* operation, const churn_bucket_t* buckets)
+{
+	printf("%s\n  extents     calls   cpu ns/call   bus us/call\n",operation);
+	for (uint16_t idx = 0; idx<=MAX_FREE_EXTENTS; idx++)
+	{
+		if (buckets[idx].calls)
+		{
+			printf("  %7u %9u %13.1f %13.2f\n",idx,buckets[idx].calls,
+					(double)buckets[idx].cpu_ns/buckets[idx].calls,
+					(double)buckets[idx].bus_ns/1000.0/buckets[idx].calls);
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t iterations = (argc > 1) ? (uint32_t)strtoul(argv[1],NULL,10) : DEFAULT_ITERATIONS;
+	uint8_t live[MAX_FILES] = {0};
+	uint32_t failed_creates = 0;
+	char name[MAX_FILENAME_SIZE+1];
+	file_t* file;
+
+	srand(1);
+	if (mount_fs() != MOUNT_FS_SUCCESS)
+		return 1;
+	reset_fs();
+
+	for (uint32_t it = 0; it<iterations; it++)
+	{
+		uint16_t idx = rand()%MAX_FILES;
+		uint16_t extents = get_fs_free_extents();
+		uint64_t start_ns;
+
+		snprintf(name,sizeof(name),"f%u",idx);
+		reset_FRAM_bus_cost();
+		start_ns = now_ns();
+		if (live[idx])
+		{
+			if (delete_file(name) != DELETE_FILE_SUCCESS)
+			{
+				printf("delete of %s failed\n",name);
+				return 1;
+			}
+			account(&delete_buckets[extents],start_ns);
+			live[idx] = 0;
+		}
+		else if (create_file(name,1+rand()%MAX_CREATE_SIZE,&file) == CREATE_FILE_SUCCESS)
+		{
+			account(&create_buckets[extents],start_ns);
+			live[idx] = 1;
+		}
+		else
+		{
+			failed_creates++;
+		}
+	}
+
+	printf("%u iterations, %u creates failed for lack of contiguous space, %u bytes free in %u extents at the end\n",
+			iterations,failed_creates,get_fs_free_bytes(),get_fs_free_extents());
+	print_buckets("create_file",create_buckets);
+	print_buckets("delete_file",delete_buckets);
+	return 0;
+}
@@ -0,0 +1,99 @@
+#include <array>
+#include <cstdio>
+#include <cstring>
+
+#include "B-FRAM-FileSystem.hpp"
+
+/*Host example of the C++ wrapper: two volumes of different sizes on the host FRAM, each with its own statically sized
+ * file table, written and read through spans and streamed to a lambda. Build and run on a Linux machine with:
+ *   gcc -c -O2 -IBFFS -Ihost_fram_driver BFFS/B-FRAM-FileSystem.c host_fram_driver/fram_driver.c
+ *   g++ -std=c++20 -O2 -IBFFS -Ihost_fram_driver examples/host_cpp_volumes.cpp B-FRAM-FileSystem.o fram_driver.o -pthread
+ *   ./a.out
+ */
+
+/*Need to declare FS struct as a global variable, for the default volume*/
+
+extern "C" file_system_t BFFS;
+file_system_t BFFS;
+
+struct sample_t
+{
+	std::uint32_t time;
+	std::int16_t value;
+	std::uint16_t flags;
+};
+
+//A small configuration volume at the start of the first device, and a log volume taking the rest of it
+using config_volume = bffs::FileSystem<2048>;
+using log_volume = bffs::FileSystem<FRAM_SIZE-2048>;
+
+static_assert(config_volume::layout::file_offset(1) == offsetof(file_system_t,files)+sizeof(file_t));
+static_assert(log_volume::usable_size == FRAM_SIZE-2048-FS_OFFSET);
+
+int main()
+{
+	static config_volume config;
+	static log_volume log(2048);
+	std::array<sample_t,16> samples;
+	std::array<sample_t,16> read_back;
+	std::array<char,8> name = {'d','e','v','i','c','e','0','1'};
+	std::array<char,8> name_back;
+	file_t* file;
+	int errors = 0;
+
+	if ((config.init_status() != INIT_FS_SUCCESS) || (log.init_status() != INIT_FS_SUCCESS))
+		return 1;
+	if ((config.mount() != MOUNT_FS_SUCCESS) || (log.mount() != MOUNT_FS_SUCCESS))
+		return 1;
+	config.reset();
+	log.reset();
+
+	if ((config.create("name",sizeof(name),file) != CREATE_FILE_SUCCESS) ||
+			(config.write(file,std::span(name)) != WRITE_FILE_SUCCESS))
+		return 1;
+	if (log.create_ring("samples",sizeof(samples),file) != CREATE_FILE_SUCCESS)
+		return 1;
+	/*Three rounds over a ring of 16 samples, the last 16 being kept*/
+	for (std::uint32_t round = 0; round<3; round++)
+	{
+		for (std::uint32_t idx = 0; idx<samples.size(); idx++)
+		{
+			samples[idx] = {round*100+idx,static_cast<std::int16_t>(idx),0};
+		}
+		if (log.write(file,std::span(samples)) != WRITE_FILE_SUCCESS)
+			return 1;
+	}
+
+	/*Both volumes loaded back from FRAM*/
+	if ((config.load() != LOAD_FS_SUCCESS) || (log.load() != LOAD_FS_SUCCESS))
+		return 1;
+	if ((config.open("name",file) != OPEN_FILE_SUCCESS) ||
+			(config.read(file,std::span(name_back),READ_FILE_RESET_READ_PTR) != READ_FILE_SUCCESS))
+		return 1;
+	errors += (name_back != name);
+	/*The same bytes streamed to a lambda, in chunks that don't divide the file*/
+	std::array<char,8> name_streamed;
+	std::size_t streamed = 0;
+	auto gather = [&](std::span<const std::uint8_t> chunk)
+	{
+		if ((chunk.size() > 3) || (streamed+chunk.size() > name_streamed.size()))
+		{
+			errors++;
+			return;
+		}
+		std::memcpy(name_streamed.data()+streamed,chunk.data(),chunk.size());
+		streamed += chunk.size();
+	};
+	if ((config.read_stream(file,sizeof(name),3,gather) != READ_FILE_SUCCESS) ||
+			(config.read_stream(file,sizeof(name),READ_STREAM_CHUNK_SIZE+1,gather) != READ_FILE_BAD_LENGTH))
+		return 1;
+	errors += (streamed != sizeof(name)) || (name_streamed != name);
+	if ((log.open("samples",file) != OPEN_FILE_SUCCESS) || (log.read_ring(file,std::span(read_back)) != READ_FILE_SUCCESS))
+		return 1;
+	errors += std::memcmp(read_back.data(),samples.data(),sizeof(samples)) != 0;
+
+	std::printf("config volume: %u bytes, %u free, log volume: %u bytes, %u free, file table of %zu bytes: %s\n",
+			config.size(),config.free_bytes(),log.size(),log.free_bytes(),config_volume::layout::fs_size,
+			errors ? "FAILED" : "ok");
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "B-FRAM-FileSystem.h"
+#include "B-FRAM-KeyValue.h"
+
+/*Host example of the key-value store: calibration parameters kept in a single file, set, updated in place, deleted
+ * and read back after loading the file system again, with the driver transfers each operation takes. Build and run on
+ * a Linux machine with:
+ *   gcc -O2 -IBFFS -Ihost_fram_driver BFFS/B-FRAM-FileSystem.c BFFS/B-FRAM-KeyValue.c host_fram_driver/fram_driver.c examples/host_kv_store.c
+ *   ./a.out
+ */
+
+#define PARAMETERS 40
+#define BUCKETS 64
+
+/*Need to declare FS struct as a global variable*/
+
+file_system_t BFFS;
+
+/*Driver transfers since the last call*/
+static uint32_t transfers(void)
+{
+	bffs_stats_t stats;
+	bffs_get_stats(&stats);
+	bffs_reset_stats();
+	return stats.driver_reads+stats.driver_writes;
+}
+
+int main(void)
+{
+	kv_store_t kv;
+	char key[KV_KEY_SIZE+1];
+	float value;
+	uint32_t get_transfers = 0;
+	int errors = 0;
+
+	if ((mount_fs() != MOUNT_FS_SUCCESS) || (reset_fs() != RESET_FS_SUCCESS) ||
+			(kv_create(&kv,NULL,"calib",BUCKETS,sizeof(float)) != KV_OPEN_SUCCESS))
+		return 1;
+	for (uint16_t idx = 0; idx<PARAMETERS; idx++)
+	{
+		value = idx*0.5f;
+		snprintf(key,sizeof(key),"gain_%u",idx);
+		errors += (kv_put(&kv,key,sizeof(value),&value) != KV_PUT_SUCCESS);
+	}
+	/*Updating a parameter writes its value only, deleting it its state byte only*/
+	transfers();
+	value = -1.0f;
+	errors += (kv_put(&kv,"gain_7",sizeof(value),&value) != KV_PUT_SUCCESS);
+	printf("update in place: %u transfers\n",transfers());
+	errors += (kv_delete(&kv,"gain_8") != KV_DELETE_SUCCESS);
+	printf("delete: %u transfers\n",transfers());
+
+	/*Read everything back from FRAM*/
+	if ((load_fs() != LOAD_FS_SUCCESS) || (kv_open(&kv,NULL,"calib") != KV_OPEN_SUCCESS))
+		return 1;
+	transfers();
+	for (uint16_t idx = 0; idx<PARAMETERS; idx++)
+	{
+		snprintf(key,sizeof(key),"gain_%u",idx);
+		kv_st status = kv_get(&kv,key,&value,NULL);
+		if (idx == 8)
+		{
+			errors += (status != KV_GET_NOT_FOUND);
+		}
+		else
+		{
+			errors += (status != KV_GET_SUCCESS) || (value != ((idx == 7) ? -1.0f : idx*0.5f));
+		}
+	}
+	get_transfers = transfers();
+	printf("%u parameters in %u buckets: %.2f reads per get: %s\n",PARAMETERS,BUCKETS,(float)get_transfers/PARAMETERS,
+			errors ? "FAILED" : "ok");
+	return errors ? 1 : 0;
+}
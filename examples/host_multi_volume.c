@@ -0,0 +1,228 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "B-FRAM-FileSystem.h"
+#include "fram_driver.h"
+
+/*Host example of volume handles. Two volumes share the host FRAM as partitions of its first device, then several
+ * volumes on RAM buffers with their own driver are used by one thread each at the same time. Every volume holds a file
+ * of the same name with its own contents, checked again after loading the volume back. Build and run on a Linux
+ * machine with:
+ *   gcc -O2 -IBFFS -Ihost_fram_driver BFFS/B-FRAM-FileSystem.c host_fram_driver/fram_driver.c examples/host_multi_volume.c -pthread
+ *   ./a.out
+ * Add -DBFFS_THREAD_SAFE=1 to give every volume lock hooks, the RAM volumes from their own thread, and check the
+ * partitions share the bus locks of the host FRAM while the RAM volumes each have their own.
+ */
+
+#define RAM_VOLUMES 8
+#define RAM_VOLUME_SIZE 4096
+#define RECORDS 100
+
+/*Need to declare FS struct as a global variable, for the default volume*/
+
+file_system_t BFFS;
+
+/*RAM driver: a single device backed by a buffer of the driver context*/
+typedef struct
+{
+	uint8_t bytes[RAM_VOLUME_SIZE];
+	uint32_t transactions;
+} ram_fram_t;
+
+static void ram_write_v(void* ctx, uint8_t device, const fram_segment_t* segments, uint16_t segment_count)
+{
+	ram_fram_t* ram = ctx;
+	(void)device;
+
+	for (uint16_t idx = 0; idx<segment_count; idx++)
+	{
+		memcpy(&ram->bytes[segments[idx].address],segments[idx].data_ptr,segments[idx].data_length);
+	}
+	ram->transactions++;
+}
+
+static void ram_read_v(void* ctx, uint8_t device, const fram_segment_t* segments, uint16_t segment_count)
+{
+	ram_fram_t* ram = ctx;
+	(void)device;
+
+	for (uint16_t idx = 0; idx<segment_count; idx++)
+	{
+		memcpy(segments[idx].data_ptr,&ram->bytes[segments[idx].address],segments[idx].data_length);
+	}
+	ram->transactions++;
+}
+
+static void ram_fill(void* ctx, uint8_t device, fram_addr_t address, fram_addr_t data_length, uint8_t value)
+{
+	ram_fram_t* ram = ctx;
+	(void)device;
+
+	memset(&ram->bytes[address],value,data_length);
+	ram->transactions++;
+}
+
+/*No bus selection, no asynchronous transfers, and no bus locks shared with other volumes as each context is a
+ * volume of its own*/
+static const bffs_driver_t ram_driver = {NULL,ram_write_v,ram_read_v,ram_fill,NULL,NULL,NULL,NULL};
+
+#if BFFS_THREAD_SAFE
+/*Lock hooks on pthread mutexes, which can't be shared*/
+static void* mutex_create(void)
+{
+	pthread_mutex_t* lock = malloc(sizeof(*lock));
+
+	if ((lock != NULL) && pthread_mutex_init(lock,NULL))
+	{
+		free(lock);
+		return NULL;
+	}
+	return lock;
+}
+
+static void mutex_lock(void* lock, uint8_t shared)
+{
+	(void)shared;
+	pthread_mutex_lock(lock);
+}
+
+static void mutex_unlock(void* lock, uint8_t shared)
+{
+	(void)shared;
+	pthread_mutex_unlock(lock);
+}
+
+static const bffs_lock_hooks_t mutex_hooks = {mutex_create,mutex_lock,mutex_unlock};
+#endif
+
+/*Write RECORDS records tagged with a volume number to the "log" file of a volume, and check them, before and after
+ * loading the volume back from its FRAM. Returns the number of mismatches*/
+static int fill_and_check(bffs_t* volume, uint32_t tag)
+{
+	uint32_t records[RECORDS];
+	file_t* file;
+	int errors = 0;
+
+	if ((bffs_mount_fs(volume) != MOUNT_FS_SUCCESS) || (bffs_reset_fs(volume) != RESET_FS_SUCCESS) ||
+			(bffs_create_file(volume,"log",sizeof(records),&file) != CREATE_FILE_SUCCESS))
+	{
+		return 1;
+	}
+	for (uint32_t idx = 0; idx<RECORDS; idx++)
+	{
+		uint32_t record = tag*1000+idx;
+		if (bffs_write_file(volume,file,sizeof(record),&record) != WRITE_FILE_SUCCESS)
+		{
+			return 1;
+		}
+	}
+	for (int pass = 0; pass<2; pass++)
+	{
+		if ((bffs_open_file(volume,"log",&file) != OPEN_FILE_SUCCESS) ||
+				(bffs_read_file(volume,file,sizeof(records),records,READ_FILE_RESET_READ_PTR) != READ_FILE_SUCCESS))
+		{
+			return errors+1;
+		}
+		for (uint32_t idx = 0; idx<RECORDS; idx++)
+		{
+			errors += (records[idx] != tag*1000+idx);
+		}
+		/*Second pass on what is in FRAM, once appends still in RAM (with BFFS_APPEND_BUFFER set) are written out*/
+		if ((bffs_sync_fs(volume) != SYNC_FS_SUCCESS) || (bffs_load_fs(volume) != LOAD_FS_SUCCESS))
+		{
+			return errors+1;
+		}
+	}
+	return errors;
+}
+
+typedef struct
+{
+	bffs_t volume;
+	file_system_t fs;
+	ram_fram_t ram;
+	uint32_t tag;
+	int errors;
+} ram_volume_t;
+
+static void* volume_thread(void* arg)
+{
+	ram_volume_t* ram_volume = arg;
+
+#if BFFS_THREAD_SAFE
+	/*Volumes on other driver contexts share nothing, so their hooks are set while the other threads run*/
+	if (bffs_set_fs_lock_hooks(&ram_volume->volume,&mutex_hooks) != SET_LOCK_HOOKS_SUCCESS)
+	{
+		ram_volume->errors = 1;
+		return NULL;
+	}
+#endif
+	ram_volume->errors = fill_and_check(&ram_volume->volume,ram_volume->tag);
+	return NULL;
+}
+
+int main(void)
+{
+	static ram_volume_t ram_volumes[RAM_VOLUMES];
+	pthread_t threads[RAM_VOLUMES];
+	bffs_t partitions[2];
+	file_system_t partition_fs[2];
+	int errors = 0;
+
+	/*Two halves of the first host FRAM device, with the fram_driver.h functions*/
+	for (uint8_t idx = 0; idx<2; idx++)
+	{
+		bffs_geometry_t geometry = {idx*(FRAM_SIZE/2),FRAM_SIZE/2,1};
+		if (bffs_init(&partitions[idx],&partition_fs[idx],NULL,NULL,&geometry) != INIT_FS_SUCCESS)
+			return 1;
+#if BFFS_THREAD_SAFE
+		if (bffs_set_fs_lock_hooks(&partitions[idx],&mutex_hooks) != SET_LOCK_HOOKS_SUCCESS)
+			return 1;
+#endif
+	}
+#if BFFS_THREAD_SAFE
+	/*Partitions of the same devices take turns on their buses*/
+	errors += (partitions[0].bus_locks[0] != partitions[1].bus_locks[0]);
+#endif
+	errors += fill_and_check(&partitions[0],1);
+	errors += fill_and_check(&partitions[1],2);
+	/*Filling the second partition must have left the first one untouched*/
+	errors += (bffs_load_fs(&partitions[0]) != LOAD_FS_SUCCESS);
+	printf("partitions of %u bytes at 0 and %u: %s\n",FRAM_SIZE/2,FRAM_SIZE/2,errors ? "FAILED" : "ok");
+
+	/*Independent volumes, one per thread, need no lock hooks*/
+	for (uint16_t idx = 0; idx<RAM_VOLUMES; idx++)
+	{
+		bffs_geometry_t geometry = {0,RAM_VOLUME_SIZE,1};
+		ram_volumes[idx].tag = 10+idx;
+		if (bffs_init(&ram_volumes[idx].volume,&ram_volumes[idx].fs,&ram_driver,&ram_volumes[idx].ram,&geometry)
+				!= INIT_FS_SUCCESS)
+			return 1;
+		pthread_create(&threads[idx],NULL,volume_thread,&ram_volumes[idx]);
+	}
+	for (uint16_t idx = 0; idx<RAM_VOLUMES; idx++)
+	{
+		pthread_join(threads[idx],NULL);
+		printf("RAM volume %u: %u driver transactions, %u bytes free: %s\n",idx,ram_volumes[idx].ram.transactions,
+				bffs_get_fs_free_bytes(&ram_volumes[idx].volume),ram_volumes[idx].errors ? "FAILED" : "ok");
+		errors += ram_volumes[idx].errors;
+	}
+#if BFFS_THREAD_SAFE
+	/*While the RAM volumes never wait on each other's bus, nor on the host FRAM ones*/
+	int shared_bus_locks = 0;
+	for (uint16_t idx = 0; idx<RAM_VOLUMES; idx++)
+	{
+		shared_bus_locks += (ram_volumes[idx].volume.bus_locks[0] == partitions[0].bus_locks[0]);
+		for (uint16_t other = 0; other<idx; other++)
+		{
+			shared_bus_locks += (ram_volumes[idx].volume.bus_locks[0] == ram_volumes[other].volume.bus_locks[0]);
+		}
+	}
+	printf("bus locks shared by the partitions and no other volume: %s\n",
+			(partitions[0].bus_locks[0] == partitions[1].bus_locks[0]) && !shared_bus_locks ? "ok" : "FAILED");
+	errors += shared_bus_locks;
+#endif
+	return errors ? 1 : 0;
+}
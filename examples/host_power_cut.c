@@ -0,0 +1,279 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "B-FRAM-FileSystem.h"
+#include "fram_driver.h"
+
+/*Host check of the journal against power cuts. A volume on an image file of the host FRAM is brought to a state with
+ * records both in its last checkpoint and in the journal, then a journal append of one record, one of a batch of
+ * several records (creating a file) and a checkpoint are each cut short after every possible number of bytes written, by a driver that drops all writes once its budget runs out. After each
+ * cut the image is mapped again and mounted: it must hold the file as it was before or after the cut operation, or,
+ * for a checkpoint cut short, be reported MOUNT_FS_CORRUPT and left as it is until the application resets it. Build
+ * with BFFS_JOURNAL set and run on a Linux machine with:
+ *   gcc -O2 -DBFFS_JOURNAL=1 -IBFFS -Ihost_fram_driver BFFS/B-FRAM-FileSystem.c host_fram_driver/fram_driver.c examples/host_power_cut.c -pthread
+ *   ./a.out
+ */
+
+#if !BFFS_JOURNAL
+#error "Build this example with -DBFFS_JOURNAL=1"
+#endif
+
+#define IMAGE_PATH "power_cut.bin"
+#define FILE_SIZE 1024
+#define RECORD_SIZE 24
+#define CHECKPOINTED_RECORDS 10 //records written before the last checkpoint
+#define JOURNALED_RECORDS 4 //records written after it, only in the journal
+
+/*Need to declare FS struct as a global variable, for the default volume*/
+
+file_system_t BFFS;
+
+static int errors;
+
+static void check(int ok, const char* what, uint32_t cut)
+{
+	if (!ok)
+	{
+		printf("%s, cut after %u bytes: FAILED\n",what,(unsigned)cut);
+		errors++;
+	}
+}
+
+/*Driver on the fram_driver.h functions whose power goes once budget bytes are written, while armed. Writes are done
+ * in the order of their segments, the one the budget runs out in being written in part*/
+typedef struct
+{
+	uint8_t armed;
+	uint32_t budget;
+	uint32_t written; //bytes that got to FRAM
+} power_t;
+
+static fram_addr_t get_powered_length(power_t* power, fram_addr_t data_length)
+{
+	if (power->armed)
+	{
+		data_length = (data_length < power->budget) ? data_length : (fram_addr_t)power->budget;
+		power->budget -= data_length;
+	}
+	power->written += data_length;
+	return data_length;
+}
+
+static uint8_t cut_get_bus(void* ctx, uint8_t device)
+{
+	(void)ctx;
+	return get_FRAM_bus(device);
+}
+
+static void cut_write_v(void* ctx, uint8_t device, const fram_segment_t* segments, uint16_t segment_count)
+{
+	for (uint16_t idx = 0; idx<segment_count; idx++)
+	{
+		fram_addr_t data_length = get_powered_length(ctx,segments[idx].data_length);
+		if (data_length)
+		{
+			write_FRAM(device,segments[idx].address,data_length,segments[idx].data_ptr);
+		}
+	}
+}
+
+static void cut_read_v(void* ctx, uint8_t device, const fram_segment_t* segments, uint16_t segment_count)
+{
+	(void)ctx;
+	read_FRAM_v(device,segments,segment_count);
+}
+
+static void cut_fill(void* ctx, uint8_t device, fram_addr_t address, fram_addr_t data_length, uint8_t value)
+{
+	data_length = get_powered_length(ctx,data_length);
+	if (data_length)
+	{
+		fill_FRAM(device,address,data_length,value);
+	}
+}
+
+/*No asynchronous transfers and no bus locks*/
+static const bffs_driver_t cut_driver = {cut_get_bus,cut_write_v,cut_read_v,cut_fill,NULL,NULL,NULL,NULL};
+
+static power_t power;
+static bffs_t volume;
+static file_system_t fs;
+static uint8_t snapshot[FRAM_DEVICES][FRAM_SIZE];
+static uint8_t expected[FILE_SIZE];
+
+/*Power the FRAM up again: map the image anew and mount it on a fresh volume handle*/
+static bffs_st power_up(void)
+{
+	close_FRAM_image();
+	power.armed = 0;
+	if ((open_FRAM_image(IMAGE_PATH) != 0) || (bffs_init(&volume,&fs,&cut_driver,&power,NULL) != INIT_FS_SUCCESS))
+	{
+		return MOUNT_FS_FAILED;
+	}
+	return bffs_mount_fs(&volume);
+}
+
+static void save_snapshot(void)
+{
+	for (uint8_t device = 0; device<FRAM_DEVICES; device++)
+	{
+		read_FRAM(device,0,FRAM_SIZE,snapshot[device]);
+	}
+}
+
+static void restore_snapshot(void)
+{
+	for (uint8_t device = 0; device<FRAM_DEVICES; device++)
+	{
+		write_FRAM(device,0,FRAM_SIZE,snapshot[device]);
+	}
+}
+
+/*Check the log file holds the first used bytes of expected, and nothing more*/
+static int is_log_intact(fram_addr_t used)
+{
+	static uint8_t read_back[FILE_SIZE];
+	file_t* file;
+
+	return (bffs_open_file(&volume,"log",&file) == OPEN_FILE_SUCCESS) && (bffs_get_file_used_bytes(&volume,file) == used) &&
+			(bffs_read_file(&volume,file,used,read_back,READ_FILE_RESET_READ_PTR) == READ_FILE_SUCCESS) &&
+			!memcmp(read_back,expected,used);
+}
+
+/*Append the next record to the log file of a mounted volume, and check it is there once powered up again*/
+static int append_after_power_up(fram_addr_t used)
+{
+	file_t* file;
+
+	return (bffs_open_file(&volume,"log",&file) == OPEN_FILE_SUCCESS) &&
+			(bffs_write_file(&volume,file,RECORD_SIZE,&expected[used]) == WRITE_FILE_SUCCESS) &&
+			(bffs_flush_file(&volume,file) == FLUSH_FILE_SUCCESS) && (power_up() == MOUNT_FS_SUCCESS) &&
+			is_log_intact(used+RECORD_SIZE);
+}
+
+/*Operations cut short*/
+#define CUT_APPEND 0
+#define CUT_CREATE 1
+#define CUT_CHECKPOINT 2
+
+/*Start from the snapshot with every file operation through, then run an operation with the power going after cut
+ * bytes (or not at all if cut is UINT32_MAX). Returns the bytes the operation wrote*/
+static uint32_t run_cut(uint8_t operation, uint32_t cut)
+{
+	file_t* created;
+
+	file_t* file;
+
+	restore_snapshot();
+	if ((power_up() != MOUNT_FS_SUCCESS) || (bffs_open_file(&volume,"log",&file) != OPEN_FILE_SUCCESS))
+	{
+		check(0,"mount before the cut",cut);
+		return 0;
+	}
+	power.armed = (cut != UINT32_MAX);
+	power.budget = cut;
+	power.written = 0;
+	if (operation == CUT_CHECKPOINT)
+	{
+		bffs_save_fs(&volume);
+	}
+	else if (operation == CUT_CREATE)
+	{
+		bffs_create_file(&volume,"new",RECORD_SIZE,&created);
+	}
+	else
+	{
+		bffs_write_file(&volume,file,RECORD_SIZE,&expected[(CHECKPOINTED_RECORDS+JOURNALED_RECORDS)*RECORD_SIZE]);
+		bffs_flush_file(&volume,file);
+	}
+	return power.written;
+}
+
+int main(void)
+{
+	const fram_addr_t used = (CHECKPOINTED_RECORDS+JOURNALED_RECORDS)*RECORD_SIZE;
+	file_t* file;
+
+	for (fram_addr_t idx = 0; idx<FILE_SIZE; idx++)
+	{
+		expected[idx] = (uint8_t)(idx*29+3);
+	}
+
+	/*Records in the last checkpoint, and more in the journal only*/
+	if ((power_up() == MOUNT_FS_FAILED) || (bffs_reset_fs(&volume) != RESET_FS_SUCCESS) ||
+			(bffs_create_file(&volume,"log",FILE_SIZE,&file) != CREATE_FILE_SUCCESS))
+	{
+		printf("file system setup on %s failed\n",IMAGE_PATH);
+		return 1;
+	}
+	for (uint16_t record = 0; record<CHECKPOINTED_RECORDS+JOURNALED_RECORDS; record++)
+	{
+		if (record == CHECKPOINTED_RECORDS)
+		{
+			bffs_save_fs(&volume);
+		}
+		bffs_write_file(&volume,file,RECORD_SIZE,&expected[record*RECORD_SIZE]);
+		bffs_flush_file(&volume,file);
+	}
+	save_snapshot();
+
+	/*Journal append cut short: the record is either all there or not at all, and the journal goes on after it*/
+	uint32_t append_length = run_cut(CUT_APPEND,UINT32_MAX);
+	uint32_t appended = 0;
+	for (uint32_t cut = 0; cut<=append_length; cut++)
+	{
+		run_cut(CUT_APPEND,cut);
+		check(power_up() == MOUNT_FS_SUCCESS,"mount after a journal append",cut);
+		uint8_t is_appended = is_log_intact(used+RECORD_SIZE);
+		check(is_appended || is_log_intact(used),"log after a journal append",cut);
+		check(is_appended || (cut < append_length),"whole journal append",cut);
+		check(!is_appended || (cut > 0),"journal append with no byte written",cut);
+		check(append_after_power_up(is_appended ? used+RECORD_SIZE : used),"append after a journal append",cut);
+		appended += is_appended;
+	}
+
+	/*Batch cut short: the file slot and the table header records of a new file are replayed together or not at all*/
+	uint32_t create_length = run_cut(CUT_CREATE,UINT32_MAX);
+	uint32_t created = 0;
+	for (uint32_t cut = 0; cut<=create_length; cut++)
+	{
+		run_cut(CUT_CREATE,cut);
+		check(power_up() == MOUNT_FS_SUCCESS,"mount after a file creation",cut);
+		uint8_t is_created = (bffs_open_file(&volume,"new",&file) == OPEN_FILE_SUCCESS);
+		check(bffs_get_fs_total_files(&volume) == 1+is_created,"file count after a file creation",cut);
+		check(is_created || (cut < create_length),"whole file creation",cut);
+		check(is_log_intact(used) && append_after_power_up(used),"log after a file creation",cut);
+		created += is_created;
+	}
+
+	/*Checkpoint cut short: either one of the two saves is whole, or the struct is a mix of both, which must be
+	 reported rather than replayed onto, and kept until the application formats it*/
+	uint32_t checkpoint_length = run_cut(CUT_CHECKPOINT,UINT32_MAX);
+	uint32_t corrupt = 0;
+	for (uint32_t cut = 0; cut<=checkpoint_length; cut++)
+	{
+		run_cut(CUT_CHECKPOINT,cut);
+		bffs_st status = power_up();
+		if (status == MOUNT_FS_CORRUPT)
+		{
+			check((cut > 0) && (cut < checkpoint_length),"corrupt mount after a checkpoint",cut);
+			check((power_up() == MOUNT_FS_CORRUPT) && (bffs_load_fs(&volume) == LOAD_FS_CORRUPT),
+					"corrupt file system left unformatted",cut);
+			check((bffs_reset_fs(&volume) == RESET_FS_SUCCESS) && (power_up() == MOUNT_FS_SUCCESS) &&
+					(bffs_get_fs_total_files(&volume) == 0),"corrupt file system formatted by the application",cut);
+			corrupt++;
+			continue;
+		}
+		check(status == MOUNT_FS_SUCCESS,"mount after a checkpoint",cut);
+		check(is_log_intact(used),"log after a checkpoint",cut);
+		check(append_after_power_up(used),"append after a checkpoint",cut);
+	}
+	check(corrupt > 0,"checkpoints cut short",0);
+
+	close_FRAM_image();
+	remove(IMAGE_PATH);
+	printf("cut at each byte: journal append of %u bytes, %u whole, file creation of %u bytes, %u whole, checkpoint of %u "
+			"bytes, %u corrupt: %s\n",(unsigned)append_length,(unsigned)appended,(unsigned)create_length,(unsigned)created,
+			(unsigned)checkpoint_length,(unsigned)corrupt,errors ? "FAILED" : "ok");
+	return errors ? 1 : 0;
+}
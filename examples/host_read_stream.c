@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "B-FRAM-FileSystem.h"
+#include "fram_driver.h"
+
+/*Host check of read_file_stream. A file is streamed with chunk sizes that do and don't divide its length, from the
+ * host FRAM (asynchronous reads on the driver worker thread) and from a RAM volume whose driver only carries out an
+ * asynchronous read when BFFS waits for it, which shows each chunk being fetched while the consumer has the previous
+ * one and lets the wait give up on a transfer. Build and run on a Linux machine with:
+ *   gcc -IBFFS -Ihost_fram_driver BFFS/B-FRAM-FileSystem.c host_fram_driver/fram_driver.c examples/host_read_stream.c -pthread
+ *   ./a.out
+ */
+
+#define FILE_SIZE 1024
+#define WRITTEN 1000 //bytes written to the file, the rest streaming as 0s
+#define RAM_VOLUME_SIZE 4096
+#define GIVE_UP_WAITS 3 //waits after which the RAM driver gives up on a transfer, in the give up check
+
+/*Need to declare FS struct as a global variable, for the default volume*/
+
+file_system_t BFFS;
+
+static int errors;
+
+static void check(int ok, const char* what)
+{
+	if (!ok)
+	{
+		printf("%s: FAILED\n",what);
+		errors++;
+	}
+}
+
+/*RAM driver of a single device whose asynchronous reads are only started by read_async and carried out, calling
+ * back, by the next wait_async. Set give_up to have wait_async give up after GIVE_UP_WAITS waits instead*/
+typedef struct
+{
+	uint8_t bytes[RAM_VOLUME_SIZE];
+	fram_addr_t address;
+	fram_addr_t data_length;
+	void* data_ptr;
+	fram_callback_t callback;
+	void* callback_ctx;
+	uint8_t pending;
+	uint8_t give_up;
+	uint32_t waits;
+} deferred_fram_t;
+
+static void ram_write_v(void* ctx, uint8_t device, const fram_segment_t* segments, uint16_t segment_count)
+{
+	deferred_fram_t* ram = ctx;
+	(void)device;
+
+	for (uint16_t idx = 0; idx<segment_count; idx++)
+	{
+		memcpy(&ram->bytes[segments[idx].address],segments[idx].data_ptr,segments[idx].data_length);
+	}
+}
+
+static void ram_read_v(void* ctx, uint8_t device, const fram_segment_t* segments, uint16_t segment_count)
+{
+	deferred_fram_t* ram = ctx;
+	(void)device;
+
+	for (uint16_t idx = 0; idx<segment_count; idx++)
+	{
+		memcpy(segments[idx].data_ptr,&ram->bytes[segments[idx].address],segments[idx].data_length);
+	}
+}
+
+static void ram_fill(void* ctx, uint8_t device, fram_addr_t address, fram_addr_t data_length, uint8_t value)
+{
+	deferred_fram_t* ram = ctx;
+	(void)device;
+
+	memset(&ram->bytes[address],value,data_length);
+}
+
+static fram_st ram_read_async(void* ctx, uint8_t device, fram_addr_t address, fram_addr_t data_length, void* data_ptr,
+		fram_callback_t callback, void* callback_ctx)
+{
+	deferred_fram_t* ram = ctx;
+	(void)device;
+
+	if (ram->pending)
+	{
+		return FRAM_BUSY;
+	}
+	ram->address = address;
+	ram->data_length = data_length;
+	ram->data_ptr = data_ptr;
+	ram->callback = callback;
+	ram->callback_ctx = callback_ctx;
+	ram->pending = 1;
+	return FRAM_OK;
+}
+
+static fram_st ram_wait_async(void* ctx)
+{
+	deferred_fram_t* ram = ctx;
+
+	ram->waits++;
+	if (ram->give_up)
+	{
+		/*Stop the transfer, it will never call back*/
+		if (ram->waits >= GIVE_UP_WAITS)
+		{
+			ram->pending = 0;
+			return FRAM_ERROR;
+		}
+		return FRAM_OK;
+	}
+	if (ram->pending)
+	{
+		memcpy(ram->data_ptr,&ram->bytes[ram->address],ram->data_length);
+		ram->pending = 0;
+		ram->callback(FRAM_OK,ram->callback_ctx);
+	}
+	return FRAM_OK;
+}
+
+/*No bus selection and no asynchronous writes*/
+static const bffs_driver_t deferred_driver = {NULL,ram_write_v,ram_read_v,ram_fill,NULL,ram_read_async,ram_wait_async,NULL};
+
+/*Consumer gathering the chunks it is handed, and checking they all have the chunk size but the last*/
+typedef struct
+{
+	uint8_t data[FILE_SIZE];
+	fram_addr_t length;
+	fram_addr_t chunk_size;
+	uint32_t chunks;
+	uint32_t bad_chunks;
+	uint32_t overlapped; //chunks handed over while the RAM driver had the next one in progress
+	const deferred_fram_t* ram;
+} gather_t;
+
+static void gather(const void* chunk_ptr, fram_addr_t chunk_length, void* ctx)
+{
+	gather_t* gathered = ctx;
+
+	if ((chunk_length != gathered->chunk_size) && (gathered->length+chunk_length != WRITTEN) &&
+			(gathered->length+chunk_length != FILE_SIZE))
+	{
+		gathered->bad_chunks++;
+	}
+	if (gathered->length+chunk_length <= FILE_SIZE)
+	{
+		memcpy(&gathered->data[gathered->length],chunk_ptr,chunk_length);
+	}
+	gathered->length += chunk_length;
+	gathered->chunks++;
+	if ((gathered->ram != NULL) && gathered->ram->pending)
+	{
+		gathered->overlapped++;
+	}
+}
+
+/*Stream length bytes of a file from its start and check them against expected, 0s past the written bytes*/
+static bffs_st stream(bffs_t* volume, file_t* file, fram_addr_t length, fram_addr_t chunk_size, const uint8_t* expected,
+		gather_t* gathered)
+{
+	memset(gathered,0,sizeof(*gathered));
+	gathered->chunk_size = chunk_size;
+	gathered->ram = (volume->driver == &deferred_driver) ? volume->driver_ctx : NULL;
+	bffs_st status = bffs_read_file_stream(volume,file,length,chunk_size,gather,gathered);
+	if (status == READ_FILE_SUCCESS)
+	{
+		char what[64];
+
+		snprintf(what,sizeof(what),"stream of %u bytes in chunks of %u",(unsigned)length,(unsigned)chunk_size);
+		check((gathered->length == length) && (gathered->chunks == (uint32_t)((length+chunk_size-1)/chunk_size)) &&
+				!gathered->bad_chunks,what);
+		check(!memcmp(gathered->data,expected,(length < WRITTEN) ? length : WRITTEN),what);
+		for (fram_addr_t idx = WRITTEN; idx<length; idx++)
+		{
+			check(gathered->data[idx] == 0,what);
+		}
+	}
+	return status;
+}
+
+static file_t* create_data_file(bffs_t* volume, const uint8_t* expected)
+{
+	file_t* file;
+
+	if ((bffs_mount_fs(volume) != MOUNT_FS_SUCCESS) || (bffs_reset_fs(volume) != RESET_FS_SUCCESS) ||
+			(bffs_create_file(volume,"data",FILE_SIZE,&file) != CREATE_FILE_SUCCESS) ||
+			(bffs_write_file(volume,file,WRITTEN,(void*)expected) != WRITE_FILE_SUCCESS))
+	{
+		return NULL;
+	}
+	return file;
+}
+
+int main(void)
+{
+	static const fram_addr_t chunk_sizes[] = {1,7,48,READ_STREAM_CHUNK_SIZE};
+	static uint8_t expected[FILE_SIZE];
+	static gather_t gathered;
+	static bffs_t ram_volume;
+	static file_system_t ram_fs;
+	static deferred_fram_t ram;
+	bffs_geometry_t ram_geometry = {0,RAM_VOLUME_SIZE,1};
+	bffs_t* host_volume = get_default_volume();
+	file_t* file;
+
+	for (fram_addr_t idx = 0; idx<FILE_SIZE; idx++)
+	{
+		expected[idx] = (uint8_t)(idx*13+5);
+	}
+
+	/*Host FRAM: the next chunk is read by the driver worker thread while the consumer has the current one*/
+	file = create_data_file(host_volume,expected);
+	if (file == NULL)
+	{
+		printf("host volume setup failed\n");
+		return 1;
+	}
+	for (uint8_t idx = 0; idx<sizeof(chunk_sizes)/sizeof(chunk_sizes[0]); idx++)
+	{
+		check(stream(host_volume,file,WRITTEN,chunk_sizes[idx],expected,&gathered) == READ_FILE_SUCCESS,"host stream");
+	}
+	check(stream(host_volume,file,FILE_SIZE,48,expected,&gathered) == READ_FILE_SUCCESS,"host stream past the write pointer");
+	check(bffs_tell_file(host_volume,file) == 0,"read pointer after streaming");
+
+	/*Invalid chunk sizes and consumers are refused before anything is handed over*/
+	check(stream(host_volume,file,WRITTEN,READ_STREAM_CHUNK_SIZE+1,expected,&gathered) == READ_FILE_BAD_LENGTH,
+			"chunk size above READ_STREAM_CHUNK_SIZE");
+	check(stream(host_volume,file,WRITTEN,0,expected,&gathered) == READ_FILE_BAD_LENGTH,"chunk size of 0");
+	check(stream(host_volume,file,FILE_SIZE+1,48,expected,&gathered) == READ_FILE_OVERFLOW,"stream past the file end");
+	check(gathered.chunks == 0,"consumer of refused streams");
+	check(bffs_read_file_stream(host_volume,file,WRITTEN,48,NULL,NULL) == READ_FILE_INVALID_DATA_PTR,"NULL consumer");
+
+	/*RAM volume: every chunk but the last is handed over while the next one is still being read*/
+	if ((bffs_init(&ram_volume,&ram_fs,&deferred_driver,&ram,&ram_geometry) != INIT_FS_SUCCESS) ||
+			((file = create_data_file(&ram_volume,expected)) == NULL))
+	{
+		printf("RAM volume setup failed\n");
+		return 1;
+	}
+	for (uint8_t idx = 0; idx<sizeof(chunk_sizes)/sizeof(chunk_sizes[0]); idx++)
+	{
+		check(stream(&ram_volume,file,WRITTEN,chunk_sizes[idx],expected,&gathered) == READ_FILE_SUCCESS,"RAM stream");
+		check(gathered.overlapped == gathered.chunks-1,"chunks fetched while the consumer has the previous one");
+	}
+
+	/*A transfer the driver gives up on fails the stream, which can then be run again*/
+	ram.give_up = 1;
+	ram.waits = 0;
+	check(stream(&ram_volume,file,WRITTEN,48,expected,&gathered) == READ_FILE_DRIVER_ERROR,"stream given up on");
+	check(ram.waits == GIVE_UP_WAITS,"waits before giving up");
+	ram.give_up = 0;
+	check(stream(&ram_volume,file,WRITTEN,48,expected,&gathered) == READ_FILE_SUCCESS,"stream after giving up");
+
+	printf("read_file_stream over the host FRAM and a RAM volume: %s\n",errors ? "FAILED" : "ok");
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "B-FRAM-FileSystem.h"
+#include "fram_driver.h"
+
+/*Host stress test of the BFFS lock hooks. Writer threads each append records to their own file and read them back,
+ * while a churn thread creates, deletes and compacts other files under them, moving the writers' files around. Every
+ * record read back is checked, and so is the file system loaded back from FRAM at the end. Build with BFFS_THREAD_SAFE
+ * set and run on a Linux machine with:
+ *   gcc -O2 -DBFFS_THREAD_SAFE=1 -IBFFS -Ihost_fram_driver BFFS/B-FRAM-FileSystem.c host_fram_driver/fram_driver.c examples/host_thread_stress.c -pthread
+ *   ./a.out [rounds]
+ */
+
+#if !BFFS_THREAD_SAFE
+#error "Build this example with -DBFFS_THREAD_SAFE=1"
+#endif
+
+#define WRITERS 4
+#define RECORDS 120 //records appended by a writer per round, filling its file
+#define CHECK_EVERY 16 //records appended between two read backs of the whole file
+#define CHURN_FILES 8
+#define MAX_CHURN_SIZE 200 //churn files are 1 to MAX_CHURN_SIZE bytes
+#define DEFAULT_ROUNDS 200
+
+/*Need to declare FS struct as a global variable*/
+
+file_system_t BFFS;
+
+typedef struct
+{
+	uint16_t writer;
+	uint16_t round;
+	uint32_t seq;
+} record_t;
+
+static uint32_t rounds = DEFAULT_ROUNDS;
+static int writers_done;
+static int errors;
+
+/*Lock hooks over pthread reader-writer locks*/
+static void* rwlock_create(void)
+{
+	pthread_rwlock_t* lock = malloc(sizeof(pthread_rwlock_t));
+	if ((lock != NULL) && pthread_rwlock_init(lock,NULL))
+	{
+		free(lock);
+		return NULL;
+	}
+	return lock;
+}
+
+static void rwlock_lock(void* lock, uint8_t shared)
+{
+	if (shared)
+	{
+		pthread_rwlock_rdlock(lock);
+	}
+	else
+	{
+		pthread_rwlock_wrlock(lock);
+	}
+}
+
+static void rwlock_unlock(void* lock, uint8_t shared)
+{
+	(void)shared;
+	pthread_rwlock_unlock(lock);
+}
+
+static const bffs_lock_hooks_t rwlock_hooks = {rwlock_create,rwlock_lock,rwlock_unlock};
+
+static void fail(const char* what, uint16_t writer, uint32_t round)
+{
+	printf("writer %u round %u: %s\n",writer,round,what);
+	__atomic_fetch_add(&errors,1,__ATOMIC_RELAXED);
+}
+
+/*Check the first count records of a writer file hold the sequence written in a round*/
+static int check_records(file_t* file, uint16_t writer, uint16_t round, uint32_t count)
+{
+	record_t records[RECORDS];
+
+	if (get_file_used_bytes(file) != count*sizeof(record_t))
+	{
+		return 0;
+	}
+	if ((seek_file(file,0) != SEEK_FILE_SUCCESS) ||
+			(read_file(file,count*sizeof(record_t),records,READ_FILE_RESET_READ_PTR) != READ_FILE_SUCCESS))
+	{
+		return 0;
+	}
+	for (uint32_t idx = 0; idx<count; idx++)
+	{
+		if ((records[idx].writer != writer) || (records[idx].round != round) || (records[idx].seq != idx))
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static void* writer_thread(void* arg)
+{
+	uint16_t writer = (uint16_t)(uintptr_t)arg;
+	char name[MAX_FILENAME_SIZE+1];
+	file_t* file;
+
+	snprintf(name,sizeof(name),"w%u",writer);
+	if (open_file(name,&file) != OPEN_FILE_SUCCESS)
+	{
+		fail("open failed",writer,0);
+		return NULL;
+	}
+	for (uint32_t round = 0; round<rounds; round++)
+	{
+		if (clear_file(file) != CLEAR_FILE_SUCCESS)
+		{
+			fail("clear failed",writer,round);
+			return NULL;
+		}
+		for (uint32_t seq = 0; seq<RECORDS; seq++)
+		{
+			record_t record = {writer,(uint16_t)round,seq};
+			if (write_file(file,sizeof(record),&record) != WRITE_FILE_SUCCESS)
+			{
+				fail("write failed",writer,round);
+				return NULL;
+			}
+			if (((seq+1)%CHECK_EVERY == 0) && !check_records(file,writer,(uint16_t)round,seq+1))
+			{
+				fail("read back mismatch",writer,round);
+				return NULL;
+			}
+		}
+	}
+	return NULL;
+}
+
+/*Creates and deletes files between the writer files and compacts the free space they leave, which moves the writer
+ files while they are in use*/
+static void* churn_thread(void* arg)
+{
+	uint8_t live[CHURN_FILES] = {0};
+	char name[MAX_FILENAME_SIZE+1];
+	uint32_t* operations = arg;
+	file_t* file;
+
+	while (!__atomic_load_n(&writers_done,__ATOMIC_RELAXED))
+	{
+		uint16_t idx = rand()%CHURN_FILES;
+
+		snprintf(name,sizeof(name),"c%u",idx);
+		if (live[idx])
+		{
+			live[idx] = (delete_file(name) != DELETE_FILE_SUCCESS);
+		}
+		else
+		{
+			live[idx] = (create_file(name,1+rand()%MAX_CHURN_SIZE,&file) == CREATE_FILE_SUCCESS);
+		}
+		if (rand()%4 == 0)
+		{
+			compact_fs_step(64);
+		}
+		(*operations)++;
+	}
+	return NULL;
+}
+
+int main(int argc, char** argv)
+{
+	pthread_t writers[WRITERS];
+	pthread_t churn;
+	uint32_t churn_operations = 0;
+	char name[MAX_FILENAME_SIZE+1];
+	struct timespec start, end;
+	file_t* file;
+
+	if (argc > 1)
+	{
+		rounds = (uint32_t)strtoul(argv[1],NULL,10);
+	}
+	srand(1);
+	/*Locks are set before anything else is called*/
+	if (set_fs_lock_hooks(&rwlock_hooks) != SET_LOCK_HOOKS_SUCCESS)
+		return 1;
+	if (mount_fs() != MOUNT_FS_SUCCESS)
+		return 1;
+	reset_fs();
+	/*Each writer file follows a pad file deleted before the threads start, so compaction has them all to move*/
+	for (uint16_t writer = 0; writer<WRITERS; writer++)
+	{
+		snprintf(name,sizeof(name),"p%u",writer);
+		if (create_file(name,64,&file) != CREATE_FILE_SUCCESS)
+			return 1;
+		snprintf(name,sizeof(name),"w%u",writer);
+		if (create_file(name,RECORDS*sizeof(record_t),&file) != CREATE_FILE_SUCCESS)
+			return 1;
+	}
+	for (uint16_t writer = 0; writer<WRITERS; writer++)
+	{
+		snprintf(name,sizeof(name),"p%u",writer);
+		delete_file(name);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC,&start);
+	pthread_create(&churn,NULL,churn_thread,&churn_operations);
+	for (uint16_t writer = 0; writer<WRITERS; writer++)
+	{
+		pthread_create(&writers[writer],NULL,writer_thread,(void*)(uintptr_t)writer);
+	}
+	for (uint16_t writer = 0; writer<WRITERS; writer++)
+	{
+		pthread_join(writers[writer],NULL);
+	}
+	__atomic_store_n(&writers_done,1,__ATOMIC_RELAXED);
+	pthread_join(churn,NULL);
+	clock_gettime(CLOCK_MONOTONIC,&end);
+
+	/*What is in FRAM must be what the threads left in RAM*/
+	if (load_fs() != LOAD_FS_SUCCESS)
+	{
+		printf("file system can't be loaded back\n");
+		errors++;
+	}
+	for (uint16_t writer = 0; writer<WRITERS; writer++)
+	{
+		snprintf(name,sizeof(name),"w%u",writer);
+		if ((open_file(name,&file) != OPEN_FILE_SUCCESS) || !check_records(file,writer,(uint16_t)(rounds-1),RECORDS))
+		{
+			fail("loaded file mismatch",writer,rounds-1);
+		}
+	}
+
+	printf("%u writers x %u rounds of %u records, %u churn operations in %.3f s, %u free extents left: %s\n",
+			WRITERS,rounds,RECORDS,churn_operations,
+			(end.tv_sec-start.tv_sec)+(end.tv_nsec-start.tv_nsec)/1e9,get_fs_free_extents(),
+			errors ? "FAILED" : "ok");
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,273 @@
+#include "main.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "B-FRAM-FileSystem.h"
+#include "fram_driver.h"
+
+/*Benchmark of filename lookups: for every file count from 1 to MAX_FILES, time open_file (which uses the
+ * in-RAM filename index) against a linear strcmp scan over the file table, for both hits and misses.
+ * Timing uses the Cortex-M7 DWT cycle counter, so results are in CPU cycles. Raise MAX_FILES (and FS_INDEX_SIZE)
+ * in B-FRAM-FileSystem.h to see how both approaches scale with the size of the file table.
+ */
+
+#define LOOKUP_REPEATS 16 //Lookups of each file per measurement
+
+SPI_HandleTypeDef hspi1;
+
+UART_HandleTypeDef huart2;
+DMA_HandleTypeDef hdma_usart2_rx;
+
+void SystemClock_Config(void);
+static void MX_GPIO_Init(void);
+static void MX_USART2_UART_Init(void);
+static void MX_SPI1_Init(void);
+
+/*Need to declare FS struct as a global variable*/
+
+file_system_t BFFS;
+
+/*Function to facilitate debugging through uart2, adapt to your needs */
+int stm32printf(const char *format, ...)
+{
+    char str[200];
+    va_list args;
+    va_start(args, format);
+    int n = vsprintf(str, format, args);
+    va_end(args);
+    HAL_UART_Transmit(&huart2, (uint8_t *)str, n, HAL_MAX_DELAY);
+    return n;
+}
+
+/*Lookup as open_file used to do it before the filename index, kept as a reference*/
+static file_t* linear_lookup(char* filename)
+{
+	for (uint16_t search_idx =0; search_idx<MAX_FILES; search_idx++)
+	{
+		if (!strncmp(filename,BFFS.files[search_idx].filename,MAX_FILENAME_SIZE))
+		{
+			return &(BFFS.files[search_idx]);
+		}
+	}
+	return NULL;
+}
+
+int main(void)
+{
+	HAL_Init();
+	SystemClock_Config();
+
+	MX_GPIO_Init();
+	MX_USART2_UART_Init();
+	MX_SPI1_Init();
+
+	HAL_GPIO_WritePin(GPIOA, GPIO_PIN_0, GPIO_PIN_SET);
+
+	/*Enable the DWT cycle counter*/
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	file_t* file;
+	char filename[MAX_FILENAME_SIZE+1];
+	char missing_filename[] = "missing";
+
+	if (mount_fs() != MOUNT_FS_SUCCESS)
+		while(1);
+	if (reset_fs() != RESET_FS_SUCCESS)
+		while(1);
+
+	stm32printf("files;index hit;linear hit;index miss;linear miss (cycles per lookup)\n");
+
+	for (uint16_t file_count = 1; file_count <= MAX_FILES; file_count++)
+	{
+		sprintf(filename,"f%u",file_count-1);
+		if (create_file(filename,1,&file) != CREATE_FILE_SUCCESS)
+			while(1);
+
+		uint32_t index_hit = 0, linear_hit = 0, index_miss = 0, linear_miss = 0;
+		uint32_t start;
+
+		for (uint16_t repeat = 0; repeat < LOOKUP_REPEATS; repeat++)
+		{
+			for (uint16_t idx = 0; idx < file_count; idx++)
+			{
+				sprintf(filename,"f%u",idx);
+
+				start = DWT->CYCCNT;
+				open_file(filename,&file);
+				index_hit += DWT->CYCCNT-start;
+
+				start = DWT->CYCCNT;
+				linear_lookup(filename);
+				linear_hit += DWT->CYCCNT-start;
+			}
+			start = DWT->CYCCNT;
+			open_file(missing_filename,&file);
+			index_miss += DWT->CYCCNT-start;
+
+			start = DWT->CYCCNT;
+			linear_lookup(missing_filename);
+			linear_miss += DWT->CYCCNT-start;
+		}
+
+		stm32printf("%u;%lu;%lu;%lu;%lu\n",
+				file_count,
+				index_hit/(LOOKUP_REPEATS*file_count),
+				linear_hit/(LOOKUP_REPEATS*file_count),
+				index_miss/LOOKUP_REPEATS,
+				linear_miss/LOOKUP_REPEATS);
+	}
+
+	while(1);
+}
+
+/**
+  * @brief System Clock Configuration
+  * @retval None
+  */
+void SystemClock_Config(void)
+{
+  RCC_OscInitTypeDef RCC_OscInitStruct = {0};
+  RCC_ClkInitTypeDef RCC_ClkInitStruct = {0};
+
+  /** Configure the main internal regulator output voltage
+  */
+  __HAL_RCC_PWR_CLK_ENABLE();
+  __HAL_PWR_VOLTAGESCALING_CONFIG(PWR_REGULATOR_VOLTAGE_SCALE3);
+
+  /** Initializes the RCC Oscillators according to the specified parameters
+  * in the RCC_OscInitTypeDef structure.
+  */
+  RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_HSI;
+  RCC_OscInitStruct.HSIState = RCC_HSI_ON;
+  RCC_OscInitStruct.HSICalibrationValue = RCC_HSICALIBRATION_DEFAULT;
+  RCC_OscInitStruct.PLL.PLLState = RCC_PLL_NONE;
+  if (HAL_RCC_OscConfig(&RCC_OscInitStruct) != HAL_OK)
+  {
+    Error_Handler();
+  }
+
+  /** Initializes the CPU, AHB and APB buses clocks
+  */
+  RCC_ClkInitStruct.ClockType = RCC_CLOCKTYPE_HCLK|RCC_CLOCKTYPE_SYSCLK
+                              |RCC_CLOCKTYPE_PCLK1|RCC_CLOCKTYPE_PCLK2;
+  RCC_ClkInitStruct.SYSCLKSource = RCC_SYSCLKSOURCE_HSI;
+  RCC_ClkInitStruct.AHBCLKDivider = RCC_SYSCLK_DIV1;
+  RCC_ClkInitStruct.APB1CLKDivider = RCC_HCLK_DIV1;
+  RCC_ClkInitStruct.APB2CLKDivider = RCC_HCLK_DIV1;
+
+  if (HAL_RCC_ClockConfig(&RCC_ClkInitStruct, FLASH_LATENCY_0) != HAL_OK)
+  {
+    Error_Handler();
+  }
+}
+
+/**
+  * @brief SPI1 Initialization Function
+  * @param None
+  * @retval None
+  */
+static void MX_SPI1_Init(void)
+{
+
+
+  /* SPI1 parameter configuration*/
+  hspi1.Instance = SPI1;
+  hspi1.Init.Mode = SPI_MODE_MASTER;
+  hspi1.Init.Direction = SPI_DIRECTION_2LINES;
+  hspi1.Init.DataSize = SPI_DATASIZE_8BIT;
+  hspi1.Init.CLKPolarity = SPI_POLARITY_LOW;
+  hspi1.Init.CLKPhase = SPI_PHASE_1EDGE;
+  hspi1.Init.NSS = SPI_NSS_SOFT;
+  hspi1.Init.BaudRatePrescaler = SPI_BAUDRATEPRESCALER_4;
+  hspi1.Init.FirstBit = SPI_FIRSTBIT_MSB;
+  hspi1.Init.TIMode = SPI_TIMODE_DISABLE;
+  hspi1.Init.CRCCalculation = SPI_CRCCALCULATION_DISABLE;
+  hspi1.Init.CRCPolynomial = 7;
+  hspi1.Init.CRCLength = SPI_CRC_LENGTH_DATASIZE;
+  hspi1.Init.NSSPMode = SPI_NSS_PULSE_DISABLE;
+  if (HAL_SPI_Init(&hspi1) != HAL_OK)
+  {
+    Error_Handler();
+  }
+
+}
+
+/**
+  * @brief USART2 Initialization Function
+  * @param None
+  * @retval None
+  */
+static void MX_USART2_UART_Init(void)
+{
+
+  huart2.Instance = USART2;
+  huart2.Init.BaudRate = 115200;
+  huart2.Init.WordLength = UART_WORDLENGTH_8B;
+  huart2.Init.StopBits = UART_STOPBITS_1;
+  huart2.Init.Parity = UART_PARITY_NONE;
+  huart2.Init.Mode = UART_MODE_TX_RX;
+  huart2.Init.HwFlowCtl = UART_HWCONTROL_NONE;
+  huart2.Init.OverSampling = UART_OVERSAMPLING_16;
+  huart2.Init.OneBitSampling = UART_ONE_BIT_SAMPLE_DISABLE;
+  huart2.AdvancedInit.AdvFeatureInit = UART_ADVFEATURE_NO_INIT;
+  if (HAL_UART_Init(&huart2) != HAL_OK)
+  {
+    Error_Handler();
+  }
+
+}
+
+static void MX_GPIO_Init(void)
+{
+  GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+  /* GPIO Ports Clock Enable */
+  __HAL_RCC_GPIOA_CLK_ENABLE();
+
+  /*Configure GPIO pin Output Level */
+  HAL_GPIO_WritePin(GPIOA, GPIO_PIN_0, GPIO_PIN_SET);
+
+  /*Configure GPIO pin : PA0 */
+  GPIO_InitStruct.Pin = GPIO_PIN_0;
+  GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+  GPIO_InitStruct.Pull = GPIO_NOPULL;
+  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+  HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+
+}
+
+
+/**
+  * @brief  This function is executed in case of error occurrence.
+  * @retval None
+  */
+void Error_Handler(void)
+{
+  /* USER CODE BEGIN Error_Handler_Debug */
+  /* User can add his own implementation to report the HAL error return state */
+  __disable_irq();
+  while (1)
+  {
+  }
+  /* USER CODE END Error_Handler_Debug */
+}
+
+#ifdef  USE_FULL_ASSERT
+/**
+  * @brief  Reports the name of the source file and the source line number
+  *         where the assert_param error has occurred.
+  * @param  file: pointer to the source file name
+  * @param  line: assert_param error line source number
+  * @retval None
+  */
+void assert_failed(uint8_t *file, uint32_t line)
+{
+  /* USER CODE BEGIN 6 */
+  /* User can add his own implementation to report the file name and line number,
+     ex: printf("Wrong parameters value: file %s on line %d\r\n", file, line) */
+  /* USER CODE END 6 */
+}
+#endif /* USE_FULL_ASSERT */
@@ -51,10 +51,11 @@ int main(void)
 	HAL_GPIO_WritePin(GPIOA, GPIO_PIN_0, GPIO_PIN_SET);
 
 	stm32printf("FRAM Size: %d\n",FRAM_SIZE);
-	stm32printf("File Struct Size: %d\n",FILE_STRCT_SIZE);
+	stm32printf("File Struct Size: %d\n",(int)FILE_STRCT_SIZE);
 	stm32printf("Max Files: %d\n",MAX_FILES);
-	stm32printf("FS Struct Size =(Max Files*File Size)+8 = FS_OFFSET: %d\n",FS_STRCT_SIZE);
-	stm32printf("Usable Size: FRAM Size - FS Size = %d \n",USABLE_SIZE);
+	stm32printf("FS Struct Size: %d\n",(int)FS_STRCT_SIZE);
+	stm32printf("FS Offset: FS Size + Journal Size = %d\n",(int)FS_OFFSET);
+	stm32printf("Usable Size: FRAM Size - FS Offset = %d \n",(int)USABLE_SIZE);
 	stm32printf("--------------------------------\n");
 
 	bffs_st status;
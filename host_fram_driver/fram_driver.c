@@ -0,0 +1,381 @@
+/*
+ * fram_driver.c
+ *
+ * Host stand-in for the FRAM driver: the FRAM devices are a RAM buffer (or a memory mapped image file), one after the
+ * other, and asynchronous transfers are carried out by a worker thread, which is started on the first asynchronous
+ * call and serves the buses in turn.
+ *
+ *  Created on: 17/10/2026
+ *      Author: hugobpontes
+ */
+#include "fram_driver.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*Mimics the MB85RS64V RDID response: Fujitsu manufacturer ID, continuation code and product ID*/
+static const uint8_t fram_id[4] = {0x04, 0x7F, 0x03, 0x02};
+
+#define FRAM_TOTAL_SIZE ((FRAM_SIZE)*(FRAM_DEVICES)) //Bytes of all the devices, device d starting at d*FRAM_SIZE
+
+static uint8_t fram_ram[FRAM_TOTAL_SIZE];
+static uint8_t* fram = fram_ram;
+static int image_fd = -1;
+
+/*Defaults match the SPI1 setup of the STM32 example: 16 MHz HSI with a /4 prescaler*/
+static fram_bus_config_t bus_config = {4000000, 50, 0};
+static fram_bus_cost_t bus_cost;
+static pthread_mutex_t cost_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*Asynchronous transfer handed to the worker thread*/
+typedef struct
+{
+	uint8_t pending;
+	uint8_t device;
+	uint8_t is_write;
+	fram_addr_t address;
+	fram_addr_t data_length;
+	void* data_ptr;
+	fram_callback_t callback;
+	void* ctx;
+} fram_request_t;
+
+static pthread_once_t worker_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t worker_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t worker_cond = PTHREAD_COND_INITIALIZER;
+static fram_request_t requests[FRAM_BUSES];
+static uint8_t busy[FRAM_BUSES];
+
+uint8_t get_FRAM_bus(uint8_t device)
+{
+	return device%FRAM_BUSES;
+}
+
+/*Get where a device's bytes start in the FRAM contents*/
+static uint8_t* FRAM_Device(uint8_t device)
+{
+	return fram+(size_t)device*FRAM_SIZE;
+}
+
+/*Account one CS low..high frame carrying the given bytes on the bus model, on the bus of device*/
+static void FRAM_Account_Frame(uint8_t device,uint8_t opcode_bytes,uint8_t address_bytes,uint32_t write_bytes,uint32_t read_bytes)
+{
+	pthread_mutex_lock(&cost_lock);
+	uint64_t bits = 8ull*(opcode_bytes+address_bytes+write_bytes+read_bytes);
+	uint64_t frame_ns = (bits*1000000000ull)/bus_config.clock_hz + 2ull*bus_config.cs_toggle_ns + bus_config.transaction_ns;
+
+	bus_cost.transactions++;
+	bus_cost.cs_toggles += 2;
+	bus_cost.opcode_bytes += opcode_bytes;
+	bus_cost.address_bytes += address_bytes;
+	bus_cost.write_bytes += write_bytes;
+	bus_cost.read_bytes += read_bytes;
+	bus_cost.bus_ns += frame_ns;
+	bus_cost.bus_busy_ns[get_FRAM_bus(device)] += frame_ns;
+	pthread_mutex_unlock(&cost_lock);
+}
+
+/*A write is framed as in spi_fram_driver: WREN, WRITE+address+data, WRDI*/
+static void FRAM_Account_Write(uint8_t device,uint32_t data_length)
+{
+	FRAM_Account_Frame(device,1,0,0,0);
+	FRAM_Account_Frame(device,1,FRAM_ADDR_BYTES,data_length,0);
+	FRAM_Account_Frame(device,1,0,0,0);
+}
+
+static void FRAM_Account_Read(uint8_t device,uint32_t data_length)
+{
+	FRAM_Account_Frame(device,1,FRAM_ADDR_BYTES,0,data_length);
+}
+
+/*Map an image file as the FRAM contents, so they persist across runs. The file is created (zeroed) or extended to
+ FRAM_SIZE bytes per device if needed. Returns 0 on success and -1 on failure, in which case the RAM buffer stays in use */
+int open_FRAM_image(const char* path)
+{
+	struct stat st;
+	void* image;
+	int fd;
+
+	close_FRAM_image();
+	fd = open(path, O_RDWR|O_CREAT, 0644);
+	if (fd < 0)
+	{
+		return -1;
+	}
+	if ((fstat(fd, &st) != 0) || ((st.st_size < FRAM_TOTAL_SIZE) && (ftruncate(fd, FRAM_TOTAL_SIZE) != 0)))
+	{
+		close(fd);
+		return -1;
+	}
+	image = mmap(NULL, FRAM_TOTAL_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	if (image == MAP_FAILED)
+	{
+		close(fd);
+		return -1;
+	}
+	fram = image;
+	image_fd = fd;
+	return 0;
+}
+
+/*Flush and unmap the image file, if any, and go back to the RAM buffer*/
+void close_FRAM_image(void)
+{
+	if (image_fd < 0)
+	{
+		return;
+	}
+	msync(fram, FRAM_TOTAL_SIZE, MS_SYNC);
+	munmap(fram, FRAM_TOTAL_SIZE);
+	close(image_fd);
+	image_fd = -1;
+	fram = fram_ram;
+}
+
+void set_FRAM_bus_config(const fram_bus_config_t* config)
+{
+	pthread_mutex_lock(&cost_lock);
+	bus_config = *config;
+	pthread_mutex_unlock(&cost_lock);
+}
+
+void get_FRAM_bus_config(fram_bus_config_t* config)
+{
+	pthread_mutex_lock(&cost_lock);
+	*config = bus_config;
+	pthread_mutex_unlock(&cost_lock);
+}
+
+void get_FRAM_bus_cost(fram_bus_cost_t* cost)
+{
+	pthread_mutex_lock(&cost_lock);
+	*cost = bus_cost;
+	pthread_mutex_unlock(&cost_lock);
+}
+
+void reset_FRAM_bus_cost(void)
+{
+	pthread_mutex_lock(&cost_lock);
+	memset(&bus_cost, 0, sizeof(bus_cost));
+	pthread_mutex_unlock(&cost_lock);
+}
+
+void get_FRAM_ID(uint8_t device,void* data_ptr)
+{
+	FRAM_Account_Frame(device,1,0,0,sizeof(fram_id));
+	memcpy(data_ptr, fram_id, sizeof(fram_id));
+}
+
+void write_FRAM(uint8_t device,fram_addr_t address,fram_addr_t data_length,void* data_ptr)
+{
+	FRAM_Account_Write(device,data_length);
+	if ((uint64_t)address+data_length <= FRAM_SIZE)
+	{
+		memcpy(&FRAM_Device(device)[address], data_ptr, data_length);
+	}
+}
+
+void read_FRAM(uint8_t device,fram_addr_t address,fram_addr_t data_length,void* data_ptr)
+{
+	FRAM_Account_Read(device,data_length);
+	if ((uint64_t)address+data_length <= FRAM_SIZE)
+	{
+		memcpy(data_ptr, &FRAM_Device(device)[address], data_length);
+	}
+}
+
+void fill_FRAM(uint8_t device,fram_addr_t address,fram_addr_t data_length,uint8_t value)
+{
+	FRAM_Account_Write(device,data_length);
+	if ((uint64_t)address+data_length <= FRAM_SIZE)
+	{
+		memset(&FRAM_Device(device)[address], value, data_length);
+	}
+}
+
+/*Get how many segments, starting at the first one, are contiguous in FRAM and can thus share a single transaction*/
+static uint16_t FRAM_Contiguous_Segments(const fram_segment_t* segments,uint16_t segment_count)
+{
+	uint16_t count = 1;
+	while ((count < segment_count) &&
+		   (segments[count].address == segments[count-1].address+segments[count-1].data_length))
+	{
+		count++;
+	}
+	return count;
+}
+
+/*Framed as in spi_fram_driver: WREN and WRITE+address+data for each group of contiguous segments, then one WRDI*/
+void write_FRAM_v(uint8_t device,const fram_segment_t* segments,uint16_t segment_count)
+{
+	uint8_t* device_fram = FRAM_Device(device);
+
+	if (!segment_count)
+	{
+		return;
+	}
+	while (segment_count)
+	{
+		uint16_t group = FRAM_Contiguous_Segments(segments, segment_count);
+		uint32_t group_length = 0;
+
+		for (uint16_t idx = 0; idx < group; idx++)
+		{
+			if ((uint64_t)segments[idx].address+segments[idx].data_length <= FRAM_SIZE)
+			{
+				memcpy(&device_fram[segments[idx].address], segments[idx].data_ptr, segments[idx].data_length);
+			}
+			group_length += segments[idx].data_length;
+		}
+		FRAM_Account_Frame(device,1,0,0,0);
+		FRAM_Account_Frame(device,1,FRAM_ADDR_BYTES,group_length,0);
+
+		segments += group;
+		segment_count -= group;
+	}
+	FRAM_Account_Frame(device,1,0,0,0);
+}
+
+/*Framed as in spi_fram_driver: READ+address+data for each group of contiguous segments*/
+void read_FRAM_v(uint8_t device,const fram_segment_t* segments,uint16_t segment_count)
+{
+	uint8_t* device_fram = FRAM_Device(device);
+
+	while (segment_count)
+	{
+		uint16_t group = FRAM_Contiguous_Segments(segments, segment_count);
+		uint32_t group_length = 0;
+
+		for (uint16_t idx = 0; idx < group; idx++)
+		{
+			if ((uint64_t)segments[idx].address+segments[idx].data_length <= FRAM_SIZE)
+			{
+				memcpy(segments[idx].data_ptr, &device_fram[segments[idx].address], segments[idx].data_length);
+			}
+			group_length += segments[idx].data_length;
+		}
+		FRAM_Account_Read(device,group_length);
+
+		segments += group;
+		segment_count -= group;
+	}
+}
+
+/*Find the first bus with a pending request, going round from *bus. Returns 0 if there is none*/
+static uint8_t FRAM_Pending_Bus(uint8_t* bus)
+{
+	for (uint8_t idx = 0; idx < FRAM_BUSES; idx++)
+	{
+		uint8_t candidate = (*bus+idx)%FRAM_BUSES;
+		if (requests[candidate].pending)
+		{
+			*bus = candidate;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*Worker thread: waits for a request on any bus, carries it out and calls back. Buses are served in turn, so each
+ one's transfers get through while the others are busy. A bus is marked idle before calling back so the callback can
+ start its next transfer */
+static void* FRAM_Worker(void* arg)
+{
+	uint8_t bus = 0;
+	(void)arg;
+	for (;;)
+	{
+		fram_request_t current;
+		fram_st status = FRAM_OK;
+
+		pthread_mutex_lock(&worker_lock);
+		while (!FRAM_Pending_Bus(&bus))
+		{
+			pthread_cond_wait(&worker_cond, &worker_lock);
+		}
+		current = requests[bus];
+		requests[bus].pending = 0;
+		pthread_mutex_unlock(&worker_lock);
+
+		if ((uint64_t)current.address+current.data_length > FRAM_SIZE)
+		{
+			status = FRAM_ERROR;
+		}
+		else if (current.is_write)
+		{
+			memcpy(&FRAM_Device(current.device)[current.address], current.data_ptr, current.data_length);
+		}
+		else
+		{
+			memcpy(current.data_ptr, &FRAM_Device(current.device)[current.address], current.data_length);
+		}
+
+		pthread_mutex_lock(&worker_lock);
+		busy[bus] = 0;
+		pthread_mutex_unlock(&worker_lock);
+
+		if (current.callback != NULL)
+		{
+			current.callback(status, current.ctx);
+		}
+		bus = (bus+1)%FRAM_BUSES;
+	}
+	return NULL;
+}
+
+static void FRAM_Start_Worker(void)
+{
+	pthread_t worker;
+	pthread_create(&worker, NULL, FRAM_Worker, NULL);
+	pthread_detach(worker);
+}
+
+static fram_st FRAM_Submit(uint8_t device,uint8_t is_write,fram_addr_t address,fram_addr_t data_length,void* data_ptr,fram_callback_t callback,void* ctx)
+{
+	uint8_t bus = get_FRAM_bus(device);
+	fram_request_t* request = &requests[bus];
+
+	pthread_once(&worker_once, FRAM_Start_Worker);
+
+	pthread_mutex_lock(&worker_lock);
+	if (busy[bus])
+	{
+		pthread_mutex_unlock(&worker_lock);
+		return FRAM_BUSY;
+	}
+	busy[bus] = 1;
+	request->device = device;
+	request->is_write = is_write;
+	request->address = address;
+	request->data_length = data_length;
+	request->data_ptr = data_ptr;
+	request->callback = callback;
+	request->ctx = ctx;
+	request->pending = 1;
+	pthread_cond_signal(&worker_cond);
+	pthread_mutex_unlock(&worker_lock);
+
+	if (is_write)
+	{
+		FRAM_Account_Write(device,data_length);
+	}
+	else
+	{
+		FRAM_Account_Read(device,data_length);
+	}
+	return FRAM_OK;
+}
+
+fram_st write_FRAM_async(uint8_t device,fram_addr_t address,fram_addr_t data_length,void* data_ptr,fram_callback_t callback,void* ctx)
+{
+	return FRAM_Submit(device, 1, address, data_length, data_ptr, callback, ctx);
+}
+
+fram_st read_FRAM_async(uint8_t device,fram_addr_t address,fram_addr_t data_length,void* data_ptr,fram_callback_t callback,void* ctx)
+{
+	return FRAM_Submit(device, 0, address, data_length, data_ptr, callback, ctx);
+}
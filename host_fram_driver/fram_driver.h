@@ -0,0 +1,101 @@
+/*
+ * fram_driver.h
+ *
+ * Host (Linux/POSIX) stand-in for the FRAM driver, backed by a RAM buffer or by a memory mapped image file.
+ * Every call is also accounted on a model of the SPI bus of spi_fram_driver (opcode and address bytes, chip select
+ * toggles, clock rate), so the on-target bus time of any BFFS call sequence can be estimated on a Linux box.
+ * Asynchronous transfers complete on a worker thread, so BFFS code using them can be run and tested off-target.
+ * Link with -pthread.
+ *
+ *  Created on: 17/10/2026
+ *      Author: hugobpontes
+ */
+
+#ifndef INC_FRAM_DRIVER_H_
+#define INC_FRAM_DRIVER_H_
+
+#ifndef FRAM_SIZE
+#define FRAM_SIZE 8192 //Sizes in bytes of each FRAM, can be set from the command line to model other parts
+#endif
+#ifndef FRAM_ADDR_BYTES
+#define FRAM_ADDR_BYTES 2 //Address bytes sent after the READ and WRITE opcodes: 2 up to 64 KB, 3 (or 4) for larger parts
+#endif
+#ifndef FRAM_DEVICES
+#define FRAM_DEVICES 1 //FRAM chips, can be set from the command line to model striped setups
+#endif
+#ifndef FRAM_BUSES
+#define FRAM_BUSES 1 //SPI buses the chips are spread over, device d being on bus d%FRAM_BUSES
+#endif
+
+#include <stdint.h>
+
+/*FRAM address and length type: 16 bits unless the parts need wider addresses or all of them together exceed 64 KB,
+ so small setups keep compact pointers*/
+#if (FRAM_ADDR_BYTES > 2) || ((FRAM_SIZE)*(FRAM_DEVICES) > 65535)
+typedef uint32_t fram_addr_t;
+#define FRAM_ADDR_MAX UINT32_MAX
+#else
+typedef uint16_t fram_addr_t;
+#define FRAM_ADDR_MAX UINT16_MAX
+#endif
+
+/*Segment of a vectored transfer: data_length bytes at data_ptr are written to (or read from) the FRAM at address*/
+typedef struct
+{
+	fram_addr_t address;
+	fram_addr_t data_length;
+	void* data_ptr;
+} fram_segment_t;
+
+/*Status of an asynchronous driver transfer*/
+typedef enum
+{
+	FRAM_OK,	//transfer started (when returned) or completed (when passed to the callback)
+	FRAM_BUSY,	//another asynchronous transfer is still in progress on the bus, nothing was started
+	FRAM_ERROR,	//the transfer went out of the FRAM bounds
+} fram_st;
+
+/*Called once an asynchronous transfer completes, from the driver worker thread*/
+typedef void (*fram_callback_t)(fram_st status, void* ctx);
+
+/*Parameters of the modelled SPI bus*/
+typedef struct
+{
+	uint32_t clock_hz;			//SPI clock frequency
+	uint32_t cs_toggle_ns;		//time taken by each chip select edge, including setup/hold and deselect times
+	uint32_t transaction_ns;	//fixed software cost of each CS low..high frame (HAL call overhead, DMA setup...)
+} fram_bus_config_t;
+
+/*Bus traffic accounted since the last reset_FRAM_bus_cost*/
+typedef struct
+{
+	uint32_t transactions;	//CS low..high frames
+	uint32_t cs_toggles;	//CS edges
+	uint32_t opcode_bytes;	//WREN, WRDI, WRITE, READ and RDID bytes
+	uint32_t address_bytes;
+	uint32_t write_bytes;	//data bytes sent to the FRAM
+	uint32_t read_bytes;	//data bytes received from the FRAM
+	uint64_t bus_ns;		//estimated bus time given the bus config
+	uint64_t bus_busy_ns[FRAM_BUSES];	//share of bus_ns taken on each bus, buses being able to transfer at the same time
+} fram_bus_cost_t;
+
+/*Every function takes the index of the FRAM device (0 to FRAM_DEVICES-1) it talks to, addresses being within that
+ device. Asynchronous transfers on different buses can be in progress at the same time*/
+uint8_t get_FRAM_bus(uint8_t device);
+void get_FRAM_ID(uint8_t device,void* data_ptr);
+void write_FRAM(uint8_t device,fram_addr_t address,fram_addr_t data_length,void* data_ptr);
+void read_FRAM(uint8_t device,fram_addr_t address,fram_addr_t data_length,void* data_ptr);
+void fill_FRAM(uint8_t device,fram_addr_t address,fram_addr_t data_length,uint8_t value);
+void write_FRAM_v(uint8_t device,const fram_segment_t* segments,uint16_t segment_count);
+void read_FRAM_v(uint8_t device,const fram_segment_t* segments,uint16_t segment_count);
+fram_st write_FRAM_async(uint8_t device,fram_addr_t address,fram_addr_t data_length,void* data_ptr,fram_callback_t callback,void* ctx);
+fram_st read_FRAM_async(uint8_t device,fram_addr_t address,fram_addr_t data_length,void* data_ptr,fram_callback_t callback,void* ctx);
+
+int open_FRAM_image(const char* path);
+void close_FRAM_image(void);
+void set_FRAM_bus_config(const fram_bus_config_t* config);
+void get_FRAM_bus_config(fram_bus_config_t* config);
+void get_FRAM_bus_cost(fram_bus_cost_t* cost);
+void reset_FRAM_bus_cost(void);
+
+#endif /* INC_DUMMY_FRAM_DRIVER_H_ */
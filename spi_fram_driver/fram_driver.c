@@ -17,14 +17,110 @@
 #define WRITE 0b00000010 //Write Data
 #define RDID  0b10011111 //Read Device ID
 
-void FRAM_Reset_CS()
+#define FILL_CHUNK_SIZE 32 //Bytes of the stack buffer fill_FRAM streams repeatedly
+#define HAL_MAX_TRANSFER 0xFFFF //Largest transfer a single HAL SPI call can make
+
+/*SPI buses the FRAM chips are connected to, and the bus and chip select pin of each chip. Adapt them to your board,
+ e.g. a second chip on the same bus would be {0, GPIOA, GPIO_PIN_1}, and a chip on a second bus {1, GPIOB, GPIO_PIN_0}
+ with &hspi2 added to fram_buses. Chips on different buses can transfer at the same time*/
+typedef struct
+{
+	uint8_t bus;
+	GPIO_TypeDef* cs_port;
+	uint16_t cs_pin;
+} fram_device_t;
+
+static SPI_HandleTypeDef* const fram_buses[FRAM_BUSES] = {&hspi1};
+static const fram_device_t fram_devices[FRAM_DEVICES] = {{0, GPIOA, GPIO_PIN_0}};
+
+#define FRAM_SPI(device) (fram_buses[fram_devices[device].bus])
+
+/*Convert an address into the FRAM_ADDR_BYTES bytes sent after the READ and WRITE opcodes, most significant first*/
+static void FRAM_Address_Bytes(fram_addr_t address,uint8_t* byte_add)
+{
+	for (int8_t idx = FRAM_ADDR_BYTES-1; idx >= 0; idx--)
+	{
+		byte_add[idx] = 0xFF & address;
+		address >>= 8;
+	}
+}
+
+/*Blocking transfers of any length, split in as many HAL calls as needed*/
+static void FRAM_Transmit(SPI_HandleTypeDef* hspi,void* data_ptr,fram_addr_t data_length)
+{
+	uint8_t* data = data_ptr;
+	while (data_length)
+	{
+		uint16_t chunk = (data_length > HAL_MAX_TRANSFER) ? HAL_MAX_TRANSFER : data_length;
+		HAL_SPI_Transmit(hspi, data, chunk, 100);
+		data += chunk;
+		data_length -= chunk;
+	}
+}
+
+static void FRAM_Receive(SPI_HandleTypeDef* hspi,void* data_ptr,fram_addr_t data_length)
+{
+	uint8_t* data = data_ptr;
+	while (data_length)
+	{
+		uint16_t chunk = (data_length > HAL_MAX_TRANSFER) ? HAL_MAX_TRANSFER : data_length;
+		HAL_SPI_Receive(hspi, data, chunk, 100);
+		data += chunk;
+		data_length -= chunk;
+	}
+}
+
+/*Get how many segments, starting at the first one, are contiguous in FRAM and can thus share a single transaction*/
+static uint16_t FRAM_Contiguous_Segments(const fram_segment_t* segments,uint16_t segment_count)
 {
-	HAL_GPIO_WritePin(GPIOA, GPIO_PIN_0, GPIO_PIN_RESET);
+	uint16_t count = 1;
+	while ((count < segment_count) &&
+		   (segments[count].address == segments[count-1].address+segments[count-1].data_length))
+	{
+		count++;
+	}
+	return count;
 }
 
-void FRAM_Set_CS()
+/*State of the asynchronous transfer in progress on each bus, if any: the phase being sent or received*/
+typedef enum
+{
+	FRAM_ASYNC_IDLE,
+	FRAM_ASYNC_WRITE_ENABLE,
+	FRAM_ASYNC_WRITE_HEADER,
+	FRAM_ASYNC_WRITE_DATA,
+	FRAM_ASYNC_WRITE_DISABLE,
+	FRAM_ASYNC_READ_HEADER,
+	FRAM_ASYNC_READ_DATA,
+} fram_async_state;
+
+typedef struct
 {
-	HAL_GPIO_WritePin(GPIOA, GPIO_PIN_0, GPIO_PIN_SET);
+	volatile fram_async_state state;
+	uint8_t device;
+	uint8_t header[1+FRAM_ADDR_BYTES]; //opcode and address, sent by interrupt so kept until the transfer is over
+	uint8_t* data_ptr;
+	fram_addr_t data_length;
+	fram_callback_t callback;
+	void* ctx;
+} fram_async_t;
+
+static fram_async_t async_transfers[FRAM_BUSES];
+
+void FRAM_Reset_CS(uint8_t device)
+{
+	HAL_GPIO_WritePin(fram_devices[device].cs_port, fram_devices[device].cs_pin, GPIO_PIN_RESET);
+}
+
+void FRAM_Set_CS(uint8_t device)
+{
+	HAL_GPIO_WritePin(fram_devices[device].cs_port, fram_devices[device].cs_pin, GPIO_PIN_SET);
+}
+
+/*Get the index in fram_buses of the bus a device is on*/
+uint8_t get_FRAM_bus(uint8_t device)
+{
+	return fram_devices[device].bus;
 }
 
 /*Function that writes the FRAM ID in data_ptr by
@@ -32,21 +128,22 @@ void FRAM_Set_CS()
 	2. sending the RDID command via SPI
 	3. receiving 4 bytes of response via SPI
 	4. setting the FRAM SPI CS pin */
-void get_FRAM_ID(void* data_ptr)
+void get_FRAM_ID(uint8_t device,void* data_ptr)
 {
+	  SPI_HandleTypeDef* hspi = FRAM_SPI(device);
 	  uint8_t command;
 
-	  FRAM_Reset_CS();
+	  FRAM_Reset_CS(device);
 
 	  command = RDID;
-	  HAL_SPI_Transmit(&hspi1, &command, 1, 100);
-	  HAL_SPI_Receive(&hspi1, data_ptr, 4, 100);
+	  HAL_SPI_Transmit(hspi, &command, 1, 100);
+	  HAL_SPI_Receive(hspi, data_ptr, 4, 100);
 
-	  FRAM_Set_CS();
+	  FRAM_Set_CS(device);
 }
 
-/*Function that takes a uint16_t address, reads data_length bytes at data_ptr, and writes them at the FRAM location specified by address by:
-	1. converting the uint16_t address into a 2 uint8_t array
+/*Function that takes an address, reads data_length bytes at data_ptr, and writes them at the FRAM location specified by address by:
+	1. converting the address into a FRAM_ADDR_BYTES uint8_t array
 	2. resetting the FRAM SPI CS pin
 	3. sending the WREN command via SPI
 	4. Setting and resetting the CS pin
@@ -55,55 +152,375 @@ void get_FRAM_ID(void* data_ptr)
 	7. Setting and resetting the CS pin
 	8. sending the WRDI command via SPI
 	9. setting the FRAM SPI CS pin */
-void write_FRAM(uint16_t address,uint16_t data_length,void* data_ptr)
+void write_FRAM(uint8_t device,fram_addr_t address,fram_addr_t data_length,void* data_ptr)
 {
+	SPI_HandleTypeDef* hspi = FRAM_SPI(device);
 	uint8_t command;
-	uint8_t byte_add[2];
-	byte_add[0] = (0xFF00 & address) >> 8;
-	byte_add[1] = 0x00FF & address;
+	uint8_t byte_add[FRAM_ADDR_BYTES];
+	FRAM_Address_Bytes(address,byte_add);
 
-	FRAM_Reset_CS();
+	FRAM_Reset_CS(device);
 
 	command = WREN;
-	HAL_SPI_Transmit(&hspi1, &command, 1, 100);
+	HAL_SPI_Transmit(hspi, &command, 1, 100);
 
-	FRAM_Set_CS();
-	FRAM_Reset_CS();
+	FRAM_Set_CS(device);
+	FRAM_Reset_CS(device);
 
 	command = WRITE;
-	HAL_SPI_Transmit(&hspi1, &command, 1, 100);
-	HAL_SPI_Transmit(&hspi1, byte_add, 2, 100);
-	HAL_SPI_Transmit(&hspi1, data_ptr, data_length, 100);
+	HAL_SPI_Transmit(hspi, &command, 1, 100);
+	HAL_SPI_Transmit(hspi, byte_add, FRAM_ADDR_BYTES, 100);
+	FRAM_Transmit(hspi, data_ptr, data_length);
+
+	FRAM_Set_CS(device);
+	FRAM_Reset_CS(device);
+
+	command = WRDI;
+	HAL_SPI_Transmit(hspi, &command, 1, 100);
+
+	FRAM_Set_CS(device);
+}
+
+/*Function that takes an address and writes value in the data_length FRAM bytes starting at that address,
+ in a single write transaction, by:
+	1. converting the address into a FRAM_ADDR_BYTES uint8_t array
+	2. filling a small buffer with value
+	3. resetting the FRAM SPI CS pin
+	4. sending the WREN command via SPI
+	5. Setting and resetting the CS pin
+	6. sending the WRITE command via SPI
+	7. sending the buffer via SPI as many times as needed to cover data_length bytes
+	8. Setting and resetting the CS pin
+	9. sending the WRDI command via SPI
+	10. setting the FRAM SPI CS pin */
+void fill_FRAM(uint8_t device,fram_addr_t address,fram_addr_t data_length,uint8_t value)
+{
+	SPI_HandleTypeDef* hspi = FRAM_SPI(device);
+	uint8_t command;
+	uint8_t byte_add[FRAM_ADDR_BYTES];
+	FRAM_Address_Bytes(address,byte_add);
+
+	uint8_t fill[FILL_CHUNK_SIZE];
+	for (uint8_t idx = 0; idx < FILL_CHUNK_SIZE; idx++)
+	{
+		fill[idx] = value;
+	}
+
+	FRAM_Reset_CS(device);
+
+	command = WREN;
+	HAL_SPI_Transmit(hspi, &command, 1, 100);
+
+	FRAM_Set_CS(device);
+	FRAM_Reset_CS(device);
+
+	command = WRITE;
+	HAL_SPI_Transmit(hspi, &command, 1, 100);
+	HAL_SPI_Transmit(hspi, byte_add, FRAM_ADDR_BYTES, 100);
+	while (data_length)
+	{
+		uint16_t chunk = (data_length > FILL_CHUNK_SIZE) ? FILL_CHUNK_SIZE : data_length;
+		HAL_SPI_Transmit(hspi, fill, chunk, 100);
+		data_length -= chunk;
+	}
+
+	FRAM_Set_CS(device);
+	FRAM_Reset_CS(device);
+
+	command = WRDI;
+	HAL_SPI_Transmit(hspi, &command, 1, 100);
+
+	FRAM_Set_CS(device);
+}
+
+/*Function that writes a list of segments, each being data_length bytes at data_ptr to be written at the FRAM location
+ specified by address. Segments that are contiguous in FRAM are merged into a single WRITE transaction, and WRDI is
+ only sent once at the end. The FRAM clears its write enable latch at the end of every WRITE, so each transaction is
+ still preceded by WREN. For each group of contiguous segments:
+	1. converting the address of its first segment into a FRAM_ADDR_BYTES uint8_t array
+	2. resetting the FRAM SPI CS pin
+	3. sending the WREN command via SPI
+	4. Setting and resetting the CS pin
+	5. sending the WRITE command and address via SPI
+	6. sending the data of every segment in the group via SPI
+	7. setting the FRAM SPI CS pin
+ and then:
+	8. resetting the FRAM SPI CS pin
+	9. sending the WRDI command via SPI
+	10. setting the FRAM SPI CS pin */
+void write_FRAM_v(uint8_t device,const fram_segment_t* segments,uint16_t segment_count)
+{
+	SPI_HandleTypeDef* hspi = FRAM_SPI(device);
+	uint8_t command;
+	uint8_t byte_add[FRAM_ADDR_BYTES];
 
-	FRAM_Set_CS();
-	FRAM_Reset_CS();
+	if (!segment_count)
+	{
+		return;
+	}
+	while (segment_count)
+	{
+		uint16_t group = FRAM_Contiguous_Segments(segments, segment_count);
+		FRAM_Address_Bytes(segments[0].address,byte_add);
+
+		FRAM_Reset_CS(device);
+
+		command = WREN;
+		HAL_SPI_Transmit(hspi, &command, 1, 100);
+
+		FRAM_Set_CS(device);
+		FRAM_Reset_CS(device);
+
+		command = WRITE;
+		HAL_SPI_Transmit(hspi, &command, 1, 100);
+		HAL_SPI_Transmit(hspi, byte_add, FRAM_ADDR_BYTES, 100);
+		for (uint16_t idx = 0; idx < group; idx++)
+		{
+			FRAM_Transmit(hspi, segments[idx].data_ptr, segments[idx].data_length);
+		}
+
+		FRAM_Set_CS(device);
+
+		segments += group;
+		segment_count -= group;
+	}
+	FRAM_Reset_CS(device);
 
 	command = WRDI;
-	HAL_SPI_Transmit(&hspi1, &command, 1, 100);
+	HAL_SPI_Transmit(hspi, &command, 1, 100);
+
+	FRAM_Set_CS(device);
+}
+
+/*Function that reads a list of segments, each being data_length bytes at the FRAM location specified by address to be
+ written at data_ptr. Segments that are contiguous in FRAM are merged into a single READ transaction. For each group
+ of contiguous segments:
+	1. converting the address of its first segment into a FRAM_ADDR_BYTES uint8_t array
+	2. resetting the FRAM SPI CS pin
+	3. sending the READ command and address via SPI
+	4. receiving the data of every segment in the group via SPI
+	5. setting the FRAM SPI CS pin */
+void read_FRAM_v(uint8_t device,const fram_segment_t* segments,uint16_t segment_count)
+{
+	SPI_HandleTypeDef* hspi = FRAM_SPI(device);
+	uint8_t command;
+	uint8_t byte_add[FRAM_ADDR_BYTES];
 
-	FRAM_Set_CS();
+	while (segment_count)
+	{
+		uint16_t group = FRAM_Contiguous_Segments(segments, segment_count);
+		FRAM_Address_Bytes(segments[0].address,byte_add);
+
+		FRAM_Reset_CS(device);
+
+		command = READ;
+		HAL_SPI_Transmit(hspi, &command, 1, 100);
+		HAL_SPI_Transmit(hspi, byte_add, FRAM_ADDR_BYTES, 100);
+		for (uint16_t idx = 0; idx < group; idx++)
+		{
+			FRAM_Receive(hspi, segments[idx].data_ptr, segments[idx].data_length);
+		}
+
+		FRAM_Set_CS(device);
+
+		segments += group;
+		segment_count -= group;
+	}
 }
 
-/*Function that takes a uint16_t address, reads data_length bytes at the FRAM location specified by address, and writes them in data_ptr by:
-	1. converting the uint16_t address into a 2 uint8_t array
+/*Function that takes an address, reads data_length bytes at the FRAM location specified by address, and writes them in data_ptr by:
+	1. converting the address into a FRAM_ADDR_BYTES uint8_t array
 	2. resetting the FRAM SPI CS pin
 	3. sending the READ command via SPI
 	4. receiving data_length bytes of data via SPI
 	5. setting the FRAM SPI CS pin */
-void read_FRAM(uint16_t address,uint16_t data_length,void* data_ptr)
+void read_FRAM(uint8_t device,fram_addr_t address,fram_addr_t data_length,void* data_ptr)
 {
-	uint8_t byte_add[2];
-	byte_add[0] = (0xFF00 & address) >> 8;
-	byte_add[1] = 0x00FF & address;
+	SPI_HandleTypeDef* hspi = FRAM_SPI(device);
+	uint8_t byte_add[FRAM_ADDR_BYTES];
+	FRAM_Address_Bytes(address,byte_add);
 
 	uint8_t command;
 
-	FRAM_Reset_CS();
+	FRAM_Reset_CS(device);
 
 	command = READ;
-	HAL_SPI_Transmit(&hspi1, &command, 1, 100);
-	HAL_SPI_Transmit(&hspi1, byte_add, 2, 100);
-	HAL_SPI_Receive(&hspi1, data_ptr, data_length, 100);
+	HAL_SPI_Transmit(hspi, &command, 1, 100);
+	HAL_SPI_Transmit(hspi, byte_add, FRAM_ADDR_BYTES, 100);
+	FRAM_Receive(hspi, data_ptr, data_length);
+
+	FRAM_Set_CS(device);
+}
+
+/*Set up the asynchronous transfer of a bus and send its first phase, the first byte_count bytes of its header, by
+ interrupt. Returns FRAM_BUSY if the bus already has one in progress*/
+static fram_st FRAM_Async_Start(uint8_t device,fram_async_state state,uint8_t opcode,uint8_t byte_count,
+		fram_addr_t address,fram_addr_t data_length,void* data_ptr,fram_callback_t callback,void* ctx)
+{
+	SPI_HandleTypeDef* hspi = FRAM_SPI(device);
+	fram_async_t* transfer = &async_transfers[fram_devices[device].bus];
+
+	if (transfer->state != FRAM_ASYNC_IDLE)
+	{
+		return FRAM_BUSY;
+	}
+	if (data_length > HAL_MAX_TRANSFER)
+	{
+		return FRAM_ERROR;
+	}
+	transfer->header[0] = opcode;
+	FRAM_Address_Bytes(address,&transfer->header[1]);
+	transfer->state = state;
+	transfer->device = device;
+	transfer->data_ptr = data_ptr;
+	transfer->data_length = data_length;
+	transfer->callback = callback;
+	transfer->ctx = ctx;
+
+	FRAM_Reset_CS(device);
+	if (HAL_SPI_Transmit_IT(hspi, transfer->header, byte_count) != HAL_OK)
+	{
+		FRAM_Set_CS(device);
+		transfer->state = FRAM_ASYNC_IDLE;
+		return FRAM_ERROR;
+	}
+	return FRAM_OK;
+}
+
+/*Function that starts writing data_length bytes at data_ptr at the FRAM location specified by address, and returns
+ before the data is sent. Opcodes and address are sent by interrupt and the data by DMA, each phase being started
+ from the completion callback of the previous one, so nothing blocks in interrupt context and the callback may start
+ the next transfer. The data must stay valid (and, with the D-cache enabled, be placed in non cacheable memory) until
+ callback is called, by:
+	1. checking no other asynchronous transfer is in progress on the device's bus, and the data fits a single DMA transfer
+	2. converting the address into a FRAM_ADDR_BYTES uint8_t array
+	3. resetting the FRAM SPI CS pin
+	4. starting to send the WREN command
+	HAL_SPI_TxCpltCallback then sets and resets the CS pin, sends the WRITE command and address, the data, sets and
+	resets the CS pin again, sends WRDI, sets the CS pin and calls callback */
+fram_st write_FRAM_async(uint8_t device,fram_addr_t address,fram_addr_t data_length,void* data_ptr,fram_callback_t callback,void* ctx)
+{
+	return FRAM_Async_Start(device,FRAM_ASYNC_WRITE_ENABLE,WREN,1,address,data_length,data_ptr,callback,ctx);
+}
+
+/*Function that starts reading data_length bytes at the FRAM location specified by address into data_ptr, and returns
+ before the data is received. data_ptr must stay valid (and, with the D-cache enabled, be placed in non cacheable
+ memory) until callback is called, by:
+	1. checking no other asynchronous transfer is in progress on the device's bus, and the data fits a single DMA transfer
+	2. converting the address into a FRAM_ADDR_BYTES uint8_t array
+	3. resetting the FRAM SPI CS pin
+	4. starting to send the READ command and address by interrupt
+	HAL_SPI_TxCpltCallback then starts the DMA reception of the data, and HAL_SPI_RxCpltCallback sets the CS pin and
+	calls callback */
+fram_st read_FRAM_async(uint8_t device,fram_addr_t address,fram_addr_t data_length,void* data_ptr,fram_callback_t callback,void* ctx)
+{
+	return FRAM_Async_Start(device,FRAM_ASYNC_READ_HEADER,READ,1+FRAM_ADDR_BYTES,address,data_length,data_ptr,
+			callback,ctx);
+}
+
+/*Get the asynchronous transfer of the bus a HAL callback is for, or NULL if that bus isn't an FRAM one*/
+static fram_async_t* FRAM_Async_Transfer(SPI_HandleTypeDef *hspi)
+{
+	for (uint8_t bus = 0; bus < FRAM_BUSES; bus++)
+	{
+		if (fram_buses[bus] == hspi)
+		{
+			return &async_transfers[bus];
+		}
+	}
+	return NULL;
+}
+
+/*End an asynchronous transfer and report it. The state is set idle before calling back so the callback can start
+ the next transfer */
+static void FRAM_Async_Done(fram_async_t* transfer,fram_st status)
+{
+	fram_callback_t callback = transfer->callback;
+
+	transfer->state = FRAM_ASYNC_IDLE;
+	if (callback != NULL)
+	{
+		callback(status, transfer->ctx);
+	}
+}
+
+/*Start the next phase of an asynchronous transfer once the current one is sent or received, ending the transfer
+ after the last one*/
+static void FRAM_Async_Next(SPI_HandleTypeDef *hspi,fram_async_t* transfer)
+{
+	HAL_StatusTypeDef status;
+
+	switch (transfer->state)
+	{
+	case FRAM_ASYNC_WRITE_ENABLE:
+		/*WREN takes effect once the CS pin is set*/
+		FRAM_Set_CS(transfer->device);
+		FRAM_Reset_CS(transfer->device);
+		transfer->header[0] = WRITE;
+		transfer->state = FRAM_ASYNC_WRITE_HEADER;
+		status = HAL_SPI_Transmit_IT(hspi, transfer->header, 1+FRAM_ADDR_BYTES);
+		break;
+	case FRAM_ASYNC_WRITE_HEADER:
+		transfer->state = FRAM_ASYNC_WRITE_DATA;
+		status = HAL_SPI_Transmit_DMA(hspi, transfer->data_ptr, transfer->data_length);
+		break;
+	case FRAM_ASYNC_WRITE_DATA:
+		FRAM_Set_CS(transfer->device);
+		FRAM_Reset_CS(transfer->device);
+		transfer->header[0] = WRDI;
+		transfer->state = FRAM_ASYNC_WRITE_DISABLE;
+		status = HAL_SPI_Transmit_IT(hspi, transfer->header, 1);
+		break;
+	case FRAM_ASYNC_READ_HEADER:
+		transfer->state = FRAM_ASYNC_READ_DATA;
+		status = HAL_SPI_Receive_DMA(hspi, transfer->data_ptr, transfer->data_length);
+		break;
+	default:
+		/*WRDI sent or data received*/
+		FRAM_Set_CS(transfer->device);
+		FRAM_Async_Done(transfer, FRAM_OK);
+		return;
+	}
+	if (status != HAL_OK)
+	{
+		FRAM_Set_CS(transfer->device);
+		FRAM_Async_Done(transfer, FRAM_ERROR);
+	}
+}
+
+/*HAL interrupt and DMA completion callbacks, which need the SPI global interrupt enabled as well as its DMA streams.
+ If the application also uses them for other SPI peripherals, rename these and call them from the application's
+ callbacks instead*/
+void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi)
+{
+	fram_async_t* transfer = FRAM_Async_Transfer(hspi);
+
+	if ((transfer == NULL) || (transfer->state == FRAM_ASYNC_IDLE) || (transfer->state == FRAM_ASYNC_READ_DATA))
+	{
+		return;
+	}
+	FRAM_Async_Next(hspi, transfer);
+}
+
+void HAL_SPI_RxCpltCallback(SPI_HandleTypeDef *hspi)
+{
+	fram_async_t* transfer = FRAM_Async_Transfer(hspi);
+
+	if ((transfer == NULL) || (transfer->state != FRAM_ASYNC_READ_DATA))
+	{
+		return;
+	}
+	FRAM_Async_Next(hspi, transfer);
+}
+
+void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi)
+{
+	fram_async_t* transfer = FRAM_Async_Transfer(hspi);
 
-	FRAM_Set_CS();
+	if ((transfer == NULL) || (transfer->state == FRAM_ASYNC_IDLE))
+	{
+		return;
+	}
+	FRAM_Set_CS(transfer->device);
+	FRAM_Async_Done(transfer, FRAM_ERROR);
 }
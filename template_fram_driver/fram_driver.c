@@ -9,17 +9,47 @@
 
 
 
-void get_FRAM_ID(void* data_ptr)
+uint8_t get_FRAM_bus(uint8_t device)
 {
-	***Write here a function that writes the FRAM ID in data_ptr***
+	***Write here a function that returns the index (0 to FRAM_BUSES-1) of the bus device is on***
 }
 
-void write_FRAM(uint16_t address,uint16_t data_length,void* data_ptr)
+void get_FRAM_ID(uint8_t device,void* data_ptr)
 {
-	***Write here a function that takes a uint16_t address, reads data_length bytes at data_ptr, and writes them at the FRAM location specified by address***
+	***Write here a function that writes the ID of the FRAM selected by device in data_ptr***
 }
 
-void read_FRAM(uint16_t address,uint16_t data_length,void* data_ptr)
+void write_FRAM(uint8_t device,fram_addr_t address,fram_addr_t data_length,void* data_ptr)
 {
-	***Write here a function that takes a uint16_t address, reads data_length bytes at the FRAM location specified by address, and writes them in data_ptr***
+	***Write here a function that takes an address, reads data_length bytes at data_ptr, and writes them at the location specified by address of the FRAM selected by device***
+}
+
+void read_FRAM(uint8_t device,fram_addr_t address,fram_addr_t data_length,void* data_ptr)
+{
+	***Write here a function that takes an address, reads data_length bytes at the FRAM location specified by address, and writes them in data_ptr***
+}
+
+void fill_FRAM(uint8_t device,fram_addr_t address,fram_addr_t data_length,uint8_t value)
+{
+	***Write here a function that takes an address and writes value in the data_length FRAM bytes starting at address, ideally streaming them in a single write transaction***
+}
+
+void write_FRAM_v(uint8_t device,const fram_segment_t* segments,uint16_t segment_count)
+{
+	***Write here a function that writes each segment's data_length bytes at data_ptr at the FRAM location specified by its address. Send segments that are contiguous in FRAM in a single write transaction, and keep write enable/disable commands to the minimum your FRAM allows***
+}
+
+void read_FRAM_v(uint8_t device,const fram_segment_t* segments,uint16_t segment_count)
+{
+	***Write here a function that reads each segment's data_length bytes at the FRAM location specified by its address into data_ptr. Read segments that are contiguous in FRAM in a single read transaction***
+}
+
+fram_st write_FRAM_async(uint8_t device,fram_addr_t address,fram_addr_t data_length,void* data_ptr,fram_callback_t callback,void* ctx)
+{
+	***Write here a function that starts writing data_length bytes at data_ptr at the FRAM location specified by address (e.g. with DMA) and returns FRAM_OK without waiting, or FRAM_BUSY if a transfer is already in progress on the device's bus. Once the transfer ends, mark the driver idle and call callback with its status and ctx***
+}
+
+fram_st read_FRAM_async(uint8_t device,fram_addr_t address,fram_addr_t data_length,void* data_ptr,fram_callback_t callback,void* ctx)
+{
+	***Write here a function that starts reading data_length bytes at the FRAM location specified by address into data_ptr and returns FRAM_OK without waiting, or FRAM_BUSY if a transfer is already in progress on the device's bus. Once the transfer ends, mark the driver idle and call callback with its status and ctx***
 }
@@ -7,7 +7,10 @@
 #ifndef INC_FRAM_DRIVER_H_
 #define INC_FRAM_DRIVER_H_
 
-#define FRAM_SIZE ***INSERT THE SIZE OF YOUR FRAM HERE*** //Sizes in bytes of the FRAM
+#define FRAM_SIZE ***INSERT THE SIZE OF YOUR FRAM HERE*** //Sizes in bytes of each FRAM
+#define FRAM_ADDR_BYTES ***INSERT THE NUMBER OF ADDRESS BYTES OF YOUR FRAM HERE*** //Address bytes sent after the READ and WRITE opcodes
+#define FRAM_DEVICES ***INSERT THE NUMBER OF FRAM CHIPS HERE*** //FRAM chips BFFS stripes its volume over, 1 for a single chip
+#define FRAM_BUSES ***INSERT THE NUMBER OF BUSES THE CHIPS ARE ON HERE*** //Buses the FRAM chips are spread over
 
 #include <stdint.h>
 
@@ -15,8 +18,45 @@
 
 ***Declare your peripherals handlers*** 
 
-void get_FRAM_ID(void* data_ptr);
-void write_FRAM(uint16_t address,uint16_t data_length,void* data_ptr);
-void read_FRAM(uint16_t address,uint16_t data_length,void* data_ptr);
+/*FRAM address and length type: 16 bits unless the parts need wider addresses or all of them together exceed 64 KB,
+ so small setups keep compact pointers*/
+#if (FRAM_ADDR_BYTES > 2) || ((FRAM_SIZE)*(FRAM_DEVICES) > 65535)
+typedef uint32_t fram_addr_t;
+#define FRAM_ADDR_MAX UINT32_MAX
+#else
+typedef uint16_t fram_addr_t;
+#define FRAM_ADDR_MAX UINT16_MAX
+#endif
+
+/*Segment of a vectored transfer: data_length bytes at data_ptr are written to (or read from) the FRAM at address*/
+typedef struct
+{
+	fram_addr_t address;
+	fram_addr_t data_length;
+	void* data_ptr;
+} fram_segment_t;
+
+/*Status of an asynchronous driver transfer*/
+typedef enum
+{
+	FRAM_OK,	//transfer started (when returned) or completed (when passed to the callback)
+	FRAM_BUSY,	//another asynchronous transfer is still in progress on the bus, nothing was started
+	FRAM_ERROR,	//the peripheral reported an error
+} fram_st;
+
+/*Called once an asynchronous transfer completes*/
+typedef void (*fram_callback_t)(fram_st status, void* ctx);
+
+/*Every function takes the index of the FRAM device (0 to FRAM_DEVICES-1) it talks to, addresses being within that
+ device. Asynchronous transfers on different buses can be in progress at the same time*/
+uint8_t get_FRAM_bus(uint8_t device);
+void get_FRAM_ID(uint8_t device,void* data_ptr);
+void write_FRAM(uint8_t device,fram_addr_t address,fram_addr_t data_length,void* data_ptr);
+void read_FRAM(uint8_t device,fram_addr_t address,fram_addr_t data_length,void* data_ptr);
+void fill_FRAM(uint8_t device,fram_addr_t address,fram_addr_t data_length,uint8_t value);
+void write_FRAM_v(uint8_t device,const fram_segment_t* segments,uint16_t segment_count);
+void read_FRAM_v(uint8_t device,const fram_segment_t* segments,uint16_t segment_count);
+fram_st write_FRAM_async(uint8_t device,fram_addr_t address,fram_addr_t data_length,void* data_ptr,fram_callback_t callback,void* ctx);
+fram_st read_FRAM_async(uint8_t device,fram_addr_t address,fram_addr_t data_length,void* data_ptr,fram_callback_t callback,void* ctx);
 
 #endif /* INC_DUMMY_FRAM_DRIVER_H_ */